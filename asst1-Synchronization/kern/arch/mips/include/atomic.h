@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _MIPS_ATOMIC_H_
+#define _MIPS_ATOMIC_H_
+
+/*
+ * Atomic operations using LL/SC. See the comments on
+ * spinlock_data_testandset in spinlock.h for how LL and SC work.
+ * Because there may be no other memory accesses between the LL and
+ * the SC, the whole retry loop has to be written in assembler; we
+ * can't let the compiler see it and possibly spill registers.
+ *
+ * See include/atomic.h for further information.
+ */
+
+ATOMIC_INLINE
+unsigned
+atomic_add(volatile unsigned *p, unsigned delta)
+{
+	unsigned x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + delta */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   if it failed, try again */
+		"nop;"			/*   (delay slot) */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (delta) : "memory");
+	return x + delta;
+}
+
+ATOMIC_INLINE
+bool
+atomic_cas(volatile unsigned *p, unsigned oldval, unsigned newval)
+{
+	unsigned x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   if x != oldval, give up */
+		"move %1, %4;"		/*   y = newval (delay slot) */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   if it failed, try again */
+		"nop;"			/*   (delay slot) */
+		"2:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (oldval), "r" (newval)
+		: "memory");
+	return x == oldval;
+}
+
+#endif /* _MIPS_ATOMIC_H_ */
@@ -39,6 +39,7 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include <kstat.h>
 
 
 /* in exception-*.S */
@@ -230,6 +231,9 @@ mips_trap(struct trapframe *tf)
 	 * Call vm_fault on the TLB exceptions.
 	 * Panic on the bus error exceptions.
 	 */
+	if (code == EX_MOD || code == EX_TLBL || code == EX_TLBS) {
+		pcpu_counter_add(&kstat_vmfaults, 1);
+	}
 	switch (code) {
 	case EX_MOD:
 		if (vm_fault(VM_FAULT_READONLY, tf->tf_vaddr)==0) {
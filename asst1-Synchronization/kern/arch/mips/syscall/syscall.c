@@ -35,6 +35,7 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <kstat.h>
 
 
 /*
@@ -88,6 +89,8 @@ syscall(struct trapframe *tf)
 
 	callno = tf->tf_v0;
 
+	pcpu_counter_add(&kstat_syscalls, 1);
+
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
 	 * really return a value, just 0 for success and -1 on
@@ -1,8 +1,8 @@
 /* This file will contain your solution. Modify it as you wish. */
-// a linked list is used to implement the queue
+// the queue is the kernel work queue (see workqueue.h)
 #include <types.h>
 #include <lib.h>
-#include <synch.h>
+#include <workqueue.h>
 #include <kern/errno.h>
 #include "client_server.h"
 
@@ -10,19 +10,15 @@
  * Declare any variables you need here to implement and
  *  synchronise your queues and/or requests.
  */
-struct queue{
-        struct node* head;
-        struct node* tail;
-        struct node* current;
-};
-
-struct node{
-        request_t *request;
-        struct node *next;
-};
-struct cv *empty;
-struct queue *new_queue;
-struct lock *new_lock;
+
+/* Number of local queues in the work queue. Each cpu uses queue
+   (cpu number % WQ_QUEUES) first, and steals from the others. */
+#define WQ_QUEUES 4
+
+/* Most requests work_queue_get_batch() takes at once. */
+#define WQ_BATCH_MAX 16
+
+static struct workqueue *requests;
 
 /* work_queue_enqueue():
  *
@@ -43,20 +39,11 @@ struct lock *new_lock;
 
 void work_queue_enqueue(request_t *req)
 {
-        lock_acquire(new_lock);
-        // add request to a node in the queue
-        struct node *new_node = kmalloc(sizeof(struct node));
-        new_node->request = req;
-        new_node->next = NULL;
-        if (new_queue->head == NULL)
-                new_queue->head = new_node;
-        if (new_queue->current == NULL)
-                new_queue->current = new_node;
-        if (new_queue->tail != NULL)
-                new_queue->tail->next = new_node;
-        new_queue->tail = new_node;
-        cv_signal(empty, new_lock);
-        lock_release(new_lock);
+        // nodes are recycled, so this only allocates while the
+        // queue is growing to its working size
+        if (workqueue_enqueue(requests, req)) {
+                panic("work_queue_enqueue: out of memory");
+        }
 }
 
 /*
@@ -76,16 +63,33 @@ void work_queue_enqueue(request_t *req)
 
 request_t *work_queue_get_next(void)
 {
-        lock_acquire(new_lock);
-        // no requests waiting to be processed
-        while(new_queue->current == NULL)
-                cv_wait(empty, new_lock);
-        request_t *req = new_queue->current->request;
-        new_queue->current = new_queue->current->next;
-        lock_release(new_lock);
+        request_t *req;
+
+        work_queue_get_batch(&req, 1);
         return req;
 }
 
+/*
+ * work_queue_get_batch():
+ *
+ * Like work_queue_get_next(), but takes up to MAX requests at once,
+ * so a server that wakes up can pick up everything that arrived
+ * while it was asleep.
+ */
+
+unsigned work_queue_get_batch(request_t **reqs, unsigned max)
+{
+        void *items[WQ_BATCH_MAX];
+        unsigned i, n;
+
+        if (max > WQ_BATCH_MAX)
+                max = WQ_BATCH_MAX;
+        n = workqueue_dequeue(requests, items, max);
+        for (i = 0; i < n; i++)
+                reqs[i] = items[i];
+        return n;
+}
+
 
 
 
@@ -103,15 +107,9 @@ request_t *work_queue_get_next(void)
 
 int work_queue_setup(void)
 {
-        new_queue = kmalloc(sizeof(struct queue));
-        empty = cv_create("empty");
-        new_lock = lock_create("new_lock");
-        if (empty == NULL || new_lock == NULL || new_queue == NULL)
-                return ENOSYS;
-        // initialize queue
-        new_queue->head = NULL;
-        new_queue->tail = NULL;
-        new_queue->current = NULL;
+        requests = workqueue_create("requests", WQ_QUEUES);
+        if (requests == NULL)
+                return ENOMEM;
         return 0;
 }
 
@@ -128,14 +126,6 @@ int work_queue_setup(void)
 
 void work_queue_shutdown(void)
 {
-        cv_destroy(empty);
-        lock_destroy(new_lock);
-        // free the node in queue
-        while (new_queue->head != NULL) {
-                struct node *curr = new_queue->head;
-                new_queue->head = new_queue->head->next;
-                kfree(curr);
-        }
-        kfree(new_queue);
-
-}
\ No newline at end of file
+        workqueue_destroy(requests);
+        requests = NULL;
+}
@@ -31,4 +31,9 @@ extern void work_queue_shutdown(void);
 extern void work_queue_enqueue(request_t *request);
 extern request_t *work_queue_get_next(void);
 
+/* Batched version of work_queue_get_next(): get between 1 and MAX
+   requests into REQS, blocking if there are none, and return how
+   many there are. */
+extern unsigned work_queue_get_batch(request_t **reqs, unsigned max);
+
 #endif
@@ -12,6 +12,7 @@
 #include <lib.h>    /* for kprintf */
 #include <synch.h>  /* for P(), V(), sem_* */
 #include <thread.h> /* for thread_fork() */
+#include <clock.h>  /* for gettime() */
 #include <test.h>
 
 #include "client_server.h"
@@ -36,9 +37,27 @@
 static struct semaphore *servers_finished;
 static struct semaphore *clients_finished;
 
+/* Most requests a server takes from the queue at once. */
+#define SERVER_BATCH 4
+
 /* keep some stats for sanity checking */
 static int processed[NUM_SERVERS];
 
+/* and for the throughput/latency report: time from enqueueing each
+   request until the client sees it done, in nanoseconds */
+static uint64_t latency_total[NUM_CLIENTS];
+static uint64_t latency_max[NUM_CLIENTS];
+
+static uint64_t
+nsecs_since(const struct timespec *start)
+{
+        struct timespec now;
+
+        gettime(&now);
+        timespec_sub(&now, start, &now);
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
 /********************************************************************************* 
  * The clients thread's function. This function calls
  * work_queue_enqueue REQUESTS_TO_MAKE times and then
@@ -50,6 +69,8 @@ client_thread(void *unused_ptr, unsigned long client_id)
 {
         int requests_to_go = REQUESTS_TO_MAKE;
         request_t req;
+        struct timespec start;
+        uint64_t latency;
 
         (void)unused_ptr; /* Avoid compiler warnings */
 
@@ -74,9 +95,17 @@ client_thread(void *unused_ptr, unsigned long client_id)
                 req.number = client_id * REQUESTS_TO_MAKE + requests_to_go - 1;
                 req.check = 0;
                 
+                gettime(&start);
+
                 work_queue_enqueue(&req); /* send the request to the servers */
 
                 P(req.done); /* wait for it to be processed */
+
+                latency = nsecs_since(&start);
+                latency_total[client_id] += latency;
+                if (latency > latency_max[client_id]) {
+                        latency_max[client_id] = latency;
+                }
                 
                 if (req.number != ~(req.check)) {
                         panic("My request is corrupt or invalid");
@@ -94,41 +123,58 @@ client_thread(void *unused_ptr, unsigned long client_id)
 /***********************************************************************
  * The server thread's function. NUM_SERVER threads are started, each
  * of which runs this function. The function continuously calls
- * work_queue_get_next() until it receives a special NULL request.
+ * work_queue_get_batch() to get up to SERVER_BATCH requests at a
+ * time, until it receives a special NULL request. If it gets more
+ * than one NULL that way, it puts the extras back for the other
+ * servers.
  */
 static void
 server_thread(void *unused_ptr, unsigned long server_id)
 {
+        request_t  *reqs[SERVER_BATCH];
         request_t  *req;
+        unsigned n, j, stops = 0;
         int delay;
 
         (void)unused_ptr;
 
         kprintf("Server %ld started\n", server_id);
 
-        req = work_queue_get_next();
+        while (stops == 0) {
+                n = work_queue_get_batch(reqs, SERVER_BATCH);
+                KASSERT(n > 0 && n <= SERVER_BATCH);
 
-        while (req != NULL) {
+                for (j = 0; j < n; j++) {
+                        req = reqs[j];
+                        if (req == NULL) {
+                                stops++;
+                                continue;
+                        }
                 
-                /* insert a random delay representing some kind of
-                   processing or I/O */
+                        /* insert a random delay representing some kind of
+                           processing or I/O */
 
-                delay = random() % 16;
-                for (int i = 0; i <= delay; i++) {
-                        thread_yield();
-                }
+                        delay = random() % 16;
+                        for (int i = 0; i <= delay; i++) {
+                                thread_yield();
+                        }
 
-                /* process the request, which in this case is just
-                   writing a check word that is a function of the
-                   number in the request */
-                req->check = ~(req->number); 
+                        /* process the request, which in this case is just
+                           writing a check word that is a function of the
+                           number in the request */
+                        req->check = ~(req->number); 
 
-                processed[server_id]++;
+                        processed[server_id]++;
 
-                V(req->done); /* signal the request is done to the
-                                 client */
+                        V(req->done); /* signal the request is done to the
+                                         client */
+                }
+        }
 
-                req = work_queue_get_next();
+        /* Pass on NULLs that were meant for other servers. */
+        while (stops > 1) {
+                work_queue_enqueue(NULL);
+                stops--;
         }
 
         /* We got a NULL, so signal that we're done. */
@@ -161,6 +207,8 @@ start_client_threads()
         int result;
 
         for(i = 0; i < NUM_CLIENTS; i++) {
+                latency_total[i] = 0;
+                latency_max[i] = 0;
                 result = thread_fork("client thread", NULL,
                                      client_thread, NULL, i);
                 if(result) {
@@ -221,6 +269,8 @@ run_client_server_system(int nargs, char **args)
 {
         int check = 0;
         int i, error;
+        struct timespec start;
+        uint64_t elapsed, total, max;
         (void) nargs; /* Avoid "unused variable" warnings */
         (void) args;
         
@@ -242,11 +292,13 @@ run_client_server_system(int nargs, char **args)
         if (error) panic("work queue setup returned an error\n");
 
         /* Run the simulation */
+        gettime(&start);
         start_client_threads();
         start_server_threads();
 
         /* Wait for all ticket holders and validators to finish */
         wait_for_client_threads();
+        elapsed = nsecs_since(&start);
         stop_server_threads();
 
         /* Run any code required to shut down the work queue */
@@ -257,6 +309,24 @@ run_client_server_system(int nargs, char **args)
                 kprintf("Server %d processed %d requests\n", i, processed[i]);
         }
         kprintf("Giving a total of %d (expected %d)\n", check, NUM_CLIENTS * REQUESTS_TO_MAKE);
+
+        /* Throughput and latency report */
+        total = max = 0;
+        for (i = 0; i < NUM_CLIENTS; i++) {
+                total += latency_total[i];
+                if (latency_max[i] > max) {
+                        max = latency_max[i];
+                }
+        }
+        if (elapsed == 0) {
+                elapsed = 1;
+        }
+        kprintf("Throughput: %llu requests per second\n",
+                (uint64_t)NUM_CLIENTS * REQUESTS_TO_MAKE * 1000000000ULL
+                / elapsed);
+        kprintf("Latency: average %llu us, maximum %llu us\n",
+                total / (NUM_CLIENTS * REQUESTS_TO_MAKE) / 1000,
+                max / 1000);
         
         /* Done! */
         sem_destroy(clients_finished);
@@ -5,6 +5,9 @@
 #include <test.h>
 #include <thread.h>
 #include <synch.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
 
 /* THIS FILE WILL BE REPLACED IN AUTOMARKING SO YOU SHOULD NOT RELY ON ANY CHANGES
    YOU MAKE HERE FOR PERSONAL TESTING */
@@ -20,6 +23,15 @@ enum {
  */
 struct semaphore *finished;
 
+/*
+ * Bitmask of the cpus the incrementers finished on, so the scaling
+ * report can say how many cpus took part. Run this with different
+ * "cpus=" settings in sys161.conf (say 1, 2, 4 and 8) to see how the
+ * counter scales.
+ */
+static struct spinlock cpus_lock = SPINLOCK_INITIALIZER;
+static uint32_t cpus_used;
+
 
 /*
  *  Each thread simply keeps incrementing the counter until it
@@ -41,6 +53,10 @@ static void incrementer_thread(void * unusedpointer, unsigned long threadnumber)
                 counter_increment();
         }
 
+        spinlock_acquire(&cpus_lock);
+        cpus_used |= (uint32_t)1 << curcpu->c_number;
+        spinlock_release(&cpus_lock);
+
         /* signal the top-level tester thread we have finished and
            then exit */
         V(finished);
@@ -62,6 +78,9 @@ static void incrementer_thread(void * unusedpointer, unsigned long threadnumber)
 int counter_tester (int data1, char **data2)
 {
         int index, error, final_count;
+        struct timespec before, after;
+        uint64_t nsecs;
+        unsigned ncpus;
 
         /*
          * Avoid unused variable warnings from the compiler.
@@ -91,6 +110,9 @@ int counter_tester (int data1, char **data2)
 
         kprintf("Starting %d incrementer threads\n", NINCREMENTERS);
 
+        cpus_used = 0;
+        gettime(&before);
+
         for (index = 0; index < NINCREMENTERS; index++) {
                 
                 error = thread_fork("inc thread", NULL, &incrementer_thread, NULL, index);
@@ -115,6 +137,8 @@ int counter_tester (int data1, char **data2)
                 P(finished);
         }
 
+        gettime(&after);
+
 
         /* call the cleanup code for the counter */
         
@@ -122,6 +146,25 @@ int counter_tester (int data1, char **data2)
         
         kprintf("The final count value was %d (expected %d)\n", final_count, NINCREMENTERS * NINCS);
 
+        /* scaling report */
+        timespec_sub(&after, &before, &after);
+        nsecs = after.tv_sec * 1000000000ULL + after.tv_nsec;
+        if (nsecs == 0) {
+                nsecs = 1;
+        }
+        ncpus = 0;
+        for (index = 0; index < 32; index++) {
+                if (cpus_used & ((uint32_t)1 << index)) {
+                        ncpus++;
+                }
+        }
+        kprintf("%d increments on %u cpu(s) in %llu.%09lu seconds: "
+                "%llu increments per second\n",
+                NINCREMENTERS * NINCS, ncpus,
+                (unsigned long long)after.tv_sec,
+                (unsigned long)after.tv_nsec,
+                (uint64_t)NINCREMENTERS * NINCS * 1000000000ULL / nsecs);
+
         /* clean up the semaphore we allocated earlier */
         sem_destroy(finished);
         return 0;
@@ -1,26 +1,187 @@
 /* This file will contain your solution. Modify it as you wish. */
 #include <types.h>
 #include <lib.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <atomic.h>
+#include <wchan.h>
 #include <synch.h>
 #include "producerconsumer.h"
 
-/* Declare any variables you need here to keep track of and
-   synchronise your bounded buffer. A sample declaration of a buffer is shown
-   below. It is an array of pointers to items.
+/* The bounded buffer is a lock-free multi-producer/multi-consumer
+   ring (after Vyukov). Each slot carries a sequence number that says
+   whose turn it is: a slot at position pos is free for the producer
+   that claims pos when its sequence is pos, and holds an item for the
+   consumer that claims pos when its sequence is pos + 1. Producers and
+   consumers claim positions by compare-and-swap on head and tail, and
+   then fill or empty their slots without any lock, so when the buffer
+   is neither full nor empty an item costs one CAS on each side.
 
-   You can change this if you choose another implementation.
-   However, your implementation should accept at least BUFFER_SIZE
-   prior to blocking
-*/
+   Only when the buffer is full (or empty) do threads fall back to
+   sleeping, on a wait channel. The other side only takes the wait lock
+   when somebody is actually asleep.
 
-#define BUFFLEN (BUFFER_SIZE + 1)
+   Positions count up to RING_WRAP and then wrap to 0. RING_WRAP is a
+   multiple of BUFFER_SIZE, so pos % BUFFER_SIZE keeps working across
+   the wrap, and the buffer holds exactly BUFFER_SIZE items. */
 
-data_item_t * item_buffer[BUFFER_SIZE+1];
-struct cv *empty;
-struct cv *full;
-struct lock *new_lock;
+#define RING_WRAP ((0xffffffffU / BUFFER_SIZE) * BUFFER_SIZE)
 
-volatile int head, tail;
+struct ring_slot {
+        volatile unsigned seq;
+        data_item_t *item;
+};
+
+static struct ring_slot ring[BUFFER_SIZE];
+static volatile unsigned head;          /* next position to produce */
+static volatile unsigned tail;          /* next position to consume */
+
+static struct spinlock wait_lock;
+static struct wchan *not_full;
+static struct wchan *not_empty;
+static volatile unsigned sleeping_producers;
+static volatile unsigned sleeping_consumers;
+
+/* Position arithmetic, modulo RING_WRAP. */
+
+static unsigned
+ring_add(unsigned pos, unsigned n)
+{
+        return pos >= RING_WRAP - n ? pos - (RING_WRAP - n) : pos + n;
+}
+
+/* Signed distance from B to A. Sequence numbers are never more than
+   BUFFER_SIZE away from the positions we compare them with, so this
+   can't be fooled by the wrap. */
+static int
+ring_diff(unsigned a, unsigned b)
+{
+        unsigned d;
+
+        d = a >= b ? a - b : a + (RING_WRAP - b);
+        return d < RING_WRAP / 2 ? (int)d : -(int)(RING_WRAP - d);
+}
+
+/* Try to put up to N items in the ring without blocking. Returns the
+   number put, which is 0 if the ring is full. Claims all the slots
+   with a single CAS. */
+static unsigned
+ring_put(data_item_t **items, unsigned n)
+{
+        unsigned pos, k, i;
+        struct ring_slot *slot;
+
+        while (1) {
+                pos = head;
+                /* count consecutive free slots starting at pos */
+                for (k = 0; k < n && k < BUFFER_SIZE; k++) {
+                        slot = &ring[ring_add(pos, k) % BUFFER_SIZE];
+                        if (ring_diff(slot->seq, ring_add(pos, k)) != 0) {
+                                break;
+                        }
+                }
+                if (k == 0) {
+                        slot = &ring[pos % BUFFER_SIZE];
+                        if (ring_diff(slot->seq, pos) < 0) {
+                                /* slot not yet consumed: full */
+                                return 0;
+                        }
+                        /* someone else claimed pos; reload */
+                        continue;
+                }
+                if (atomic_cas(&head, pos, ring_add(pos, k))) {
+                        break;
+                }
+        }
+
+        for (i = 0; i < k; i++) {
+                slot = &ring[ring_add(pos, i) % BUFFER_SIZE];
+                slot->item = items[i];
+                /* the item must be visible before the slot is */
+                membar_store_store();
+                slot->seq = ring_add(pos, i + 1);
+        }
+        return k;
+}
+
+/* Try to take up to N items from the ring without blocking. Returns
+   the number taken, which is 0 if the ring is empty. */
+static unsigned
+ring_get(data_item_t **items, unsigned n)
+{
+        unsigned pos, k, i;
+        struct ring_slot *slot;
+
+        while (1) {
+                pos = tail;
+                for (k = 0; k < n && k < BUFFER_SIZE; k++) {
+                        slot = &ring[ring_add(pos, k) % BUFFER_SIZE];
+                        if (ring_diff(slot->seq,
+                                      ring_add(pos, k + 1)) != 0) {
+                                break;
+                        }
+                }
+                if (k == 0) {
+                        slot = &ring[pos % BUFFER_SIZE];
+                        if (ring_diff(slot->seq, ring_add(pos, 1)) < 0) {
+                                /* slot not yet produced: empty */
+                                return 0;
+                        }
+                        continue;
+                }
+                if (atomic_cas(&tail, pos, ring_add(pos, k))) {
+                        break;
+                }
+        }
+
+        for (i = 0; i < k; i++) {
+                slot = &ring[ring_add(pos, i) % BUFFER_SIZE];
+                /* read the item before handing the slot back */
+                membar_load_load();
+                items[i] = slot->item;
+                membar_any_store();
+                slot->seq = ring_add(pos, i + BUFFER_SIZE);
+        }
+        return k;
+}
+
+/* We just put or took N items: wake up to N sleepers on WC, if there
+   might be any. The barrier pairs with the one in ring_wait(): either
+   we see the sleeper's count, or it sees our change to the ring and
+   doesn't sleep. */
+static void
+ring_wake(struct wchan *wc, volatile unsigned *sleepers, unsigned n)
+{
+        unsigned i;
+
+        membar_any_any();
+        if (*sleepers > 0) {
+                spinlock_acquire(&wait_lock);
+                for (i = 0; i < n; i++) {
+                        wchan_wakeone(wc, &wait_lock);
+                }
+                spinlock_release(&wait_lock);
+        }
+}
+
+/* Sleep on WC until TRYFN makes progress; returns what it returned. */
+static unsigned
+ring_wait(struct wchan *wc, volatile unsigned *sleepers,
+          unsigned (*tryfn)(data_item_t **, unsigned),
+          data_item_t **items, unsigned n)
+{
+        unsigned done;
+
+        spinlock_acquire(&wait_lock);
+        (*sleepers)++;
+        membar_any_any();
+        while ((done = tryfn(items, n)) == 0) {
+                wchan_sleep(wc, &wait_lock);
+        }
+        (*sleepers)--;
+        spinlock_release(&wait_lock);
+        return done;
+}
 
 
 /* consumer_receive() is called by a consumer to request more data. It
@@ -30,34 +191,55 @@ volatile int head, tail;
 data_item_t * consumer_receive(void)
 {
         data_item_t * item;
-        lock_acquire(new_lock);
-        while(head == tail)
-                cv_wait(empty, new_lock);
-        item = item_buffer[tail];
-        tail = (tail + 1) % BUFFLEN;
-        cv_signal(full, new_lock);
-        lock_release(new_lock);
-        /******************
-         * Remove above here
-         */
 
+        consumer_receive_n(&item, 1);
         return item;
 }
 
+/* consumer_receive_n() receives at least one and up to N items into
+   ITEMS, blocking only if none are available, and returns how many it
+   got. */
+
+unsigned consumer_receive_n(data_item_t **items, unsigned n)
+{
+        unsigned got;
+
+        KASSERT(n > 0);
+        got = ring_get(items, n);
+        if (got == 0) {
+                got = ring_wait(not_empty, &sleeping_consumers,
+                                ring_get, items, n);
+        }
+        ring_wake(not_full, &sleeping_producers, got);
+        return got;
+}
+
 /* procucer_send() is called by a producer to store data in your
    bounded buffer.  It should block on a sync primitive if no space is
    available in your buffer. It should not busy wait!*/
 
 void producer_send(data_item_t *item)
 {
-        lock_acquire(new_lock);
-        while((head + 1) % BUFFLEN == tail) {
-                cv_wait(full,new_lock);
+        producer_send_n(&item, 1);
+}
+
+/* producer_send_n() sends all N items in ITEMS, in order, blocking
+   whenever the buffer is full. */
+
+void producer_send_n(data_item_t **items, unsigned n)
+{
+        unsigned sent;
+
+        while (n > 0) {
+                sent = ring_put(items, n);
+                if (sent == 0) {
+                        sent = ring_wait(not_full, &sleeping_producers,
+                                         ring_put, items, n);
+                }
+                ring_wake(not_empty, &sleeping_consumers, sent);
+                items += sent;
+                n -= sent;
         }
-        item_buffer[head] = item;
-        head = (head + 1) % BUFFLEN;
-        cv_signal(empty, new_lock);
-        lock_release(new_lock);
 }
 
 
@@ -68,20 +250,26 @@ void producer_send(data_item_t *item)
 
 void producerconsumer_startup(void)
 {
-        new_lock = lock_create("new_lock");
-        full = cv_create("full");
-        empty = cv_create("empty");
-        if (new_lock == NULL || full == NULL || empty == NULL)
+        unsigned i;
+
+        spinlock_init(&wait_lock);
+        not_full = wchan_create("not_full");
+        not_empty = wchan_create("not_empty");
+        if (not_full == NULL || not_empty == NULL)
                 panic("Initialisation fails");
-        head = tail = 0;
 
+        for (i = 0; i < BUFFER_SIZE; i++) {
+                ring[i].seq = i;
+                ring[i].item = NULL;
+        }
+        head = tail = 0;
+        sleeping_producers = sleeping_consumers = 0;
 }
 
 /* Perform any clean-up you need here */
 void producerconsumer_shutdown(void)
 {
-        lock_destroy(new_lock);
-        cv_destroy(full);
-        cv_destroy(empty);
+        wchan_destroy(not_full);
+        wchan_destroy(not_empty);
+        spinlock_cleanup(&wait_lock);
 }
-
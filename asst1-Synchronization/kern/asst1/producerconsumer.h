@@ -46,6 +46,14 @@ void producer_send(data_item_t *);      /* send a data item to the shared
                                          * buffer, block if full.
                                          */
 
+/* Batched versions. consumer_receive_n() receives between 1 and N
+ * items into the array, blocking only if none are available, and
+ * returns how many it got. producer_send_n() sends all N items in
+ * order, blocking whenever the buffer is full.
+ */
+unsigned consumer_receive_n(data_item_t **, unsigned n);
+void producer_send_n(data_item_t **, unsigned n);
+
 void producerconsumer_startup(void);    /* initialise your buffer and
                                          * surrounding code 
                                          */
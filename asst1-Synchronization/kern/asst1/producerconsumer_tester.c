@@ -13,6 +13,7 @@
 #include <lib.h>    /* for kprintf */
 #include <synch.h>  /* for P(), V(), sem_* */
 #include <thread.h> /* for thread_fork() */
+#include <clock.h>  /* for gettime() */
 #include <test.h>
 
 #include "producerconsumer.h"
@@ -38,6 +39,14 @@
  */
 #define SOMETHING_WRONG_COUNT 10000
 
+/* Items per call in the batched run, which uses producer_send_n()
+ * and consumer_receive_n().
+ */
+#define BATCH_SIZE 4
+
+/* True during the batched run. */
+static bool batched;
+
 /* Semaphores which the simulator uses to determine when all
  * producer threads and all consumer threads have finished.
  */
@@ -53,6 +62,8 @@ producer_thread(void *unused_ptr, unsigned long thread_num)
 {
         int items_to_go = ITEMS_TO_PRODUCE;
         data_item_t *item;
+        data_item_t *batch[BATCH_SIZE];
+        int n = 0;
 
         (void)unused_ptr; /* Avoid compiler warnings */
 
@@ -76,7 +87,16 @@ producer_thread(void *unused_ptr, unsigned long thread_num)
                 item->data2 = item->data1  + 1;
 
                 /* send the item via your code */
-                producer_send(item);
+                if (batched) {
+                        batch[n++] = item;
+                        if (n == BATCH_SIZE || items_to_go == 1) {
+                                producer_send_n(batch, n);
+                                n = 0;
+                        }
+                }
+                else {
+                        producer_send(item);
+                }
 
                 items_to_go = items_to_go - 1;
         }
@@ -141,6 +161,66 @@ consumer_thread(void *unused_ptr, unsigned long thread_num)
         V(consumer_finished);
 }
 
+/* The consumer thread's function for the batched run. This is the
+ * same as consumer_thread(), except that it receives up to
+ * BATCH_SIZE items at a time. Since it might get more than one of
+ * the stop items that way, it sends back any extras so that the
+ * other consumers still get theirs.
+ */
+static void
+consumer_thread_batched(void *unused_ptr, unsigned long thread_num)
+{
+        data_item_t *batch[BATCH_SIZE];
+        data_item_t *item;
+        unsigned n, i, stops = 0;
+        int check_count = 0;
+
+        (void)unused_ptr;
+        (void)thread_num;
+
+        kprintf("Consumer started\n");
+
+        while (stops == 0 && check_count < SOMETHING_WRONG_COUNT) {
+                n = consumer_receive_n(batch, BATCH_SIZE);
+                KASSERT(n > 0 && n <= BATCH_SIZE);
+
+                for (i = 0; i < n; i++) {
+                        item = batch[i];
+                        KASSERT(item != NULL);
+                        if (item->data1 == 0 && item->data2 == 0) {
+                                stops++;
+                        }
+                        else if (item->data1 + 1 != item->data2) {
+                                kprintf("*** Error! Unexpected data %d and %d\n",
+                                        item->data1, item->data2);
+                        }
+                        check_count++;
+                        kfree(item);
+                }
+        }
+
+        /* Pass on stop items that were meant for someone else. */
+        while (stops > 1) {
+                item = kmalloc(sizeof(data_item_t));
+                if (item == NULL) {
+                        panic("Can't kmalloc another item??");
+                }
+                item->data1 = 0;
+                item->data2 = 0;
+                producer_send(item);
+                stops--;
+        }
+
+        if (stops == 0) {
+                kprintf("*** Error! Consumer exiting...\n");
+        } else {
+                kprintf("Consumer finished normally\n");
+        }
+
+        /* Signal that we're done. */
+        V(consumer_finished);
+}
+
 /* Create a bunch of threads to consume data. */
 static void
 start_consumer_threads()
@@ -150,6 +230,7 @@ start_consumer_threads()
 
         for(i = 0; i < NUM_CONSUMERS; i++) {
                 result = thread_fork("consumer thread", NULL,
+                                     batched ? consumer_thread_batched :
                                      consumer_thread, NULL, i);
                 if(result) {
                         panic("start_consumer_threads: couldn't fork (%s)\n",
@@ -226,6 +307,38 @@ stop_consumer_threads()
 
 }
 
+/* Run the producers and consumers once, and report the throughput. */
+static void
+run_simulation(void)
+{
+        struct timespec before, after;
+        unsigned long items = NUM_PRODUCERS * ITEMS_TO_PRODUCE;
+        uint64_t nsecs;
+
+        gettime(&before);
+
+        start_consumer_threads();
+        start_producer_threads();
+
+        /* Wait for all producers and consumers to finish */
+
+        wait_for_producer_threads();
+        stop_consumer_threads();
+
+        gettime(&after);
+        timespec_sub(&after, &before, &after);
+        nsecs = after.tv_sec * 1000000000ULL + after.tv_nsec;
+        if (nsecs == 0) {
+                nsecs = 1;
+        }
+
+        kprintf("%s: %lu items in %llu.%09lu seconds, %llu items per second\n",
+                batched ? "batched" : "single", items,
+                (unsigned long long)after.tv_sec,
+                (unsigned long)after.tv_nsec,
+                items * 1000000000ULL / nsecs);
+}
+
 /* The main function for the simulation. */
 int
 run_producerconsumer(int nargs, char **args)
@@ -249,14 +362,11 @@ run_producerconsumer(int nargs, char **args)
         /* Run any code required to initialise synch primitives etc */
         producerconsumer_startup();
 
-        /* Run the simulation */
-        start_consumer_threads();
-        start_producer_threads();
-
-        /* Wait for all producers and consumers to finish */
-
-        wait_for_producer_threads();
-        stop_consumer_threads();
+        /* Run the simulation, one item at a time and then in batches */
+        batched = false;
+        run_simulation();
+        batched = true;
+        run_simulation();
 
         /* Run any code required to shut down the simulation */
         producerconsumer_shutdown();
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PCPU_COUNTER_H_
+#define _PCPU_COUNTER_H_
+
+/*
+ * Per-cpu counters, for statistics and other counts that are updated
+ * often from many cpus but read rarely.
+ *
+ * Each cpu adds into its own slot, with interrupts off but no lock
+ * and no atomic operation. When a slot's value reaches the batch
+ * threshold (in either direction) it is folded into the shared total
+ * under a spinlock. So the shared total is only touched once every
+ * BATCH updates per cpu. Slots are padded to PCPU_SLOT_SIZE bytes so
+ * two cpus' slots never share a cache line.
+ *
+ * pcpu_counter_read is cheap and approximate: it returns the shared
+ * total, which can be off by up to (BATCH - 1) per cpu.
+ * pcpu_counter_read_exact adds up all the slots as well, under the
+ * spinlock; it is exact as long as nothing is updating the counter
+ * at the same time.
+ *
+ * Functions:
+ *     pcpu_counter_init    - Set up a counter with initial value VAL.
+ *                            Fails only if out of memory.
+ *     pcpu_counter_cleanup - Free its resources.
+ *     pcpu_counter_add     - Add DELTA (which may be negative).
+ */
+
+#include <spinlock.h>
+
+/* Size of a slot; at least one cache line. */
+#define PCPU_SLOT_SIZE 64
+
+struct pcpu_slot {
+	volatile long ps_delta;
+	char ps_pad[PCPU_SLOT_SIZE - sizeof(long)];
+};
+
+struct pcpu_counter {
+	struct spinlock pc_lock;	/* Protects pc_total */
+	volatile long pc_total;
+	long pc_batch;
+	struct pcpu_slot *pc_slots;	/* One per possible cpu */
+};
+
+int pcpu_counter_init(struct pcpu_counter *pc, long val, unsigned batch);
+void pcpu_counter_cleanup(struct pcpu_counter *pc);
+void pcpu_counter_add(struct pcpu_counter *pc, long delta);
+long pcpu_counter_read(struct pcpu_counter *pc);
+long pcpu_counter_read_exact(struct pcpu_counter *pc);
+
+#endif /* _PCPU_COUNTER_H_ */
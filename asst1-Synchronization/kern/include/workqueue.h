@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Work queue: a place for producers to leave work items (opaque
+ * pointers; NULL is allowed) for a pool of worker threads to pick up.
+ *
+ * Internally there is one local queue per cpu, up to NQUEUES. Items
+ * are added to the local queue of the cpu doing the adding, and
+ * workers take from their own cpu's queue first, stealing from the
+ * others only when that is empty. So producers and workers on
+ * different cpus rarely touch the same lock. Each local queue is
+ * FIFO; there is no ordering between queues.
+ *
+ * Queue nodes are recycled rather than freed, so once a queue has
+ * reached its working size enqueueing doesn't allocate.
+ *
+ * Functions:
+ *     workqueue_create  - Create a work queue with NQUEUES local queues.
+ *     workqueue_destroy - Destroy it. It must be empty, with no
+ *                         workers waiting.
+ *     workqueue_enqueue - Add an item. Fails only if out of memory.
+ *     workqueue_dequeue - Get between 1 and MAX items into ITEMS,
+ *                         sleeping if there are none, and return how
+ *                         many were taken.
+ */
+
+struct workqueue;	/* Opaque. */
+
+struct workqueue *workqueue_create(const char *name, unsigned nqueues);
+void workqueue_destroy(struct workqueue *wq);
+int workqueue_enqueue(struct workqueue *wq, void *item);
+unsigned workqueue_dequeue(struct workqueue *wq, void **items, unsigned max);
+
+#endif /* _WORKQUEUE_H_ */
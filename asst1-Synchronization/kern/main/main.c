@@ -47,6 +47,7 @@
 #include <vfs.h>
 #include <device.h>
 #include <syscall.h>
+#include <kstat.h>
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
@@ -111,6 +112,7 @@ boot(void)
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
+	kstat_bootstrap();
 	vfs_bootstrap();
 	kheap_nextgeneration();
 
@@ -42,6 +42,7 @@
 #include <vfs.h>
 #include <sfs.h>
 #include <syscall.h>
+#include <kstat.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -466,6 +467,18 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_kstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kstat_print();
+
+	return 0;
+}
+
 static
 int
 cmd_kheapgeneration(int nargs, char **args)
@@ -604,6 +617,7 @@ static const char *mainmenu[] = {
 	"[1d] Client/Server problem          ",
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ks] Kernel event counters          ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
 	"[q] Quit and shut down              ",
@@ -663,6 +677,7 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ks",         cmd_kstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
 
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-cpu counters. See pcpu_counter.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <current.h>
+#include <pcpu_counter.h>
+#include <platform/maxcpus.h>
+
+int
+pcpu_counter_init(struct pcpu_counter *pc, long val, unsigned batch)
+{
+	unsigned i;
+
+	KASSERT(batch > 0);
+
+	/*
+	 * One slot for every cpu there could be, since secondary cpus
+	 * may not have been found yet. Subpage blocks from kmalloc are
+	 * aligned to their size, so the slots are cache-aligned.
+	 */
+	pc->pc_slots = kmalloc(MAXCPUS * sizeof(pc->pc_slots[0]));
+	if (pc->pc_slots == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<MAXCPUS; i++) {
+		pc->pc_slots[i].ps_delta = 0;
+	}
+
+	spinlock_init(&pc->pc_lock);
+	pc->pc_total = val;
+	pc->pc_batch = batch;
+	return 0;
+}
+
+void
+pcpu_counter_cleanup(struct pcpu_counter *pc)
+{
+	spinlock_cleanup(&pc->pc_lock);
+	kfree(pc->pc_slots);
+	pc->pc_slots = NULL;
+}
+
+void
+pcpu_counter_add(struct pcpu_counter *pc, long delta)
+{
+	struct pcpu_slot *slot;
+	long val;
+	int spl;
+
+	/* Interrupts off so nobody else on this cpu touches the slot. */
+	spl = splhigh();
+
+	slot = &pc->pc_slots[curcpu->c_number];
+	val = slot->ps_delta + delta;
+	if (val >= pc->pc_batch || val <= -pc->pc_batch) {
+		/*
+		 * Clear the slot while still holding the lock, so
+		 * pcpu_counter_read_exact never counts VAL twice.
+		 */
+		spinlock_acquire(&pc->pc_lock);
+		pc->pc_total += val;
+		slot->ps_delta = 0;
+		spinlock_release(&pc->pc_lock);
+	}
+	else {
+		slot->ps_delta = val;
+	}
+
+	splx(spl);
+}
+
+long
+pcpu_counter_read(struct pcpu_counter *pc)
+{
+	return pc->pc_total;
+}
+
+long
+pcpu_counter_read_exact(struct pcpu_counter *pc)
+{
+	long val;
+	unsigned i;
+
+	spinlock_acquire(&pc->pc_lock);
+	val = pc->pc_total;
+	for (i=0; i<MAXCPUS; i++) {
+		val += pc->pc_slots[i].ps_delta;
+	}
+	spinlock_release(&pc->pc_lock);
+
+	return val;
+}
@@ -30,6 +30,7 @@
 /* Make sure to build out-of-line versions of inline functions */
 #define SPINLOCK_INLINE   /* empty */
 #define MEMBAR_INLINE     /* empty */
+#define ATOMIC_INLINE     /* empty */
 
 #include <types.h>
 #include <lib.h>
@@ -37,6 +38,7 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <membar.h>
+#include <atomic.h>
 #include <current.h>	/* for curcpu */
 
 /*
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Work queue. See workqueue.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <wchan.h>
+#include <current.h>
+#include <workqueue.h>
+
+struct wq_node {
+	struct wq_node *wn_next;
+	void *wn_item;
+};
+
+/*
+ * One cpu's local queue, with its own free list of nodes.
+ */
+struct wq_local {
+	struct spinlock wl_lock;
+	struct wq_node *wl_head;
+	struct wq_node *wl_tail;
+	volatile unsigned wl_count;	/* Items queued; may be read unlocked */
+	struct wq_node *wl_free;	/* Nodes for reuse */
+};
+
+/*
+ * Workers with nothing to do sleep on wq_wchan. wq_sleepers lets
+ * enqueue skip the sleep lock entirely when nobody is asleep.
+ */
+struct workqueue {
+	char *wq_name;
+	unsigned wq_nqueues;
+	struct wq_local *wq_queues;
+	struct spinlock wq_sleeplock;
+	struct wchan *wq_wchan;
+	volatile unsigned wq_sleepers;
+};
+
+struct workqueue *
+workqueue_create(const char *name, unsigned nqueues)
+{
+	struct workqueue *wq;
+	unsigned i;
+
+	KASSERT(nqueues > 0);
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		return NULL;
+	}
+
+	wq->wq_name = kstrdup(name);
+	if (wq->wq_name == NULL) {
+		kfree(wq);
+		return NULL;
+	}
+
+	wq->wq_queues = kmalloc(nqueues * sizeof(wq->wq_queues[0]));
+	if (wq->wq_queues == NULL) {
+		kfree(wq->wq_name);
+		kfree(wq);
+		return NULL;
+	}
+
+	wq->wq_wchan = wchan_create(wq->wq_name);
+	if (wq->wq_wchan == NULL) {
+		kfree(wq->wq_queues);
+		kfree(wq->wq_name);
+		kfree(wq);
+		return NULL;
+	}
+
+	wq->wq_nqueues = nqueues;
+	for (i=0; i<nqueues; i++) {
+		spinlock_init(&wq->wq_queues[i].wl_lock);
+		wq->wq_queues[i].wl_head = NULL;
+		wq->wq_queues[i].wl_tail = NULL;
+		wq->wq_queues[i].wl_count = 0;
+		wq->wq_queues[i].wl_free = NULL;
+	}
+	spinlock_init(&wq->wq_sleeplock);
+	wq->wq_sleepers = 0;
+
+	return wq;
+}
+
+void
+workqueue_destroy(struct workqueue *wq)
+{
+	struct wq_local *q;
+	struct wq_node *node;
+	unsigned i;
+
+	KASSERT(wq != NULL);
+	KASSERT(wq->wq_sleepers == 0);
+
+	for (i=0; i<wq->wq_nqueues; i++) {
+		q = &wq->wq_queues[i];
+		KASSERT(q->wl_head == NULL);
+		KASSERT(q->wl_count == 0);
+		while ((node = q->wl_free) != NULL) {
+			q->wl_free = node->wn_next;
+			kfree(node);
+		}
+		spinlock_cleanup(&q->wl_lock);
+	}
+	spinlock_cleanup(&wq->wq_sleeplock);
+	wchan_destroy(wq->wq_wchan);
+
+	kfree(wq->wq_queues);
+	kfree(wq->wq_name);
+	kfree(wq);
+}
+
+/*
+ * Add an item to the current cpu's queue, and wake a worker if any
+ * are asleep.
+ */
+int
+workqueue_enqueue(struct workqueue *wq, void *item)
+{
+	struct wq_local *q;
+	struct wq_node *node;
+
+	KASSERT(wq != NULL);
+
+	/* If we migrate after this it doesn't matter. */
+	q = &wq->wq_queues[curcpu->c_number % wq->wq_nqueues];
+
+	spinlock_acquire(&q->wl_lock);
+	node = q->wl_free;
+	if (node != NULL) {
+		q->wl_free = node->wn_next;
+	}
+	else {
+		spinlock_release(&q->wl_lock);
+		node = kmalloc(sizeof(*node));
+		if (node == NULL) {
+			return ENOMEM;
+		}
+		spinlock_acquire(&q->wl_lock);
+	}
+
+	node->wn_next = NULL;
+	node->wn_item = item;
+	if (q->wl_tail == NULL) {
+		q->wl_head = node;
+	}
+	else {
+		q->wl_tail->wn_next = node;
+	}
+	q->wl_tail = node;
+	q->wl_count++;
+	spinlock_release(&q->wl_lock);
+
+	/*
+	 * Either we see a worker that's about to sleep, or it sees
+	 * our item. The matching barrier is in workqueue_dequeue.
+	 */
+	membar_any_any();
+	if (wq->wq_sleepers > 0) {
+		spinlock_acquire(&wq->wq_sleeplock);
+		wchan_wakeone(wq->wq_wchan, &wq->wq_sleeplock);
+		spinlock_release(&wq->wq_sleeplock);
+	}
+
+	return 0;
+}
+
+/*
+ * Take up to MAX items off the front of one local queue, recycling
+ * their nodes.
+ */
+static
+unsigned
+workqueue_take(struct wq_local *q, void **items, unsigned max)
+{
+	struct wq_node *node;
+	unsigned n;
+
+	/* Don't bother locking queues that look empty. */
+	if (q->wl_count == 0) {
+		return 0;
+	}
+
+	n = 0;
+	spinlock_acquire(&q->wl_lock);
+	while (n < max && (node = q->wl_head) != NULL) {
+		q->wl_head = node->wn_next;
+		if (q->wl_head == NULL) {
+			q->wl_tail = NULL;
+		}
+		q->wl_count--;
+		items[n++] = node->wn_item;
+
+		node->wn_next = q->wl_free;
+		q->wl_free = node;
+	}
+	spinlock_release(&q->wl_lock);
+
+	return n;
+}
+
+/*
+ * Take up to MAX items, from the current cpu's queue if possible and
+ * otherwise by stealing from the others.
+ */
+static
+unsigned
+workqueue_trytake(struct workqueue *wq, void **items, unsigned max)
+{
+	unsigned i, mine, n;
+
+	mine = curcpu->c_number % wq->wq_nqueues;
+	for (i=0; i<wq->wq_nqueues; i++) {
+		n = workqueue_take(&wq->wq_queues[(mine + i) % wq->wq_nqueues],
+				   items, max);
+		if (n > 0) {
+			return n;
+		}
+	}
+	return 0;
+}
+
+unsigned
+workqueue_dequeue(struct workqueue *wq, void **items, unsigned max)
+{
+	unsigned n;
+
+	KASSERT(wq != NULL);
+	KASSERT(max > 0);
+
+	n = workqueue_trytake(wq, items, max);
+	if (n > 0) {
+		return n;
+	}
+
+	spinlock_acquire(&wq->wq_sleeplock);
+	wq->wq_sleepers++;
+	membar_any_any();
+	while ((n = workqueue_trytake(wq, items, max)) == 0) {
+		wchan_sleep(wq->wq_wchan, &wq->wq_sleeplock);
+	}
+	wq->wq_sleepers--;
+	spinlock_release(&wq->wq_sleeplock);
+
+	return n;
+}
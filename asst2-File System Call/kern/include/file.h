@@ -14,15 +14,34 @@
 /*
  * Put your function declarations and data types here ...
  */
+
+/*
+ * An open file. These live in the global open file table, of_table,
+ * and processes' fd tables point at their of_table slots.
+ *
+ * file_lock protects file_offset and file_refcount, so processes
+ * sharing an open file (after dup2) don't trample each other's seek
+ * position. file_vnode and file_flag don't change while the file is
+ * open.
+ *
+ * Slots and file_info objects both come from a pool: free slots are
+ * kept on a stack so allocating one is O(1), and closed file_info
+ * objects (with their locks) are kept for reuse rather than freed.
+ */
 struct file_info {
     struct vnode *file_vnode;
     off_t file_offset;
     int file_refcount;
     int file_flag;
+    struct lock *file_lock;
+    unsigned file_slot;          // index in of_table
+    struct file_info *file_next; // link on the spare list
 };
-// Global open file table
-struct file_info **of_table;
 
+// Maximum number of closed file_info objects kept for reuse
+#define FILE_SPARE_MAX 32
+
+void file_bootstrap(void);
 int open_trust(char *filename, int flags, mode_t mode, int *retval);
 int sys_open(userptr_t filename, int flags, mode_t mode,int *retval);
 int sys_close(int fd, int *retval);
@@ -47,6 +47,7 @@
 #include <vfs.h>
 #include <device.h>
 #include <syscall.h>
+#include <file.h>
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
@@ -112,6 +113,7 @@ boot(void)
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	file_bootstrap();
 	kheap_nextgeneration();
 
 	/* Probe and initialize devices. Interrupts should come on. */
@@ -19,6 +19,104 @@
 /*
  * Add your file-related functions here ...
  */
+
+/*
+ * The open file pool. of_table holds the open files; of_freeslots is
+ * a stack of the free of_table indexes, and of_spare a list of closed
+ * file_info objects waiting to be reused. of_pool_lock protects all
+ * of it. It's a spinlock because nothing done while holding it can
+ * sleep.
+ */
+static struct file_info *of_table[TABLE_MAX];
+static unsigned of_freeslots[TABLE_MAX];
+static unsigned of_nfree;
+static struct file_info *of_spare;
+static unsigned of_nspare;
+static struct spinlock of_pool_lock;
+
+void file_bootstrap(void) {
+    spinlock_init(&of_pool_lock);
+    // Hand out low slots first, like the old linear scan did
+    for (unsigned i = 0; i < TABLE_MAX; i++) {
+        of_table[i] = NULL;
+        of_freeslots[i] = TABLE_MAX - 1 - i;
+    }
+    of_nfree = TABLE_MAX;
+    of_spare = NULL;
+    of_nspare = 0;
+}
+
+// Get a file_info, from the spare list if there is one.
+static struct file_info *file_info_get(void) {
+    struct file_info *file;
+
+    spinlock_acquire(&of_pool_lock);
+    file = of_spare;
+    if (file != NULL) {
+        of_spare = file->file_next;
+        of_nspare--;
+    }
+    spinlock_release(&of_pool_lock);
+    if (file != NULL) {
+        return file;
+    }
+
+    file = kmalloc(sizeof(struct file_info));
+    if (file == NULL) {
+        return NULL;
+    }
+    file->file_lock = lock_create("file_info");
+    if (file->file_lock == NULL) {
+        kfree(file);
+        return NULL;
+    }
+    return file;
+}
+
+// Give back a file_info that isn't in of_table.
+static void file_info_put(struct file_info *file) {
+    file->file_vnode = NULL;
+    spinlock_acquire(&of_pool_lock);
+    if (of_nspare < FILE_SPARE_MAX) {
+        file->file_next = of_spare;
+        of_spare = file;
+        of_nspare++;
+        file = NULL;
+    }
+    spinlock_release(&of_pool_lock);
+    // Too many spares already
+    if (file != NULL) {
+        lock_destroy(file->file_lock);
+        kfree(file);
+    }
+}
+
+// Put FILE in a free of_table slot.
+static int of_slot_alloc(struct file_info *file) {
+    unsigned slot;
+
+    spinlock_acquire(&of_pool_lock);
+    if (of_nfree == 0) {
+        spinlock_release(&of_pool_lock);
+        return ENFILE;
+    }
+    slot = of_freeslots[--of_nfree];
+    KASSERT(of_table[slot] == NULL);
+    of_table[slot] = file;
+    file->file_slot = slot;
+    spinlock_release(&of_pool_lock);
+    return 0;
+}
+
+// Take FILE out of of_table and recycle it.
+static void of_slot_free(struct file_info *file) {
+    spinlock_acquire(&of_pool_lock);
+    KASSERT(of_table[file->file_slot] == file);
+    of_table[file->file_slot] = NULL;
+    of_freeslots[of_nfree++] = file->file_slot;
+    spinlock_release(&of_pool_lock);
+    file_info_put(file);
+}
 int sys_open(userptr_t filename, int flags, mode_t mode, int *retval) {
     // Copy in and check filename
     char *filename_internal = kmalloc(NAME_MAX * sizeof(char));
@@ -42,57 +140,52 @@ int open_trust(char *filename, int flags, mode_t mode, int *retval) {
     if (result) {
         return result;
     }
-    // Find free entry in open file table
-    struct file_info **position;
-    bool exist = false;
-    for (int i = 0; i < TABLE_MAX; i++) {
-        if (of_table[i] == NULL) {
-            exist = true;
-            of_table[i] = kmalloc(sizeof(struct file_info));
-            if (of_table[i] == NULL) {
-                vfs_close(file_vnode);
-                return ENOMEM;
-            }
-            of_table[i]->file_vnode = file_vnode;
-            of_table[i]->file_refcount = 1;
-            of_table[i]->file_flag = flags;
-            // Files open in append mode
-            if (flags == O_APPEND) {
-                struct stat info;
-                result = VOP_STAT(file_vnode, &info);
-                if (result) {
-                    vfs_close(file_vnode);
-                    kfree(of_table[i]);
-                    return result;
-                }
-                of_table[i]->file_offset = info.st_size;
-            } else {
-                of_table[i]->file_offset = 0;
-            }
-            position = &(of_table[i]);
+    // Find free entry in file descriptor table
+    int fd = -1;
+    for (int i = 0; i < OPEN_MAX; i++) {
+        if (curproc->fd_table[i] == NULL) {
+            fd = i;
             break;
         }
     }
-    // No free entry in of table
-    if (exist == false) {
+    // No free entry in fd table
+    if (fd < 0) {
         vfs_close(file_vnode);
-        return ENFILE;
+        return EMFILE;
     }
-    // Find free entry in file descriptor table
-    for (int i = 0; i < OPEN_MAX; i++) {
-        if (curproc->fd_table[i] == NULL) {
-            // fd number
-            *retval = i;
-            // of table position
-            curproc->fd_table[i] = position;
-            return 0;
+    struct file_info *file = file_info_get();
+    if (file == NULL) {
+        vfs_close(file_vnode);
+        return ENOMEM;
+    }
+    file->file_vnode = file_vnode;
+    file->file_refcount = 1;
+    file->file_flag = flags;
+    // Files open in append mode
+    if (flags == O_APPEND) {
+        struct stat info;
+        result = VOP_STAT(file_vnode, &info);
+        if (result) {
+            vfs_close(file_vnode);
+            file_info_put(file);
+            return result;
         }
+        file->file_offset = info.st_size;
+    } else {
+        file->file_offset = 0;
     }
-    // No free entry in fd table
-    vfs_close(file_vnode);
-    kfree(*position);
-    return EMFILE;
-
+    // Find free entry in open file table
+    result = of_slot_alloc(file);
+    if (result) {
+        vfs_close(file_vnode);
+        file_info_put(file);
+        return result;
+    }
+    // fd number
+    *retval = fd;
+    // of table position
+    curproc->fd_table[fd] = &of_table[file->file_slot];
+    return 0;
 }
 
 int sys_close(int fd, int *retval) {
@@ -106,17 +199,16 @@ int sys_close(int fd, int *retval) {
         return EBADF;
     }
     struct file_info *file  = *(curproc->fd_table[fd]);
-    // at least 2 reference count exsists after sys_open
-    if (file->file_refcount > 1) {
-        file->file_refcount--;
-    }
-    // the only reference
-    else {
+    curproc->fd_table[fd] = NULL;
+    lock_acquire(file->file_lock);
+    file->file_refcount--;
+    bool last = (file->file_refcount == 0);
+    lock_release(file->file_lock);
+    // that was the only reference
+    if (last) {
         vfs_close(file->file_vnode);
-        kfree(file);
-        *(curproc->fd_table[fd]) = NULL;
+        of_slot_free(file);
     }
-    curproc->fd_table[fd] = NULL;
     *retval = 0;
     return 0;
 }
@@ -143,17 +235,20 @@ ssize_t sys_read(int fd, void *buf, size_t buflen, int *retval) {
         return EBADF;
     }
 
+    lock_acquire(file->file_lock);
     /* initialize a uio */
     uio_kinit(iov, u_io, safe_buf, buflen, file->file_offset, UIO_READ);
 
     result = VOP_READ(file->file_vnode, u_io);
     if (result) {
+        lock_release(file->file_lock);
         *retval = -1;
         return result;
     }
 
     *retval = u_io->uio_offset - file->file_offset;
     file->file_offset = u_io->uio_offset;
+    lock_release(file->file_lock);
     kfree(iov);
     kfree(u_io);
     if (*retval == 0)
@@ -193,17 +288,20 @@ ssize_t sys_write(int fd, const void *buf, size_t buflen, int *retval) {
         return result;
     }
 
+    lock_acquire(file->file_lock);
     /* initialize a uio */
     uio_kinit(iov, u_io, safe_buf, buflen, file->file_offset, UIO_WRITE);
 
     result = VOP_WRITE(file->file_vnode, u_io);
     if (result) {
+        lock_release(file->file_lock);
         *retval = -1;
         return result;
     }
 
     *retval = u_io->uio_offset - file->file_offset;
     file->file_offset = u_io->uio_offset;
+    lock_release(file->file_lock);
 
     kfree(iov);
     kfree(u_io);
@@ -235,7 +333,9 @@ int sys_dup2(int oldfd, int newfd, int *retval) {
     struct file_info *file  = *(curproc->fd_table[oldfd]);
     // Copy pointer to new fd
     curproc->fd_table[newfd] = curproc->fd_table[oldfd];
+    lock_acquire(file->file_lock);
     file->file_refcount++;
+    lock_release(file->file_lock);
     return 0;
 }
 
@@ -257,6 +357,7 @@ off_t sys_lseek(int fd, off_t pos, int whence, off_t *retval) {
         *retval = -1;
         return ESPIPE;
     }
+    lock_acquire(file->file_lock);
     off_t first_off = file->file_offset;
     // Start position in file
     if (whence == SEEK_SET) {
@@ -267,20 +368,24 @@ off_t sys_lseek(int fd, off_t pos, int whence, off_t *retval) {
         struct stat info;
         int result = VOP_STAT(file->file_vnode, &info);
         if (result) {
+            lock_release(file->file_lock);
             return result;
         }
         file->file_offset = info.st_size + pos;
     } else {
         // invalid whence
+        lock_release(file->file_lock);
         *retval = -1;
         return EINVAL;
     }
     // check if offset is negative
     if (file->file_offset < 0) {
         file->file_offset = first_off;
+        lock_release(file->file_lock);
         *retval = -1;
         return EINVAL;
     }
     *retval = file->file_offset;
+    lock_release(file->file_lock);
     return 0;
 }
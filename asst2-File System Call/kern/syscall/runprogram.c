@@ -61,17 +61,6 @@ runprogram(char *progname)
     struct vnode *v;
     vaddr_t entrypoint, stackptr;
     int result, fd;
-    // Initialize open file table
-    if (of_table == NULL) {
-        of_table = kmalloc(TABLE_MAX * sizeof(struct file_info *));
-        if (of_table == NULL) {
-            return ENOMEM;
-        }
-        for (int i = 0; i < TABLE_MAX; i++) {
-            of_table[i] = NULL;
-        }
-    }
-
     // Initialize file descripter table
     for (int i = 0; i < OPEN_MAX; i++) {
         curproc->fd_table[i] = NULL;
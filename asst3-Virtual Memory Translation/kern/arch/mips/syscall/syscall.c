@@ -113,6 +113,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -120,12 +125,23 @@ syscall(struct trapframe *tf)
 		err = sys_fork(tf, &retval);
 		break;
 
+	    case SYS_vfork:
+		err = sys_vfork(tf, &retval);
+		break;
+
 	    case SYS_execv:
 		err = sys_execv(
 			(userptr_t)tf->tf_a0,
 			(userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS___spawn:
+		err = sys___spawn(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			&retval);
+		break;
+
 	    case SYS__exit:
 		sys__exit(tf->tf_a0);
 		panic("Returning from exit\n");
@@ -143,6 +159,37 @@ syscall(struct trapframe *tf)
 		break;
 
 
+	    /* memory and userlevel synchronization calls */
+
+	    case SYS_mmap:
+		{
+			/*
+			 * The offset is 64 bits wide and aligned, so
+			 * after three 32-bit arguments it lands on the
+			 * stack, as with whence for lseek.
+			 */
+			uint64_t offset;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &offset, sizeof(offset));
+			if (err) {
+				break;
+			}
+			err = sys_mmap(tf->tf_a0, tf->tf_a1, tf->tf_a2,
+				       offset, &retval);
+		}
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1,
+				     &retval);
+		break;
+
+
 	    /* file calls */
 
 	    case SYS_open:
@@ -178,6 +225,55 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The position is 64 bits wide and aligned, so
+			 * like lseek's it skips a3 and comes from the
+			 * stack.
+			 */
+			uint64_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+			if (callno == SYS_pread) {
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+			}
+			else {
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+			}
+		}
+		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_sendfile:
+		err = sys_sendfile(
+			tf->tf_a0,
+			tf->tf_a1,
+			(userptr_t)tf->tf_a2,
+			tf->tf_a3,
+			&retval);
+		break;
 	    case SYS_lseek:
 		{
 			/*
@@ -251,6 +347,9 @@ syscall(struct trapframe *tf)
 	    case SYS_fsync:
 		err = sys_fsync(tf->tf_a0);
 		break;
+	    case SYS_ioctl:
+		err = sys_ioctl(tf->tf_a0, tf->tf_a1, (userptr_t)tf->tf_a2);
+		break;
 	    case SYS_ftruncate:
 		{
 			/* Like lseek, the length is 64 bits and aligned */
@@ -29,6 +29,7 @@
 #include <opt-unsw.h>
 #include <types.h>
 #include <kern/errno.h>
+#include <limits.h>
 #include <lib.h>
 #include <spl.h>
 #include <cpu.h>
@@ -38,6 +39,8 @@
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <userinfo.h>
+#include <kern/userinfo.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -55,9 +58,10 @@
  * it's cutting (there are many) and why, and more importantly, how.
  */
 
-/* under dumbvm, always have 72k of user stack */
-/* (this must be > 64K so argument blocks of size ARG_MAX will fit) */
-#define DUMBVM_STACKPAGES    18
+/* under dumbvm, always have 128k of user stack */
+/* (this must be > ARG_MAX so argument blocks of size ARG_MAX will fit, */
+/* and no more than 128k or it runs into the user info pages) */
+#define DUMBVM_STACKPAGES    32
 
 #if ! OPT_UNSW
 /*
@@ -70,7 +74,10 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 void
 vm_bootstrap(void)
 {
-	/* Do nothing. */
+	/* Just check the stack fits between ARG_MAX and the info pages. */
+	KASSERT(DUMBVM_STACKPAGES * PAGE_SIZE > ARG_MAX);
+	KASSERT(USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE >=
+		USERINFO_PROC + PAGE_SIZE);
 }
 
 
@@ -162,7 +169,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
 	paddr_t paddr;
 	int i;
-	uint32_t ehi, elo;
+	uint32_t ehi, elo, dirty;
 	struct addrspace *as;
 	int spl;
 
@@ -172,8 +179,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
+		/* Only the user info pages are read-only */
+		return EFAULT;
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -219,8 +226,17 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
 	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
 	stacktop = USERSTACK;
+	dirty = TLBLO_DIRTY;
 
-	if (faultaddress >= vbase1 && faultaddress < vtop1) {
+	if (faultaddress == USERINFO_GLOBAL) {
+		paddr = userinfo_frame();
+		dirty = 0;
+	}
+	else if (faultaddress == USERINFO_PROC) {
+		paddr = as->as_procinfo;
+		dirty = 0;
+	}
+	else if (faultaddress >= vbase1 && faultaddress < vtop1) {
 		paddr = (faultaddress - vbase1) + as->as_pbase1;
 	}
 	else if (faultaddress >= vbase2 && faultaddress < vtop2) {
@@ -245,7 +261,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 			continue;
 		}
 		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+		elo = paddr | dirty | TLBLO_VALID;
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
 		splx(spl);
@@ -257,6 +273,13 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	return EFAULT;
 }
 
+static
+void
+as_zero_region(paddr_t paddr, unsigned npages)
+{
+	bzero((void *)PADDR_TO_KVADDR(paddr), npages * PAGE_SIZE);
+}
+
 struct addrspace *
 as_create(void)
 {
@@ -265,6 +288,13 @@ as_create(void)
 		return NULL;
 	}
 
+	as->as_procinfo = getppages(1);
+	if (as->as_procinfo == 0) {
+		kfree(as);
+		return NULL;
+	}
+	as_zero_region(as->as_procinfo, 1);
+
 	as->as_vbase1 = 0;
 	as->as_pbase1 = 0;
 	as->as_npages1 = 0;
@@ -279,6 +309,7 @@ as_create(void)
 void
 as_destroy(struct addrspace *as)
 {
+	free_kpages(PADDR_TO_KVADDR(as->as_procinfo));
 	kfree(as);
 }
 
@@ -348,13 +379,6 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 	return ENOSYS;
 }
 
-static
-void
-as_zero_region(paddr_t paddr, unsigned npages)
-{
-	bzero((void *)PADDR_TO_KVADDR(paddr), npages * PAGE_SIZE);
-}
-
 int
 as_prepare_load(struct addrspace *as)
 {
@@ -440,3 +464,71 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	*ret = new;
 	return 0;
 }
+
+int
+as_define_shared(struct addrspace *as, size_t sz, int writeable, vaddr_t *ret)
+{
+	/* dumbvm has no way to share pages. */
+	(void)as;
+	(void)sz;
+	(void)writeable;
+	(void)ret;
+	return ENOSYS;
+}
+
+int
+as_translate(struct addrspace *as, vaddr_t vaddr, paddr_t *ret)
+{
+	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
+
+	if (as == NULL || as->as_pbase1 == 0) {
+		return EFAULT;
+	}
+
+	vbase1 = as->as_vbase1;
+	vtop1 = vbase1 + as->as_npages1 * PAGE_SIZE;
+	vbase2 = as->as_vbase2;
+	vtop2 = vbase2 + as->as_npages2 * PAGE_SIZE;
+	stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+	stacktop = USERSTACK;
+
+	if (vaddr >= vbase1 && vaddr < vtop1) {
+		*ret = (vaddr - vbase1) + as->as_pbase1;
+	}
+	else if (vaddr >= vbase2 && vaddr < vtop2) {
+		*ret = (vaddr - vbase2) + as->as_pbase2;
+	}
+	else if (vaddr >= stackbase && vaddr < stacktop) {
+		*ret = (vaddr - stackbase) + as->as_stackpbase;
+	}
+	else {
+		return EFAULT;
+	}
+	return 0;
+}
+
+int
+as_placepage(struct addrspace *as, vaddr_t vaddr, vaddr_t kpage)
+{
+	paddr_t paddr;
+	int result;
+
+	/* dumbvm's memory is all contiguous, so just copy the page in. */
+	result = as_translate(as, vaddr, &paddr);
+	if (result) {
+		return result;
+	}
+	memmove((void *)PADDR_TO_KVADDR(paddr), (const void *)kpage,
+		PAGE_SIZE);
+	free_kpages(kpage);
+	return 0;
+}
+
+void
+as_setpid(struct addrspace *as, pid_t pid)
+{
+	struct userinfo_proc *up;
+
+	up = (struct userinfo_proc *)PADDR_TO_KVADDR(as->as_procinfo);
+	up->up_pid = pid;
+}
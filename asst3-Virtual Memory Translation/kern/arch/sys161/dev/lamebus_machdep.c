@@ -59,7 +59,30 @@
  * The c0_count register increments on every cycle; when the value
  * matches the c0_compare register, the timer interrupt line is
  * asserted. Writing to c0_compare again clears the interrupt.
+ *
+ * Writing c0_compare does not reset c0_count, so c0_compare is an
+ * absolute cycle number: to go off N cycles from now, read c0_count
+ * and write c0_count + N (see mainbus_timer_set). This doesn't
+ * depend on whether count restarts from 0 when it matches.
  */
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t count;
+
+	/*
+	 * $9 == c0_count.
+	 */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
 static
 void
 mips_timer_set(uint32_t count)
@@ -114,9 +137,10 @@ mainbus_bootstrap(void)
 	autoconf_lamebus(lamebus, 0);
 
 	/*
-	 * Configure the MIPS on-chip timer to interrupt HZ times a second.
+	 * Configure the MIPS on-chip timer to interrupt HZ times a
+	 * second until clock_start() takes over.
 	 */
-	mips_timer_set(CPU_FREQUENCY / HZ);
+	mips_timer_set(mips_timer_count() + CPU_FREQUENCY / HZ);
 }
 
 /*
@@ -276,6 +300,40 @@ mainbus_send_ipi(struct cpu *target)
 	lamebus_assert_ipi(lamebus, target);
 }
 
+/*
+ * Set the on-chip timer to go off once, NSECS from now. Each cpu has
+ * its own, so this is what clock.c uses for both hardclock and
+ * kernel timers. (The ltimer countdown can't be used for that, as
+ * its interrupt goes only to the boot cpu.)
+ *
+ * The count register is 32 bits, which at 25 MHz is about 171
+ * seconds; if asked to wait longer we go off early and clock.c
+ * reprograms us.
+ *
+ * This is called mid-period (from clock_idle, clock_unidle, and when
+ * an earlier timer is added), with the count anywhere, so the compare
+ * value is the current count plus the delay; the sum wraps the same
+ * way the count does. MIPS_TIMER_MIN is enough cycles that the count
+ * can't pass the new compare value before it's written.
+ */
+#define MIPS_TIMER_MIN		100		/* cycles */
+#define MIPS_TIMER_MAX		0xffffffffULL	/* cycles */
+
+void
+mainbus_timer_set(uint64_t nsecs)
+{
+	uint64_t cycles;
+
+	cycles = nsecs / (1000000000 / CPU_FREQUENCY);
+	if (cycles < MIPS_TIMER_MIN) {
+		cycles = MIPS_TIMER_MIN;
+	}
+	if (cycles > MIPS_TIMER_MAX) {
+		cycles = MIPS_TIMER_MAX;
+	}
+	mips_timer_set(mips_timer_count() + (uint32_t)cycles);
+}
+
 /*
  * Trigger the debugger.
  */
@@ -314,10 +372,11 @@ mainbus_interrupt(struct trapframe *tf)
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
-		/* and call hardclock */
-		hardclock();
+		/*
+		 * The MI code always reprograms the timer, which
+		 * clears the interrupt.
+		 */
+		clock_interrupt();
 		seen = true;
 	}
 
@@ -473,31 +473,24 @@ emufs_reclaim(struct vnode *v)
 	int result;
 
 	/*
-	 * Need all of these locks, e_lock to protect the device,
-	 * vfs_biglock to protect the fs-related material, and
-	 * vn_countlock for the reference count.
+	 * Need both of these locks, e_lock to protect the device and
+	 * vfs_biglock to protect the fs-related material.
 	 */
 
 	vfs_biglock_acquire();
 	lock_acquire(ef->ef_emu->e_lock);
-	spinlock_acquire(&ev->ev_v.vn_countlock);
 
-	if (ev->ev_v.vn_refcount > 1) {
-		/* consume the reference VOP_DECREF passed us */
-		ev->ev_v.vn_refcount--;
-
-		spinlock_release(&ev->ev_v.vn_countlock);
+	if (refcount_dec_unless_last(&ev->ev_v.vn_refcount)) {
+		/* consumed the reference VOP_DECREF passed us */
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
 		return EBUSY;
 	}
-	KASSERT(ev->ev_v.vn_refcount == 1);
 
 	/*
 	 * Since we hold e_lock and are the last ref, nobody can increment
-	 * the refcount, so we can release vn_countlock.
+	 * the refcount.
 	 */
-	spinlock_release(&ev->ev_v.vn_countlock);
 
 	/* emu_close retries on I/O error */
 	result = emu_close(ev->ev_emu, ev->ev_handle);
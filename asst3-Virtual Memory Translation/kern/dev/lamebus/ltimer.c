@@ -46,11 +46,6 @@
 #define LT_REG_COUNT  16    /* Time for countdown timer (usec) */
 #define LT_REG_SPKR   20    /* Beep control */
 
-/* Granularity of countdown timer (usec) */
-#define LT_GRANULARITY   1000000
-
-static bool havetimerclock;
-
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
  */
@@ -79,23 +74,16 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 	 *
 	 * Note that the beep and rtclock devices *do* attach to
 	 * ltimer.
+	 *
+	 * We used to run the countdown timer once a second to drive
+	 * clocksleep(), but that's done with kernel timers on the
+	 * per-cpu timer now (see clock.c), so leave the countdown off
+	 * and don't interrupt the boot cpu for nothing.
 	 */
 	(void)ltimerno;
 	lt->lt_hardclock = 0;
-
-	/*
-	 * We do, however, use ltimer for the timer clock, since the
-	 * on-chip timer can't do that.
-	 */
-	if (!havetimerclock) {
-		havetimerclock = true;
-		lt->lt_timerclock = 1;
-
-		/* Wire it to go off once every second. */
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
-				   LT_GRANULARITY);
-	}
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 0);
+	bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT, 0);
 
 	return 0;
 }
@@ -118,12 +106,6 @@ ltimer_irq(void *vlt)
 		if (lt->lt_hardclock) {
 			hardclock();
 		}
-		/*
-		 * Likewise for timerclock.
-		 */
-		if (lt->lt_timerclock) {
-			timerclock();
-		}
 	}
 }
 
@@ -43,6 +43,7 @@
  */
 
 #define SEMFS_ROOTDIR	0xffffffffU		/* semnum for root dir */
+#define SEMFS_HASHSIZE	64			/* buckets in the name index */
 
 /*
  * A user-facing semaphore.
@@ -55,17 +56,22 @@ struct semfs_sem {
 	struct lock *sems_lock;			/* Lock to protect count */
 	struct cv *sems_cv;			/* CV to wait */
 	unsigned sems_count;			/* Semaphore count */
+	unsigned sems_batchwaiters;		/* Sleepers in semfs_batch */
 	bool sems_hasvnode;			/* The vnode exists */
 	bool sems_linked;			/* In the directory */
 };
 DECLARRAY(semfs_sem, SEMFS_INLINE);
 
 /*
- * Directory entry; name and reference to a semaphore.
+ * Directory entry; name and reference to a semaphore. Entries live
+ * both in the directory array, which gives them their position for
+ * getdirentry, and on a hash chain by name, which is what lookups use.
  */
 struct semfs_direntry {
 	char *semd_name;			/* Name */
 	unsigned semd_semnum;			/* Which semaphore */
+	unsigned semd_slot;			/* Index in semfs_dents */
+	struct semfs_direntry *semd_hashnext;	/* Next on hash chain */
 };
 DECLARRAY(semfs_direntry, SEMFS_INLINE);
 
@@ -95,6 +101,7 @@ struct semfs {
 
 	struct lock *semfs_dirlock;		/* Lock for following */
 	struct semfs_direntryarray *semfs_dents; /* The root directory */
+	struct semfs_direntry *semfs_hash[SEMFS_HASHSIZE]; /* Name index */
 };
 
 /*
@@ -115,6 +122,9 @@ int semfs_sem_insert(struct semfs *, struct semfs_sem *, unsigned *);
 void semfs_sem_destroy(struct semfs_sem *);
 struct semfs_direntry *semfs_direntry_create(const char *name, unsigned semno);
 void semfs_direntry_destroy(struct semfs_direntry *);
+struct semfs_direntry *semfs_dir_find(struct semfs *, const char *name);
+void semfs_dir_hashinsert(struct semfs *, struct semfs_direntry *);
+void semfs_dir_hashremove(struct semfs *, struct semfs_direntry *);
 
 /* in semfs_vnops.c */
 int semfs_getvnode(struct semfs *, unsigned, struct vnode **ret);
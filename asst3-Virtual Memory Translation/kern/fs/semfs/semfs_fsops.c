@@ -159,6 +159,7 @@ struct semfs *
 semfs_create(void)
 {
 	struct semfs *semfs;
+	unsigned i;
 
 	semfs = kmalloc(sizeof(*semfs));
 	if (semfs == NULL) {
@@ -186,6 +187,9 @@ semfs_create(void)
 	if (semfs->semfs_dents == NULL) {
 		goto fail_dirlock;
 	}
+	for (i=0; i<SEMFS_HASHSIZE; i++) {
+		semfs->semfs_hash[i] = NULL;
+	}
 
 	semfs->semfs_absfs.fs_data = semfs;
 	semfs->semfs_absfs.fs_ops = &semfs_fsops;
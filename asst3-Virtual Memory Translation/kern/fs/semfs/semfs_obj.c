@@ -44,17 +44,21 @@ struct semfs_sem *
 semfs_sem_create(const char *name)
 {
 	struct semfs_sem *sem;
-	char lockname[32];
 	char cvname[32];
 
-	snprintf(lockname, sizeof(lockname), "sem:l.%s", name);
 	snprintf(cvname, sizeof(cvname), "sem:%s", name);
 
 	sem = kmalloc(sizeof(*sem));
 	if (sem == NULL) {
 		goto fail_return;
 	}
-	sem->sems_lock = lock_create(lockname);
+	/*
+	 * All semaphore locks share one name, so lockdep sees them as
+	 * a single class. semfs_batch holds several at once, ordered
+	 * by semaphore number, which lockdep can't see and which has
+	 * nothing to do with the semaphores' names.
+	 */
+	sem->sems_lock = lock_create("semfs_sem");
 	if (sem->sems_lock == NULL) {
 		goto fail_sem;
 	}
@@ -63,6 +67,7 @@ semfs_sem_create(const char *name)
 		goto fail_lock;
 	}
 	sem->sems_count = 0;
+	sem->sems_batchwaiters = 0;
 	sem->sems_hasvnode = false;
 	sem->sems_linked = false;
 	return sem;
@@ -131,6 +136,8 @@ semfs_direntry_create(const char *name, unsigned semnum)
 		return NULL;
 	}
 	dent->semd_semnum = semnum;
+	dent->semd_slot = 0;
+	dent->semd_hashnext = NULL;
 	return dent;
 }
 
@@ -143,3 +150,72 @@ semfs_direntry_destroy(struct semfs_direntry *dent)
 	kfree(dent->semd_name);
 	kfree(dent);
 }
+
+////////////////////////////////////////////////////////////
+// name index
+
+/*
+ * Hash a name to a bucket of semfs_hash.
+ */
+static
+unsigned
+semfs_dir_hash(const char *name)
+{
+	unsigned hash = 5381;
+
+	while (*name != 0) {
+		hash = hash * 33 + (unsigned char)*name++;
+	}
+	return hash % SEMFS_HASHSIZE;
+}
+
+/*
+ * Find the directory entry for NAME, or return NULL.
+ */
+struct semfs_direntry *
+semfs_dir_find(struct semfs *semfs, const char *name)
+{
+	struct semfs_direntry *dent;
+
+	KASSERT(lock_do_i_hold(semfs->semfs_dirlock));
+	for (dent = semfs->semfs_hash[semfs_dir_hash(name)];
+	     dent != NULL;
+	     dent = dent->semd_hashnext) {
+		if (!strcmp(dent->semd_name, name)) {
+			return dent;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add a directory entry to the name index.
+ */
+void
+semfs_dir_hashinsert(struct semfs *semfs, struct semfs_direntry *dent)
+{
+	unsigned bucket;
+
+	KASSERT(lock_do_i_hold(semfs->semfs_dirlock));
+	bucket = semfs_dir_hash(dent->semd_name);
+	dent->semd_hashnext = semfs->semfs_hash[bucket];
+	semfs->semfs_hash[bucket] = dent;
+}
+
+/*
+ * Remove a directory entry from the name index.
+ */
+void
+semfs_dir_hashremove(struct semfs *semfs, struct semfs_direntry *dent)
+{
+	struct semfs_direntry **pp;
+
+	KASSERT(lock_do_i_hold(semfs->semfs_dirlock));
+	pp = &semfs->semfs_hash[semfs_dir_hash(dent->semd_name)];
+	while (*pp != dent) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->semd_hashnext;
+	}
+	*pp = dent->semd_hashnext;
+	dent->semd_hashnext = NULL;
+}
@@ -30,8 +30,10 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/ioctl.h>
 #include <stat.h>
 #include <uio.h>
+#include <copyinout.h>
 #include <synch.h>
 #include <thread.h>
 #include <proc.h>
@@ -62,16 +64,6 @@ semfs_eachopen(struct vnode *vn, int openflags)
 	return 0;
 }
 
-static
-int
-semfs_ioctl(struct vnode *vn, int op, userptr_t data)
-{
-	(void)vn;
-	(void)op;
-	(void)data;
-	return EINVAL;
-}
-
 static
 int
 semfs_gettype(struct vnode *vn, mode_t *ret)
@@ -133,15 +125,21 @@ semfs_getsem(struct semfs_vnode *semv)
 }
 
 /*
- * Wakeup helper. We only need to wake up if there are sleepers, which
- * should only be the case if the old count is 0; and we only
+ * Wakeup helper. Plain readers only sleep when the count is 0, so we
+ * only need to wake them up if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. A batch may be waiting for any count at all,
+ * so if there are batch sleepers, wake everyone whenever the count
+ * goes up.
  */
 static
 void
 semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 {
+	if (sem->sems_batchwaiters > 0 && newcount > sem->sems_count) {
+		cv_broadcast(sem->sems_cv, sem->sems_lock);
+		return;
+	}
 	if (sem->sems_count > 0 || newcount == 0) {
 		return;
 	}
@@ -291,6 +289,137 @@ semfs_truncate(struct vnode *vn, off_t len)
 	return 0;
 }
 
+/*
+ * Batch: do the operations in a struct semfs_batch all at once (see
+ * <kern/ioctl.h>).
+ *
+ * We hold a vnode reference on each semaphore, which keeps it from
+ * being destroyed, and take the semaphore locks in semaphore number
+ * order. If some P can't be done we let go of everything but that
+ * semaphore's lock, sleep on it, and start over.
+ */
+static
+int
+semfs_batch(struct semfs *semfs, userptr_t data)
+{
+	struct semfs_batch batch;
+	struct semfs_op *ops = batch.sb_ops;
+	struct semfs_op tmp;
+	struct vnode *vns[SEMFS_BATCHMAX];
+	struct semfs_sem *sems[SEMFS_BATCHMAX];
+	unsigned nops, i, j, need, blocked;
+	int result;
+
+	result = copyin(data, &batch, sizeof(batch));
+	if (result) {
+		return result;
+	}
+	nops = batch.sb_nops;
+	if (nops == 0) {
+		return 0;
+	}
+	if (nops > SEMFS_BATCHMAX) {
+		return E2BIG;
+	}
+
+	/* Sort by semaphore number; there are at most a few */
+	for (i=1; i<nops; i++) {
+		tmp = ops[i];
+		for (j=i; j>0 && ops[j-1].so_sem > tmp.so_sem; j--) {
+			ops[j] = ops[j-1];
+		}
+		ops[j] = tmp;
+	}
+	for (i=0; i<nops; i++) {
+		if (ops[i].so_sem == SEMFS_ROOTDIR ||
+		    (i > 0 && ops[i].so_sem == ops[i-1].so_sem)) {
+			return EINVAL;
+		}
+	}
+
+	for (i=0; i<nops; i++) {
+		result = semfs_getvnode(semfs, ops[i].so_sem, &vns[i]);
+		if (result) {
+			goto out;
+		}
+		sems[i] = semfs_getsembynum(semfs, ops[i].so_sem);
+	}
+
+ retry:
+	for (i=0; i<nops; i++) {
+		lock_acquire(sems[i]->sems_lock);
+	}
+
+	blocked = nops;
+	for (i=0; i<nops; i++) {
+		if (ops[i].so_delta >= 0) {
+			if (sems[i]->sems_count + ops[i].so_delta
+			    < sems[i]->sems_count) {
+				/* overflow */
+				result = EFBIG;
+				goto unlock;
+			}
+		}
+		else {
+			need = 0U - (unsigned)ops[i].so_delta;
+			if (sems[i]->sems_count < need && blocked == nops) {
+				blocked = i;
+			}
+		}
+	}
+
+	if (blocked < nops) {
+		for (i=0; i<nops; i++) {
+			if (i != blocked) {
+				lock_release(sems[i]->sems_lock);
+			}
+		}
+		DEBUG(DB_SEMFS, "semfs: batch: blocking on sem%u\n",
+		      ops[blocked].so_sem);
+		sems[blocked]->sems_batchwaiters++;
+		cv_wait(sems[blocked]->sems_cv, sems[blocked]->sems_lock);
+		sems[blocked]->sems_batchwaiters--;
+		lock_release(sems[blocked]->sems_lock);
+		goto retry;
+	}
+
+	for (i=0; i<nops; i++) {
+		if (ops[i].so_delta >= 0) {
+			semfs_wakeup(sems[i],
+				     sems[i]->sems_count + ops[i].so_delta);
+			sems[i]->sems_count += ops[i].so_delta;
+		}
+		else {
+			sems[i]->sems_count -= 0U - (unsigned)ops[i].so_delta;
+		}
+	}
+	result = 0;
+
+ unlock:
+	for (j=nops; j-- > 0; ) {
+		lock_release(sems[j]->sems_lock);
+	}
+	i = nops;
+ out:
+	while (i-- > 0) {
+		VOP_DECREF(vns[i]);
+	}
+	return result;
+}
+
+static
+int
+semfs_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+
+	switch (op) {
+	    case SEMFS_IOC_BATCH:
+		return semfs_batch(semv->semv_semfs, data);
+	}
+	return EINVAL;
+}
+
 ////////////////////////////////////////////////////////////
 // directory ops
 
@@ -366,6 +495,32 @@ semfs_namefile(struct vnode *vn, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Take a directory entry out of the directory array. To keep the
+ * array dense (so creat can always append) the last entry is moved
+ * into the hole; a concurrent reader of the directory may therefore
+ * miss that entry, as it may with any directory being changed under
+ * it.
+ */
+static
+void
+semfs_dir_unslot(struct semfs *semfs, struct semfs_direntry *dent)
+{
+	struct semfs_direntry *last;
+	unsigned num;
+
+	KASSERT(lock_do_i_hold(semfs->semfs_dirlock));
+	num = semfs_direntryarray_num(semfs->semfs_dents);
+	KASSERT(dent->semd_slot < num);
+	KASSERT(semfs_direntryarray_get(semfs->semfs_dents,
+					dent->semd_slot) == dent);
+
+	last = semfs_direntryarray_get(semfs->semfs_dents, num - 1);
+	last->semd_slot = dent->semd_slot;
+	semfs_direntryarray_set(semfs->semfs_dents, last->semd_slot, last);
+	semfs_direntryarray_setsize(semfs->semfs_dents, num - 1);
+}
+
 /*
  * Create a semaphore.
  */
@@ -378,7 +533,7 @@ semfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
 	struct semfs *semfs = dirsemv->semv_semfs;
 	struct semfs_direntry *dent;
 	struct semfs_sem *sem;
-	unsigned i, num, empty, semnum;
+	unsigned semnum;
 	int result;
 
 	(void)mode;
@@ -387,27 +542,16 @@ semfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
 	}
 
 	lock_acquire(semfs->semfs_dirlock);
-	num = semfs_direntryarray_num(semfs->semfs_dents);
-	empty = num;
-	for (i=0; i<num; i++) {
-		dent = semfs_direntryarray_get(semfs->semfs_dents, i);
-		if (dent == NULL) {
-			if (empty == num) {
-				empty = i;
-			}
-			continue;
-		}
-		if (!strcmp(dent->semd_name, name)) {
-			/* found */
-			if (excl) {
-				lock_release(semfs->semfs_dirlock);
-				return EEXIST;
-			}
-			result = semfs_getvnode(semfs, dent->semd_semnum,
-						resultvn);
+	dent = semfs_dir_find(semfs, name);
+	if (dent != NULL) {
+		/* found */
+		if (excl) {
 			lock_release(semfs->semfs_dirlock);
-			return result;
+			return EEXIST;
 		}
+		result = semfs_getvnode(semfs, dent->semd_semnum, resultvn);
+		lock_release(semfs->semfs_dirlock);
+		return result;
 	}
 
 	/* create it */
@@ -425,18 +569,14 @@ semfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
 
 	dent = semfs_direntry_create(name, semnum);
 	if (dent == NULL) {
+		result = ENOMEM;
 		goto fail_uninsert;
 	}
 
-	if (empty < num) {
-		semfs_direntryarray_set(semfs->semfs_dents, empty, dent);
-	}
-	else {
-		result = semfs_direntryarray_add(semfs->semfs_dents, dent,
-						 &empty);
-		if (result) {
-			goto fail_undent;
-		}
+	result = semfs_direntryarray_add(semfs->semfs_dents, dent,
+					 &dent->semd_slot);
+	if (result) {
+		goto fail_undent;
 	}
 
 	result = semfs_getvnode(semfs, semnum, resultvn);
@@ -444,12 +584,13 @@ semfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
 		goto fail_undir;
 	}
 
+	semfs_dir_hashinsert(semfs, dent);
 	sem->sems_linked = true;
 	lock_release(semfs->semfs_dirlock);
 	return 0;
 
  fail_undir:
-	semfs_direntryarray_set(semfs->semfs_dents, empty, NULL);
+	semfs_dir_unslot(semfs, dent);
  fail_undent:
 	semfs_direntry_destroy(dent);
  fail_uninsert:
@@ -475,47 +616,39 @@ semfs_remove(struct vnode *dirvn, const char *name)
 	struct semfs *semfs = dirsemv->semv_semfs;
 	struct semfs_direntry *dent;
 	struct semfs_sem *sem;
-	unsigned i, num;
-	int result;
 
 	if (!strcmp(name, ".") || !strcmp(name, "..")) {
 		return EINVAL;
 	}
 
 	lock_acquire(semfs->semfs_dirlock);
-	num = semfs_direntryarray_num(semfs->semfs_dents);
-	for (i=0; i<num; i++) {
-		dent = semfs_direntryarray_get(semfs->semfs_dents, i);
-		if (dent == NULL) {
-			continue;
-		}
-		if (!strcmp(name, dent->semd_name)) {
-			/* found */
-			sem = semfs_getsembynum(semfs, dent->semd_semnum);
-			lock_acquire(sem->sems_lock);
-			KASSERT(sem->sems_linked);
-			sem->sems_linked = false;
-			if (sem->sems_hasvnode == false) {
-				lock_acquire(semfs->semfs_tablelock);
-				semfs_semarray_set(semfs->semfs_sems,
-						   dent->semd_semnum, NULL);
-				lock_release(semfs->semfs_tablelock);
-				lock_release(sem->sems_lock);
-				semfs_sem_destroy(sem);
-			}
-			else {
-				lock_release(sem->sems_lock);
-			}
-			semfs_direntryarray_set(semfs->semfs_dents, i, NULL);
-			semfs_direntry_destroy(dent);
-			result = 0;
-			goto out;
-		}
+	dent = semfs_dir_find(semfs, name);
+	if (dent == NULL) {
+		lock_release(semfs->semfs_dirlock);
+		return ENOENT;
 	}
-	result = ENOENT;
- out:
+
+	sem = semfs_getsembynum(semfs, dent->semd_semnum);
+	lock_acquire(sem->sems_lock);
+	KASSERT(sem->sems_linked);
+	sem->sems_linked = false;
+	if (sem->sems_hasvnode == false) {
+		lock_acquire(semfs->semfs_tablelock);
+		semfs_semarray_set(semfs->semfs_sems,
+				   dent->semd_semnum, NULL);
+		lock_release(semfs->semfs_tablelock);
+		lock_release(sem->sems_lock);
+		semfs_sem_destroy(sem);
+	}
+	else {
+		lock_release(sem->sems_lock);
+	}
+	semfs_dir_hashremove(semfs, dent);
+	semfs_dir_unslot(semfs, dent);
+	semfs_direntry_destroy(dent);
+
 	lock_release(semfs->semfs_dirlock);
-	return result;
+	return 0;
 }
 
 /*
@@ -528,7 +661,6 @@ semfs_lookup(struct vnode *dirvn, char *path, struct vnode **resultvn)
 	struct semfs_vnode *dirsemv = dirvn->vn_data;
 	struct semfs *semfs = dirsemv->semv_semfs;
 	struct semfs_direntry *dent;
-	unsigned i, num;
 	int result;
 
 	if (!strcmp(path, ".") || !strcmp(path, "..")) {
@@ -538,21 +670,15 @@ semfs_lookup(struct vnode *dirvn, char *path, struct vnode **resultvn)
 	}
 
 	lock_acquire(semfs->semfs_dirlock);
-	num = semfs_direntryarray_num(semfs->semfs_dents);
-	for (i=0; i<num; i++) {
-		dent = semfs_direntryarray_get(semfs->semfs_dents, i);
-		if (dent == NULL) {
-			continue;
-		}
-		if (!strcmp(path, dent->semd_name)) {
-			result = semfs_getvnode(semfs, dent->semd_semnum,
-						resultvn);
-			lock_release(semfs->semfs_dirlock);
-			return result;
-		}
+	dent = semfs_dir_find(semfs, path);
+	if (dent == NULL) {
+		result = ENOENT;
+	}
+	else {
+		result = semfs_getvnode(semfs, dent->semd_semnum, resultvn);
 	}
 	lock_release(semfs->semfs_dirlock);
-	return ENOENT;
+	return result;
 }
 
 /*
@@ -603,19 +729,13 @@ semfs_reclaim(struct vnode *vn)
 
 	lock_acquire(semfs->semfs_tablelock);
 
-	/* vnode refcount is protected by the vnode's ->vn_countlock */
-	spinlock_acquire(&vn->vn_countlock);
-	if (vn->vn_refcount > 1) {
-		/* consume the reference VOP_DECREF passed us */
-		vn->vn_refcount--;
-
-		spinlock_release(&vn->vn_countlock);
+	/* new references are only handed out under the table lock */
+	if (refcount_dec_unless_last(&vn->vn_refcount)) {
+		/* consumed the reference VOP_DECREF passed us */
 		lock_release(semfs->semfs_tablelock);
 		return EBUSY;
 	}
 
-	spinlock_release(&vn->vn_countlock);
-
 	/* remove from the table */
 	num = vnodearray_num(semfs->semfs_vnodes);
 	for (i=0; i<num; i++) {
@@ -774,6 +894,15 @@ semfs_getvnode(struct semfs *semfs, unsigned semnum, struct vnode **ret)
 		}
 	}
 
+	/* The semaphore may be gone, if we came from semfs_batch */
+	if (semnum != SEMFS_ROOTDIR) {
+		if (semnum >= semfs_semarray_num(semfs->semfs_sems) ||
+		    semfs_semarray_get(semfs->semfs_sems, semnum) == NULL) {
+			lock_release(semfs->semfs_tablelock);
+			return ENOENT;
+		}
+	}
+
 	/* Make it */
 	semv = semfs_vnode_create(semfs, semnum);
 	if (semv == NULL) {
@@ -788,7 +917,6 @@ semfs_getvnode(struct semfs *semfs, unsigned semnum, struct vnode **ret)
 	}
 	if (semnum != SEMFS_ROOTDIR) {
 		sem = semfs_semarray_get(semfs->semfs_sems, semnum);
-		KASSERT(sem != NULL);
 		KASSERT(sem->sems_hasvnode == false);
 		sem->sems_hasvnode = true;
 	}
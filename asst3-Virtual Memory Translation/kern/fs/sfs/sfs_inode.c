@@ -80,18 +80,11 @@ sfs_reclaim(struct vnode *v)
 	 * decision was made to reclaim it. (You must also synchronize
 	 * this with sfs_loadvnode.)
 	 */
-	spinlock_acquire(&v->vn_countlock);
-	if (v->vn_refcount != 1) {
-
-		/* consume the reference VOP_DECREF gave us */
-		KASSERT(v->vn_refcount>1);
-		v->vn_refcount--;
-
-		spinlock_release(&v->vn_countlock);
+	if (refcount_dec_unless_last(&v->vn_refcount)) {
+		/* consumed the reference VOP_DECREF gave us */
 		vfs_biglock_release();
 		return EBUSY;
 	}
-	spinlock_release(&v->vn_countlock);
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount == 0) {
@@ -36,6 +36,7 @@
 
 
 #include <vm.h>
+#include <refcount.h>
 #include "opt-dumbvm.h"
 
 struct vnode;
@@ -49,11 +50,23 @@ struct vnode;
  */
 
 
+/*
+ * Shared region (see as_define_shared). The frames are allocated up
+ * front and belong to this structure, not to any one page table; the
+ * last address space to let go of it frees them.
+ */
+struct as_shared {
+    struct refcount sh_refcount; // number of segments using this
+    size_t sh_npages; // number of pages
+    paddr_t *sh_pages; // frame of each page
+};
+
 struct as_segment {
     vaddr_t vbase; // vritral address base
     size_t npage; // number of pages
     uint32_t mode; // premession
     uint32_t prev_mode; // previous premession
+    struct as_shared *shared; // pages shared across fork, or NULL
     struct as_segment* next; // next segnment
 };
 
@@ -66,10 +79,13 @@ struct addrspace {
         paddr_t as_pbase2;
         size_t as_npages2;
         paddr_t as_stackpbase;
+        paddr_t as_procinfo;
 #else
         /* Put stuff here for your VM system */
         paddr_t ***pagetable; // 3-level pagetable
         struct as_segment *as_segment; // a linked list of region specifications
+        vaddr_t as_mmaptop; // shared regions are placed below here
+        paddr_t as_procinfo; // frame of the USERINFO_PROC page
 #endif
 };
 
@@ -110,6 +126,24 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_shared - set up a zero-filled region of SZ bytes, placed
+ *                by the VM system, whose pages are shared with (not
+ *                copied to) the address spaces made from this one by
+ *                as_copy. Hands back its address.
+ *
+ *    as_translate - hand back the physical address VADDR is mapped to.
+ *                The page must already be resident (e.g. touch it
+ *                with copyin first); fails with EFAULT otherwise.
+ *
+ *    as_placepage - give the frame at kernel address KPAGE to the
+ *                address space as its page at VADDR, which must be
+ *                in a writeable region and not yet touched. On
+ *                success the address space owns the frame.
+ *
+ *    as_setpid - record PID in the address space's USERINFO_PROC page
+ *                (see <kern/userinfo.h>). Call when the address space
+ *                is given to a process.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -128,6 +162,13 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_shared(struct addrspace *as, size_t sz,
+                                   int writeable, vaddr_t *ret);
+int               as_translate(struct addrspace *as, vaddr_t vaddr,
+                               paddr_t *ret);
+int               as_placepage(struct addrspace *as, vaddr_t vaddr,
+                                   vaddr_t kpage);
+void              as_setpid(struct addrspace *as, pid_t pid);
 
 
 /*
@@ -135,9 +176,18 @@ int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
  *    load_elf - load an ELF user program executable into the current
  *               address space. Returns the entry point (initial PC)
  *               in the space pointed to by ENTRYPOINT.
+ *
+ *    loadelf_bootstrap - set up the cache of executable headers that
+ *               load_elf keeps.
+ *
+ *    loadelf_flush - empty that cache, which holds references to the
+ *               vnodes of recently run programs. Call before
+ *               unmounting.
  */
 
 int load_elf(struct vnode *v, vaddr_t *entrypoint);
+void loadelf_bootstrap(void);
+void loadelf_flush(void);
 
 
 #endif /* _ADDRSPACE_H_ */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+/*
+ * Atomic operations on single machine words, for reference counts,
+ * statistics counters, and lock-free data structures.
+ *
+ * atomic_add adds DELTA to *P and returns the new value. Use a
+ * negative delta (cast to unsigned) to subtract.
+ *
+ * atomic_cas sets *P to NEWVAL if and only if it is currently OLDVAL,
+ * and returns true if it did so.
+ *
+ * These do not include memory barriers; they are atomic with respect
+ * to the word they touch and nothing else. Code that publishes other
+ * data through an atomic word needs to use the barriers in membar.h
+ * itself.
+ *
+ * Plain loads and stores of an aligned word are already atomic, so
+ * there are no functions for those; use volatile.
+ */
+
+#include <cdefs.h>
+
+/* Inlining support - for making sure an out-of-line copy gets built */
+#ifndef ATOMIC_INLINE
+#define ATOMIC_INLINE INLINE
+#endif
+
+ATOMIC_INLINE unsigned atomic_add(volatile unsigned *p, unsigned delta);
+ATOMIC_INLINE bool atomic_cas(volatile unsigned *p,
+			      unsigned oldval, unsigned newval);
+
+/* Get the implementation. */
+#include <machine/atomic.h>
+
+#endif /* _ATOMIC_H_ */
@@ -41,6 +41,9 @@
  *     bitmap_mark    - set a clear bit by its index.
  *     bitmap_unmark  - clear a set bit by its index.
  *     bitmap_isset   - return whether a particular bit is set or not.
+ *     bitmap_findnext - locate the first set bit at or after an index.
+ *                      Returns ENOENT if there isn't one.
+ *     bitmap_findclear - same, for a clear bit. Doesn't set it.
  *     bitmap_destroy - destroy bitmap.
  */
 
@@ -53,6 +56,10 @@ int            bitmap_alloc(struct bitmap *, unsigned *index);
 void           bitmap_mark(struct bitmap *, unsigned index);
 void           bitmap_unmark(struct bitmap *, unsigned index);
 int            bitmap_isset(struct bitmap *, unsigned index);
+int            bitmap_findnext(struct bitmap *, unsigned start,
+                               unsigned *index);
+int            bitmap_findclear(struct bitmap *, unsigned start,
+                                unsigned *index);
 void           bitmap_destroy(struct bitmap *);
 
 
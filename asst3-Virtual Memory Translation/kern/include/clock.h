@@ -38,8 +38,8 @@
 
 
 /*
- * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * hardclock() is called on every CPU HZ times a second, only when the
+ * CPU is not idle, for scheduling.
  */
 
 /* hardclocks per second */
@@ -49,10 +49,25 @@ void hardclock_bootstrap(void);
 void hardclock(void);
 
 /*
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * Per-CPU timer interrupt management; see clock.c.
+ *
+ * clock_start() is called once gettime() works, to stop plain ticking.
+ * clock_interrupt() is called by the MD code when the timer goes off.
+ * clock_reprogram() makes sure the timer goes off no later than WHEN.
+ * clock_idle() and clock_unidle() are called by the scheduler when the
+ * CPU enters and leaves the idle loop.
+ */
+void clock_start(void);
+void clock_interrupt(void);
+void clock_reprogram(uint64_t when);
+void clock_idle(void);
+void clock_unidle(void);
+
+/*
+ * clock_now() returns the current time in nanoseconds, as used by
+ * kernel timers (see <timer.h>).
  */
-void timerclock(void);
+uint64_t clock_now(void);
 
 /*
  * gettime() may be used to fetch the current time of day.
@@ -76,8 +91,10 @@ void timespec_sub(const struct timespec *t1,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ * clock_nsleep() is the same but takes nanoseconds.
  */
 void clocksleep(int seconds);
+void clock_nsleep(uint64_t nsecs);
 
 
 #endif /* _CLOCK_H_ */
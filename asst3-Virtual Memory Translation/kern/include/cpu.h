@@ -33,6 +33,7 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <timer.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
@@ -59,8 +60,11 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadpool;	/* Exited threads kept for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	uint64_t c_nexttick;		/* When hardclock is next due */
+	uint64_t c_nextevent;		/* When the timer will go off */
 
 	/*
 	 * Accessed by other cpus.
@@ -88,6 +92,11 @@ struct cpu {
 	unsigned c_numshootdown;
 	struct spinlock c_ipi_lock;
 
+	/*
+	 * Accessed by other cpus. Protected inside timer.c.
+	 */
+	struct timerwheel c_timers;	/* Timers pending on this cpu */
+
 	/*
 	 * Accessed by other cpus. Protected inside hangman.c.
 	 */
@@ -112,6 +121,11 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * cpu_count returns the number of cpus found (running or not).
+ */
+unsigned cpu_count(void);
+
 /*
  * Produce a string describing the CPU type.
  */
@@ -40,25 +40,30 @@
 /*
  * The file table is an array of open files.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * The array starts small (FILETABLE_INITSIZE slots) and doubles as
+ * higher descriptors are used, up to OPEN_MAX; most processes never
+ * get past stdin/stdout/stderr and a few more. Alongside it is a
+ * bitmap of OPEN_MAX bits marking which descriptors are in use, so
+ * finding the lowest free descriptor, and walking the open ones on
+ * fork and exit, doesn't mean looking at every slot.
  *
  * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * never shared and so it doesn't require synchronization; in
+ * particular filetable_get is just a bounds check and a load. On
+ * fork, the table is copied. Another exercise: what would you need
+ * to do to make this code safe for multithreaded processes? What
+ * happens if one thread calls close() while another one is in the
+ * middle of e.g. read() using the same file handle? (Or if one thread
+ * grows the array while another is reading a slot from it?)
  */
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct openfile **ft_openfiles;	/* ft_size slots */
+	unsigned ft_size;		/* current size of the array */
+	struct bitmap *ft_used;		/* which fds are open */
 };
 
+#define FILETABLE_INITSIZE 8
+
 /*
  * Filetable ops:
  *
@@ -71,7 +76,8 @@ struct filetable {
  *           is not NULL.) Call put with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
- *           previously there.
+ *           previously there. (Can fail only if it needs to grow the
+ *           table, and never when inserting NULL.)
  */
 
 struct filetable *filetable_create(void);
@@ -83,8 +89,8 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
 
 
 #endif /* _FILETABLE_H_ */
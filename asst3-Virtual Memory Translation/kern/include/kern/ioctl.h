@@ -34,6 +34,30 @@
  * ioctl operation codes
  */
 
-/* (none yet) */
+/*
+ * semfs: perform several P and V operations, on one or more
+ * semaphores, as a single atomic step. The ioctl may be issued on
+ * any open file in sem:, and its argument is a struct semfs_batch.
+ * Semaphores are named by number, which is the st_ino fstat reports
+ * for them.
+ *
+ * A positive delta is V by that much and a negative delta is P. If
+ * any P can't be satisfied the call sleeps, without doing any of the
+ * operations, until all of them can be done at once. Each semaphore
+ * may appear only once in a batch.
+ */
+#define SEMFS_IOC_BATCH		1
+
+#define SEMFS_BATCHMAX		8	/* ops per batch */
+
+struct semfs_op {
+	unsigned so_sem;	/* semaphore number */
+	int so_delta;		/* > 0 for V, < 0 for P */
+};
+
+struct semfs_batch {
+	unsigned sb_nops;
+	struct semfs_op sb_ops[SEMFS_BATCHMAX];
+};
 
 #endif /* _KERN_IOCTL_H_*/
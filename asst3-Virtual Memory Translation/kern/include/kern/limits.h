@@ -64,10 +64,11 @@
 
 /* Max bytes for an exec function (should be at least 16K) */
 /*
- * UNSW Note: We use max 4K to avoid the frametable allocator needing
- * to deal with greater than 4K allocations
+ * UNSW Note: this used to be 4K to avoid the frametable allocator
+ * needing to deal with greater than 4K allocations. exec now keeps
+ * the arguments in single pages, so it can be the usual 64K again.
  */
-#define __ARG_MAX       (4 * 1024)
+#define __ARG_MAX       (64 * 1024)
 
 /*
  * Important for system behavior, but not a big part of the API.
@@ -89,7 +90,7 @@
 #define __PIPE_BUF      512
 
 /* Max number of processes at once. */
-#define __PROCS_MAX       128
+#define __PROCS_MAX       1024
 
 
 /*
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_USERINFO_H_
+#define _KERN_USERINFO_H_
+
+/*
+ * Pages the kernel maps read-only into every user address space, so
+ * that things that rarely change can be read without a system call.
+ *
+ * USERINFO_GLOBAL is one page shared by everybody, holding the time
+ * of day and the number of cpus. The time is updated on every clock
+ * tick (HZ times a second) and so is only that precise; use __time()
+ * when you need better. The kernel bumps ui_seq before and after each
+ * update, so it is odd while an update is in progress; readers should
+ * read ui_seq, then the fields, then ui_seq again, and retry if it
+ * was odd or changed.
+ *
+ * USERINFO_PROC is private to each process and holds its pid.
+ *
+ * Both sit immediately below the user stack.
+ */
+
+#define USERINFO_GLOBAL	0x7ffde000
+#define USERINFO_PROC	0x7ffdf000
+
+struct userinfo {
+	__u32 ui_seq;		/* update sequence number */
+	__u32 ui_ncpu;		/* number of cpus */
+	__time_t ui_sec;	/* time of day as of the last tick */
+	__i32 ui_nsec;
+};
+
+struct userinfo_proc {
+	__pid_t up_pid;		/* process id */
+};
+
+
+#endif /* _KERN_USERINFO_H_ */
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOCKDEP_H
+#define LOCKDEP_H
+
+/*
+ * Lock order validator. Enable with "options lockdep" in the kernel
+ * config.
+ *
+ * Where hangman reports a deadlock once it has happened, this records
+ * which classes of sleep lock have been held while acquiring which
+ * others, and panics the first time some thread takes two of them in
+ * the opposite order to one seen before, whether or not that actually
+ * deadlocks this time. A lock's class is its name, so all locks
+ * created with the same name are treated as one lock for ordering
+ * purposes.
+ */
+
+#include "opt-lockdep.h"
+
+#if OPT_LOCKDEP
+
+/* Per-lock state: which class the lock belongs to. */
+struct lockdep_lock {
+	const char *ll_name;
+	int ll_class;		/* -1 if not tracked */
+};
+
+/* Per-thread state: the tracked locks it currently holds, in order. */
+#define LOCKDEP_MAXHELD 16
+
+struct lockdep_held {
+	unsigned lh_count;
+	const struct lockdep_lock *lh_locks[LOCKDEP_MAXHELD];
+};
+
+void lockdep_lockinit(struct lockdep_lock *l, const char *name);
+void lockdep_acquire(struct lockdep_held *h, const struct lockdep_lock *l);
+void lockdep_release(struct lockdep_held *h, const struct lockdep_lock *l);
+
+#define LOCKDEP_LOCK(sym)	struct lockdep_lock sym
+#define LOCKDEP_HELD(sym)	struct lockdep_held sym
+
+#define LOCKDEP_LOCKINIT(l, n)	lockdep_lockinit(l, n)
+#define LOCKDEP_HELDINIT(h)	((h)->lh_count = 0)
+
+#define LOCKDEP_ACQUIRE(h, l)	lockdep_acquire(h, l)
+#define LOCKDEP_RELEASE(h, l)	lockdep_release(h, l)
+
+#else
+
+#define LOCKDEP_LOCK(sym)
+#define LOCKDEP_HELD(sym)
+
+#define LOCKDEP_LOCKINIT(l, n)
+#define LOCKDEP_HELDINIT(h)
+
+#define LOCKDEP_ACQUIRE(h, l)
+#define LOCKDEP_RELEASE(h, l)
+
+#endif
+
+#endif /* LOCKDEP_H */
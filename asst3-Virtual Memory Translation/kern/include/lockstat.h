@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+/*
+ * Lock contention statistics. Enable with "options lockstat" in the
+ * kernel config.
+ *
+ * Sleep locks, CVs, and spinlocks each carry a struct lockstat that
+ * counts acquisitions, how many of them had to wait, and how long
+ * they waited in total and at most. It also remembers the call site
+ * that held the lock when the longest wait happened (for a CV, the
+ * call site that waited). A lock shows up in the report once it has
+ * been contended at least once.
+ *
+ * Waits are timed with clock_now(), in nanoseconds; nothing is timed
+ * until lockstat_bootstrap() is called, once the clock works.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct lockstat {
+	const char *ls_name;		/* NULL for spinlocks */
+	const char *ls_kind;		/* "lock", "cv"; NULL for spinlocks */
+	struct lockstat *ls_next;	/* list of contended locks */
+	struct lockstat *ls_prev;
+	bool ls_listed;			/* on the list */
+	unsigned ls_acquires;		/* times acquired (or waited, for CVs) */
+	unsigned ls_contended;		/* how many of those waited */
+	uint64_t ls_waitns;		/* total nanoseconds waited */
+	uint64_t ls_maxwaitns;		/* longest wait */
+	const void *ls_holdsite;	/* call site of the latest holder */
+	const void *ls_maxsite;		/* holder's call site in longest wait */
+};
+
+/* Kept on the acquiring thread's stack while it waits. */
+struct lockstat_wait {
+	bool lw_waited;
+	uint64_t lw_start;
+	const void *lw_site;
+};
+
+void lockstat_bootstrap(void);
+void lockstat_init(struct lockstat *ls, const char *kind, const char *name);
+void lockstat_cleanup(struct lockstat *ls);
+void lockstat_contended(struct lockstat *ls, struct lockstat_wait *w,
+			const void *site);
+void lockstat_acquired(struct lockstat *ls, struct lockstat_wait *w,
+		       const void *site);
+
+/* Print the N locks with the most total wait; zero all the counts. */
+void lockstat_print(unsigned n);
+void lockstat_reset(void);
+
+#define LOCKSTAT(sym)			struct lockstat sym
+#define LOCKSTAT_WAIT(sym)		struct lockstat_wait sym = \
+						{ false, 0, NULL }
+
+/* For SPINLOCK_INITIALIZER; note the trailing comma. */
+#define LOCKSTAT_INITIALIZER		{ NULL, NULL, NULL, NULL, false, \
+					  0, 0, 0, 0, NULL, NULL },
+
+#define LOCKSTAT_INIT(ls, kind, name)	lockstat_init(ls, kind, name)
+#define LOCKSTAT_CLEANUP(ls)		lockstat_cleanup(ls)
+
+/*
+ * Call CONTENDED each time around the wait loop (only the first
+ * counts), and ACQUIRED once the lock is held. SITE is the caller's
+ * return address; for CONTENDED, NULL means the holder's.
+ */
+#define LOCKSTAT_CONTENDED(ls, w, site)	lockstat_contended(ls, &(w), site)
+#define LOCKSTAT_ACQUIRED(ls, w, site)	lockstat_acquired(ls, &(w), site)
+
+#else
+
+#define LOCKSTAT(sym)
+#define LOCKSTAT_WAIT(sym)
+
+#define LOCKSTAT_INITIALIZER
+
+#define LOCKSTAT_INIT(ls, kind, name)
+#define LOCKSTAT_CLEANUP(ls)
+
+#define LOCKSTAT_CONTENDED(ls, w, site)
+#define LOCKSTAT_ACQUIRED(ls, w, site)
+
+#endif
+
+#endif /* LOCKSTAT_H */
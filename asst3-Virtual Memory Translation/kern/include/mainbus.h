@@ -55,6 +55,9 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/* Make the current cpu's timer interrupt go off in NSECS nanoseconds. */
+void mainbus_timer_set(uint64_t nsecs);
+
 /* Request breaking into the debugger, where available. */
 void mainbus_debugger(void);
 
@@ -34,7 +34,7 @@
 #ifndef _OPENFILE_H_
 #define _OPENFILE_H_
 
-#include <spinlock.h>
+#include <refcount.h>
 
 
 /*
@@ -55,8 +55,7 @@ struct openfile {
 	struct lock *of_offsetlock;	/* lock for of_offset */
 	off_t of_offset;
 
-	struct spinlock of_reflock;	/* lock for of_refcount */
-	int of_refcount;
+	struct refcount of_refcount;
 };
 
 /* open a file (args must be kernel pointers; destroys filename) */
@@ -40,6 +40,7 @@
 #include <thread.h> /* required for struct threadarray */
 
 struct addrspace;
+struct semaphore;
 struct vnode;
 
 /*
@@ -60,6 +61,7 @@ struct proc {
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
+	struct semaphore *p_vforksem;	/* if borrowing parent's; see below */
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
@@ -80,6 +82,23 @@ int proc_create_runprogram(const char *name, struct proc **ret);
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
+/*
+ * Create a fresh process for use by vfork(). Instead of a copy of the
+ * current address space it borrows the address space itself, until
+ * it execs or exits; it then calls V on DONE, and the parent (which
+ * should be waiting on DONE) can use the address space again.
+ */
+int proc_vfork(struct semaphore *done, struct proc **ret);
+
+/*
+ * Create a fresh process for use by __spawn(): like proc_fork, but
+ * with no address space at all.
+ */
+int proc_spawn(struct proc **ret);
+
+/* Give back a borrowed address space, if we have one (see proc_vfork). */
+void proc_vforkdone(struct proc *proc);
+
 /* Undo proc_fork if nothing's run in the new process yet. */
 void proc_unfork(struct proc *proc);
 
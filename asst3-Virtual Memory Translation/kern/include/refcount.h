@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _REFCOUNT_H_
+#define _REFCOUNT_H_
+
+/*
+ * Reference counts, kept with atomic operations instead of a
+ * spinlock.
+ *
+ * refcount_inc takes a new reference; the caller must already hold
+ * one (or otherwise know the object can't go away).
+ *
+ * refcount_dec drops a reference and returns true if it was the
+ * last one, in which case the caller destroys the object.
+ *
+ * refcount_dec_unless_last drops a reference only if it isn't the
+ * last one, and returns true if it did. If it returns false the
+ * count is still 1 and the caller still owns that reference. This is
+ * for objects (like vnodes) where dropping the last reference means
+ * going to some table lock and rechecking whether anyone has found
+ * the object there in the meantime.
+ *
+ * The decrements are ordered after everything the caller did with
+ * the object beforehand, and a true return from refcount_dec is
+ * ordered before the caller's teardown, so the last user doesn't
+ * need any other lock to destroy the object safely.
+ */
+
+#include <cdefs.h>
+#include <lib.h>
+#include <membar.h>
+#include <atomic.h>
+
+/* Inlining support - for making sure an out-of-line copy gets built */
+#ifndef REFCOUNT_INLINE
+#define REFCOUNT_INLINE INLINE
+#endif
+
+struct refcount {
+	volatile unsigned rc_count;
+};
+
+REFCOUNT_INLINE void refcount_init(struct refcount *rc, unsigned count);
+REFCOUNT_INLINE unsigned refcount_get(const struct refcount *rc);
+REFCOUNT_INLINE void refcount_inc(struct refcount *rc);
+REFCOUNT_INLINE bool refcount_dec(struct refcount *rc);
+REFCOUNT_INLINE bool refcount_dec_unless_last(struct refcount *rc);
+
+REFCOUNT_INLINE
+void
+refcount_init(struct refcount *rc, unsigned count)
+{
+	rc->rc_count = count;
+}
+
+/* For assertions and diagnostics; the value may change at any time. */
+REFCOUNT_INLINE
+unsigned
+refcount_get(const struct refcount *rc)
+{
+	return rc->rc_count;
+}
+
+REFCOUNT_INLINE
+void
+refcount_inc(struct refcount *rc)
+{
+	unsigned newcount;
+
+	newcount = atomic_add(&rc->rc_count, 1);
+	KASSERT(newcount > 1);
+	(void)newcount;
+}
+
+REFCOUNT_INLINE
+bool
+refcount_dec(struct refcount *rc)
+{
+	unsigned newcount;
+
+	membar_any_store();
+	newcount = atomic_add(&rc->rc_count, (unsigned)-1);
+	KASSERT(newcount != (unsigned)-1);
+	if (newcount == 0) {
+		membar_load_load();
+		return true;
+	}
+	return false;
+}
+
+REFCOUNT_INLINE
+bool
+refcount_dec_unless_last(struct refcount *rc)
+{
+	unsigned count;
+
+	membar_any_store();
+	do {
+		count = rc->rc_count;
+		KASSERT(count > 0);
+		if (count == 1) {
+			return false;
+		}
+	} while (!atomic_cas(&rc->rc_count, count, count - 1));
+	return true;
+}
+
+#endif /* _REFCOUNT_H_ */
@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -58,6 +59,7 @@
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	LOCKSTAT(splk_lockstat);	    /* Contention statistics. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
 };
 
@@ -66,9 +68,11 @@ struct spinlock {
  */
 #ifdef OPT_HANGMAN
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_INITIALIZER \
 				  HANGMAN_LOCKABLE_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_INITIALIZER }
 #endif
 
 /*
@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include <lockdep.h>
 
 /*
  * Dijkstra-style semaphore.
@@ -75,9 +76,13 @@ void V(struct semaphore *);
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
+        LOCKDEP_LOCK(lk_lockdep);       /* Lock order validator hook. */
+        LOCKSTAT(lk_lockstat);          /* Contention statistics. */
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        bool lk_adaptive;               /* Spin while holder is running. */
+        bool lk_handoff;                /* Release straight to a waiter. */
 };
 
 struct lock *lock_create(const char *name);
@@ -98,6 +103,26 @@ void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+/*
+ * Locks are adaptive by default: a thread that finds the lock held by
+ * a thread that is running on another cpu spins until the holder lets
+ * go or stops running, on the theory that it will let go soon and
+ * that's cheaper than two context switches. It sleeps otherwise.
+ * lock_set_adaptive(lock, false) makes it always sleep.
+ */
+void lock_set_adaptive(struct lock *, bool adaptive);
+
+/*
+ * By default lock_release frees the lock and wakes one waiter, which
+ * then competes for it with everyone else, so a thread that releases
+ * and reacquires in a loop can keep it while the waiter goes back to
+ * sleep. With lock_set_handoff(lock, true), lock_release instead
+ * hands the lock directly to the thread that has been waiting
+ * longest, so waiters get it in FIFO order, at the cost of the lock
+ * being idle until that thread runs.
+ */
+void lock_set_handoff(struct lock *, bool handoff);
+
 
 /*
  * Condition variable.
@@ -117,6 +142,7 @@ struct cv {
         char *cv_name;
         struct wchan *cv_wchan;
         struct spinlock cv_wchanlock;
+        LOCKSTAT(cv_lockstat);          /* Wait statistics. */
 };
 
 struct cv *cv_create(const char *name);
@@ -140,4 +166,46 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of threads may hold the lock for reading at once, or one
+ * thread may hold it for writing. Writers are preferred: once a writer
+ * is waiting, new readers wait too, so a steady stream of readers
+ * can't starve writers out. When a writer releases the lock it hands
+ * it to the next waiting writer if there is one, and otherwise lets
+ * all the waiting readers in.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+
+struct rwlock {
+        char *rw_name;
+        struct wchan *rw_readwchan;     /* Readers wait here. */
+        struct wchan *rw_writewchan;    /* Writers wait here. */
+        struct spinlock rw_lock;
+        volatile unsigned rw_readers;   /* Readers holding the lock. */
+        volatile unsigned rw_waitingwriters;
+        struct thread *volatile rw_writer;
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Release a read hold of the lock.
+ *    rwlock_acquire_write - Get the lock for writing, exclusive of all
+ *                           readers and other writers.
+ *    rwlock_release_write - Release the lock; only the thread holding
+ *                           it for writing may do this.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -54,6 +54,9 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 /* Setup function for exec. */
 void exec_bootstrap(void);
 
+/* Setup function for futexes. */
+void futex_bootstrap(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -64,18 +67,31 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
+int sys___spawn(userptr_t prog, userptr_t args, pid_t *retval);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
 
+int sys_mmap(size_t length, int prot, int fd, off_t offset, int *retval);
+int sys_futex_wait(userptr_t uaddr, int val);
+int sys_futex_wake(userptr_t uaddr, int n, int *retval);
+
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_sendfile(int outfd, int infd, userptr_t offsetptr, size_t count,
+		 int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
 
 int sys_chdir(const_userptr_t path);
@@ -90,6 +106,7 @@ int sys_rename(userptr_t oldpath, userptr_t newpath);
 int sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval);
 int sys_fstat(int fd, userptr_t statptr);
 int sys_fsync(int fd);
+int sys_ioctl(int fd, int code, userptr_t buf);
 int sys_ftruncate(int fd, off_t len);
 
 #endif /* _SYSCALL_H_ */
@@ -49,14 +49,25 @@ int arraytest2(int, char **);
 int bitmaptest(int, char **);
 int threadlisttest(int, char **);
 
+/* copyin/copyout tests */
+int usercopytest(int, char **);
+int usercopybench(int, char **);
+
 /* thread tests */
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadbench(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int lockbench(int, char **);
+int lockfairbench(int, char **);
+int cvbcastbench(int, char **);
+int rwtest(int, char **);
+int rwtest2(int, char **);
+int rwbench(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -38,6 +38,7 @@
 
 #include <array.h>
 #include <spinlock.h>
+#include <lockdep.h>
 #include <threadlist.h>
 
 struct cpu;
@@ -82,8 +83,10 @@ struct thread {
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
+	unsigned t_lastrun;		/* t_cpu's c_hardclocks at switch-out */
 	struct proc *t_proc;		/* Process thread belongs to */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
+	LOCKDEP_HELD(t_lockdep);	/* Lock order validator hook */
 
 	/*
 	 * Interrupt state fields.
@@ -163,11 +166,5 @@ void thread_yield(void);
  */
 void schedule(void);
 
-/*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
- */
-void thread_consider_migration(void);
-
 
 #endif /* _THREAD_H_ */
@@ -83,6 +83,9 @@ void threadlist_addtail(struct threadlist *tl, struct thread *t);
 struct thread *threadlist_remhead(struct threadlist *tl);
 struct thread *threadlist_remtail(struct threadlist *tl);
 
+/* Move all of SRC onto the end of DST, in constant time. */
+void threadlist_join(struct threadlist *dst, struct threadlist *src);
+
 /* Add and remove: in middle. (TL is needed to maintain ->tl_count.) */
 void threadlist_insertafter(struct threadlist *tl,
 			    struct thread *onlist, struct thread *addee);
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timers.
+ *
+ * A timer calls a function once, at (or shortly after) a given time
+ * as returned by clock_now(). Each CPU keeps its pending timers in a
+ * hierarchical timing wheel, so starting and cancelling a timer are
+ * both O(1). Timers run on the CPU that started them, in interrupt
+ * context, and must not sleep.
+ *
+ * struct timer is made public so timers do not have to be malloc'd;
+ * however, code that uses timers should not look inside the structure
+ * directly but always use the timer functions.
+ */
+
+#include <spinlock.h>
+
+struct cpu;
+
+/* A time that never comes. */
+#define TIMER_NEVER		0xffffffffffffffffULL
+
+/*
+ * Wheel geometry. Level 0 slots are 2^TIMER_RESSHIFT ns (131 us)
+ * wide; each level up is TIMER_SLOTS times coarser. With 5 levels of
+ * 64 slots the wheel spans 2^47 ns, about 39 hours; timers further
+ * out than that are parked at the top and re-sorted when they come
+ * around.
+ */
+#define TIMER_RESSHIFT		17
+#define TIMER_SLOTSHIFT		6
+#define TIMER_SLOTS		(1 << TIMER_SLOTSHIFT)
+#define TIMER_LEVELS		5
+
+struct timer {
+	struct timer *tm_next;		/* Next timer in wheel slot */
+	struct timer **tm_prevp;	/* Pointer to us in wheel slot */
+	uint64_t tm_expires;		/* When to go off (ns) */
+	void (*tm_func)(void *);	/* Function to call */
+	void *tm_data;			/* Argument for tm_func */
+	struct cpu *tm_cpu;		/* CPU we're pending on, or NULL */
+	unsigned tm_level;		/* Wheel level we're on */
+};
+
+/*
+ * Per-CPU timing wheel. tw_now is the level 0 slot number (time in
+ * units of 2^TIMER_RESSHIFT ns) up to which the wheel has been run.
+ */
+struct timerwheel {
+	struct spinlock tw_lock;
+	uint64_t tw_now;
+	unsigned tw_count[TIMER_LEVELS];
+	struct timer *tw_slots[TIMER_LEVELS][TIMER_SLOTS];
+};
+
+/*
+ * Timer functions.
+ *
+ * init		Initialize a timer to call FUNC(DATA) when it goes off.
+ * start	Arrange for the timer to go off at time WHEN, on the
+ *		current CPU. The timer must not already be pending.
+ * cancel	Stop a pending timer. Returns true if the timer was
+ *		pending, false if it had already gone off (or was
+ *		never started). Note that in the latter case the
+ *		function might still be running on some other CPU.
+ */
+void timer_init(struct timer *t, void (*func)(void *), void *data);
+void timer_start(struct timer *t, uint64_t when);
+bool timer_cancel(struct timer *t);
+
+/*
+ * Timing wheel functions, for the clock code.
+ *
+ * init		Set up an empty wheel.
+ * run		Call every timer on the wheel that is due at time NOW.
+ * next		Return the time the wheel next needs running, or
+ *		TIMER_NEVER if it's empty. This may be earlier than
+ *		the first timer actually expires.
+ */
+void timerwheel_init(struct timerwheel *tw);
+void timerwheel_run(struct timerwheel *tw, uint64_t now);
+uint64_t timerwheel_next(struct timerwheel *tw);
+
+
+#endif /* _TIMER_H_ */
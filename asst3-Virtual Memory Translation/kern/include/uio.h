@@ -144,5 +144,12 @@ void uio_kinit(struct iovec *, struct uio *,
 void uio_uinit(struct iovec *, struct uio *,
 	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * The same, for a list of IOVCNT user buffers (as for readv/writev).
+ * The uio updates the iovecs as it goes.
+ */
+void uio_uinitv(struct iovec *, unsigned iovcnt, struct uio *,
+		off_t pos, enum uio_rw rw);
+
 
 #endif /* _UIO_H_ */
@@ -38,7 +38,16 @@
 #define FIRST_LEVEL 256
 #define SECOND_LEVEL 64
 #define THIRD_LEVEL 64
-#define STACK_PAGES 16
+/* Room for ARG_MAX of arguments and as much again of actual stack */
+#define STACK_PAGES 32
+
+/*
+ * Page table entries are TLBLO values. The hardware ignores the low
+ * bits, so we use one to mark frames that belong to a shared region
+ * (see as_define_shared), which are freed with the region rather than
+ * with the page table. Mask it off before loading the TLB.
+ */
+#define PTE_SHARED 0x00000001
 
 #include <machine/vm.h>
 
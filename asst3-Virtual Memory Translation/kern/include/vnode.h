@@ -30,7 +30,7 @@
 #ifndef _VNODE_H_
 #define _VNODE_H_
 
-#include <spinlock.h>
+#include <refcount.h>
 struct uio;
 struct stat;
 
@@ -49,8 +49,9 @@ struct stat;
  * Note: vn_fs may be null if the vnode refers to a device.
  */
 struct vnode {
-	int vn_refcount;                /* Reference count */
-	struct spinlock vn_countlock;   /* Lock for vn_refcount */
+	struct refcount vn_refcount;    /* Reference count */
+	volatile unsigned vn_writers;   /* Writes/truncates in progress */
+	volatile unsigned vn_writegen;  /* Bumped after each write/truncate */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
@@ -231,14 +232,14 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
-#define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
+#define VOP_WRITE(vn, uio)              (vnode_write(vn, uio))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
-#define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
+#define VOP_TRUNCATE(vn, pos)           (vnode_truncate(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
@@ -257,6 +258,22 @@ struct vnode_ops {
  */
 void vnode_check(struct vnode *, const char *op);
 
+/*
+ * Change the file's contents (used by VOP_WRITE and VOP_TRUNCATE),
+ * keeping track so caches of things read from it can tell.
+ */
+int vnode_write(struct vnode *, struct uio *);
+int vnode_truncate(struct vnode *, off_t);
+
+/*
+ * For caching things read from a file: call vnode_writegen before
+ * reading, and vnode_unchanged with what it returned afterwards. If
+ * that's true, no write or truncate overlapped the read and none has
+ * happened since, so what was read is current.
+ */
+unsigned vnode_writegen(struct vnode *);
+bool vnode_unchanged(struct vnode *, unsigned gen);
+
 /*
  * Reference count manipulation (handled above filesystem level)
  */
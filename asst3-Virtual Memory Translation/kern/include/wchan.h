@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct thread; /* in thread.h */
 struct wchan; /* Opaque */
 
 /*
@@ -76,5 +77,13 @@ void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Wake up the thread that has been sleeping on the channel longest,
+ * and return it, or NULL if there were none. Unlike wchan_wakeone,
+ * this is promised to be FIFO, so ownership of something can be
+ * handed to the thread woken.
+ */
+struct thread *wchan_wakehead(struct wchan *wc, struct spinlock *lk);
+
 
 #endif /* _WCHAN_H_ */
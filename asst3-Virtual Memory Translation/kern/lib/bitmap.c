@@ -168,6 +168,74 @@ bitmap_isset(struct bitmap *b, unsigned index)
         return (b->v[ix] & mask);
 }
 
+int
+bitmap_findnext(struct bitmap *b, unsigned start, unsigned *index)
+{
+        unsigned ix;
+        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+        unsigned offset;
+        WORD_TYPE w;
+
+        if (start >= b->nbits) {
+                return ENOENT;
+        }
+
+        ix = start / BITS_PER_WORD;
+        /* drop the bits below start in the first word */
+        w = b->v[ix] & (WORD_TYPE)(WORD_ALLBITS << (start % BITS_PER_WORD));
+        while (1) {
+                if (w != 0) {
+                        for (offset = 0; (w & 1) == 0; offset++) {
+                                w >>= 1;
+                        }
+                        *index = (ix*BITS_PER_WORD)+offset;
+                        /* the leftover bits at the end are set too */
+                        if (*index >= b->nbits) {
+                                return ENOENT;
+                        }
+                        return 0;
+                }
+                ix++;
+                if (ix >= maxix) {
+                        return ENOENT;
+                }
+                w = b->v[ix];
+        }
+}
+
+int
+bitmap_findclear(struct bitmap *b, unsigned start, unsigned *index)
+{
+        unsigned ix;
+        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+        unsigned offset;
+        WORD_TYPE w;
+
+        if (start >= b->nbits) {
+                return ENOENT;
+        }
+
+        ix = start / BITS_PER_WORD;
+        /* treat the bits below start in the first word as set */
+        w = b->v[ix] | (WORD_TYPE)~(WORD_ALLBITS << (start % BITS_PER_WORD));
+        while (1) {
+                if (w != WORD_ALLBITS) {
+                        for (offset = 0; (w & 1) != 0; offset++) {
+                                w >>= 1;
+                        }
+                        /* the leftover bits at the end are set */
+                        *index = (ix*BITS_PER_WORD)+offset;
+                        KASSERT(*index < b->nbits);
+                        return 0;
+                }
+                ix++;
+                if (ix >= maxix) {
+                        return ENOENT;
+                }
+                w = b->v[ix];
+        }
+}
+
 void
 bitmap_destroy(struct bitmap *b)
 {
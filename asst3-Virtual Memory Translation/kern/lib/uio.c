@@ -184,3 +184,28 @@ uio_uinit(struct iovec *iov, struct uio *u,
 	u->uio_rw = rw;
 	u->uio_space = proc_getas();
 }
+
+/*
+ * Set up a uio for a userspace transfer to or from several buffers.
+ */
+
+void
+uio_uinitv(struct iovec *iov, unsigned iovcnt, struct uio *u,
+	   off_t offset, enum uio_rw rw)
+{
+	unsigned i;
+
+	DEBUGASSERT(iov != NULL || iovcnt == 0);
+	DEBUGASSERT(u != NULL);
+
+	u->uio_iov = iov;
+	u->uio_iovcnt = iovcnt;
+	u->uio_offset = offset;
+	u->uio_resid = 0;
+	for (i=0; i<iovcnt; i++) {
+		u->uio_resid += iov[i].iov_len;
+	}
+	u->uio_segflg = UIO_USERSPACE;
+	u->uio_rw = rw;
+	u->uio_space = proc_getas();
+}
@@ -42,12 +42,14 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
 #include <pid.h>
 #include <syscall.h>
+#include <userinfo.h>
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
@@ -121,6 +123,11 @@ boot(void)
 	KASSERT(curthread->t_curspl > 0);
 	mainbus_bootstrap();
 	KASSERT(curthread->t_curspl == 0);
+	/* The time-of-day clock is attached now, so timers can work. */
+	clock_start();
+#if OPT_LOCKSTAT
+	lockstat_bootstrap();
+#endif
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
@@ -128,8 +135,10 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	userinfo_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	futex_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
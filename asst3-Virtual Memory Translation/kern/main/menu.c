@@ -38,6 +38,7 @@
 #include <clock.h>
 #include <mainbus.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <thread.h>
 #include <proc.h>
 #include <vfs.h>
@@ -500,6 +501,35 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for lock contention statistics.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+#if OPT_LOCKSTAT
+	if (nargs == 1) {
+		lockstat_print(10);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else if (nargs == 2 && atoi(args[1]) > 0) {
+		lockstat_print(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: lockstat [count | reset]\n");
+	}
+#else
+	(void)nargs;
+	(void)args;
+	kprintf("lockstat: not compiled in (options lockstat)\n");
+#endif
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -566,9 +596,12 @@ static const char *testmenu[] = {
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
 	"[km4] Multipage kmalloc test        ",
+	"[uc1] User copy test                ",
+	"[uc2] User copy benchmark           ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread create/exit benchmark  ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -576,6 +609,12 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] Contended lock benchmark      ",
+	"[sy6] Lock fairness benchmark       ",
+	"[sy7] CV broadcast benchmark        ",
+	"[rw1] Reader-writer lock test       ",
+	"[rw2] RW lock writer preference test",
+	"[rw3] Multi-reader benchmark        ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -606,6 +645,7 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[lockstat] Lock contention stats    ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +697,7 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "lockstat",   cmd_lockstat },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -667,18 +708,27 @@ static struct {
 	{ "km2",	kmallocstress },
 	{ "km3",	kmalloctest3 },
 	{ "km4",	kmalloctest4 },
+	{ "uc1",	usercopytest },
+	{ "uc2",	usercopybench },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadbench },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	lockbench },
+	{ "sy6",	lockfairbench },
+	{ "sy7",	cvbcastbench },
+	{ "rw1",	rwtest },
+	{ "rw2",	rwtest2 },
+	{ "rw3",	rwbench },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
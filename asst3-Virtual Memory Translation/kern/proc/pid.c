@@ -37,6 +37,8 @@
 #include <limits.h>
 #include <lib.h>
 #include <array.h>
+#include <bitmap.h>
+#include <atomic.h>
 #include <clock.h>
 #include <thread.h>
 #include <proc.h>
@@ -50,6 +52,11 @@
  * If pi_ppid is INVALID_PID, the parent has gone away and will not be
  * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
  * structure can be freed.
+ *
+ * pi_nchildren counts the pidinfos whose pi_ppid is this pid. Only
+ * the process itself changes it (when it forks, waits, or disowns),
+ * but the kernel process has many threads, so it's updated
+ * atomically.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
@@ -57,22 +64,43 @@ struct pidinfo {
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
 	struct cv *pi_cv;		// use to wait for thread exit
+	volatile unsigned pi_nchildren;	// number of children
+	struct pidinfo *pi_next;	// next in hash chain
 };
 
 
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * Pids in use are marked in pidmap, which is protected by the
+ * spinlock pidmap_lock along with nextpid and nprocs. To keep from
+ * reusing pids right away, we look for a free one starting from
+ * nextpid rather than from the bottom.
+ *
+ * The pidinfo structures live in a hash table, chained, indexed by
+ * (pid % PIDHASH_SIZE). Each bucket has its own lock, which also
+ * protects the fields of the pidinfos in it and is the lock used
+ * with their pi_cv. Nothing ever holds two bucket locks at once.
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
-static pid_t nextpid;			// next candidate pid
+#define PIDHASH_SIZE 128
+
+static struct pidbucket {
+	struct lock *pb_lock;
+	struct pidinfo *pb_head;
+} pidhash[PIDHASH_SIZE];
+
+static struct spinlock pidmap_lock;
+static struct bitmap *pidmap;		// pids in use
+static pid_t nextpid;			// where to start looking
 static int nprocs;			// number of allocated pids
 
+static
+struct pidbucket *
+pid_bucket(pid_t pid)
+{
+	return &pidhash[pid % PIDHASH_SIZE];
+}
+
 
 
 /*
@@ -101,6 +129,8 @@ pidinfo_create(pid_t pid, pid_t ppid)
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	pi->pi_nchildren = 0;
+	pi->pi_next = NULL;
 
 	return pi;
 }
@@ -126,22 +156,33 @@ pidinfo_destroy(struct pidinfo *pi)
 void
 pid_bootstrap(void)
 {
+	struct pidinfo *pi;
+	pid_t pid;
 	int i;
 
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
-		panic("Out of memory creating pid lock\n");
+	for (i=0; i<PIDHASH_SIZE; i++) {
+		pidhash[i].pb_lock = lock_create("pidhash");
+		if (pidhash[i].pb_lock == NULL) {
+			panic("Out of memory creating pid locks\n");
+		}
+		pidhash[i].pb_head = NULL;
 	}
 
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
+	spinlock_init(&pidmap_lock);
+	pidmap = bitmap_create(PID_MAX + 1);
+	if (pidmap == NULL) {
+		panic("Out of memory creating pid map\n");
+	}
+	/* INVALID_PID, KERNEL_PID, and whatever else is below PID_MIN */
+	for (pid=0; pid<PID_MIN; pid++) {
+		bitmap_mark(pidmap, pid);
 	}
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
+	pi = pidinfo_create(KERNEL_PID, INVALID_PID);
+	if (pi==NULL) {
 		panic("Out of memory creating kernel pid data\n");
 	}
+	pid_bucket(KERNEL_PID)->pb_head = pi;
 
 	nextpid = PID_MIN;
 	nprocs = 1;
@@ -154,37 +195,53 @@ static
 struct pidinfo *
 pi_get(pid_t pid)
 {
+	struct pidbucket *pb;
 	struct pidinfo *pi;
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	if (pi==NULL) {
-		return NULL;
-	}
-	if (pi->pi_pid != pid) {
-		return NULL;
+	pb = pid_bucket(pid);
+	KASSERT(lock_do_i_hold(pb->pb_lock));
+
+	for (pi = pb->pb_head; pi != NULL; pi = pi->pi_next) {
+		if (pi->pi_pid == pid) {
+			return pi;
+		}
 	}
-	return pi;
+	return NULL;
 }
 
 /*
- * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * pi_put: insert a new pidinfo in the process table. The pid must
+ * already be marked in pidmap.
  */
 static
 void
 pi_put(pid_t pid, struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidbucket *pb;
 
 	KASSERT(pid != INVALID_PID);
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	pb = pid_bucket(pid);
+	KASSERT(lock_do_i_hold(pb->pb_lock));
+
+	pi->pi_next = pb->pb_head;
+	pb->pb_head = pi;
+}
+
+/*
+ * pi_unmap: return a pid to pidmap.
+ */
+static
+void
+pi_unmap(pid_t pid)
+{
+	spinlock_acquire(&pidmap_lock);
+	bitmap_unmark(pidmap, pid);
+	nprocs--;
+	spinlock_release(&pidmap_lock);
 }
 
 /*
@@ -196,84 +253,104 @@ static
 void
 pi_drop(pid_t pid)
 {
-	struct pidinfo *pi;
+	struct pidbucket *pb;
+	struct pidinfo **pip, *pi;
 
-	KASSERT(lock_do_i_hold(pidlock));
+	pb = pid_bucket(pid);
+	KASSERT(lock_do_i_hold(pb->pb_lock));
 
-	pi = pidinfo[pid % PROCS_MAX];
+	for (pip = &pb->pb_head; *pip != NULL; pip = &(*pip)->pi_next) {
+		if ((*pip)->pi_pid == pid) {
+			break;
+		}
+	}
+	pi = *pip;
 	KASSERT(pi != NULL);
-	KASSERT(pi->pi_pid == pid);
+	*pip = pi->pi_next;
 
 	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+	pi_unmap(pid);
 }
 
-////////////////////////////////////////////////////////////
+/*
+ * pi_self: get the current process's pidinfo. It can't go away while
+ * we're still running, so it's fine to use it after unlocking, but
+ * only pi_nchildren may be touched without the bucket lock.
+ */
+static
+struct pidinfo *
+pi_self(void)
+{
+	struct pidbucket *pb;
+	struct pidinfo *us;
+
+	pb = pid_bucket(curproc->p_pid);
+	lock_acquire(pb->pb_lock);
+	us = pi_get(curproc->p_pid);
+	lock_release(pb->pb_lock);
+	KASSERT(us != NULL);
+	return us;
+}
 
 /*
- * Helper function for pid_alloc.
+ * One of our children is no longer ours.
  */
 static
 void
-inc_nextpid(void)
+pi_lostchild(void)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidinfo *us;
 
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
-	}
+	us = pi_self();
+	KASSERT(us->pi_nchildren > 0);
+	atomic_add(&us->pi_nchildren, -1);
 }
 
+////////////////////////////////////////////////////////////
+
 /*
  * pid_alloc: allocate a process id.
  */
 int
 pid_alloc(pid_t *retval)
 {
+	struct pidbucket *pb;
 	struct pidinfo *pi;
-	pid_t pid;
-	int count;
+	unsigned pid;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* lock the table */
-	lock_acquire(pidlock);
-
+	/* find a free pid, starting at nextpid and wrapping around */
+	spinlock_acquire(&pidmap_lock);
 	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
+		spinlock_release(&pidmap_lock);
 		return EAGAIN;
 	}
-
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
-
-		inc_nextpid();
+	if (bitmap_findclear(pidmap, nextpid, &pid)) {
+		/* nothing above nextpid; PROCS_MAX is less than PID_MAX */
+		if (bitmap_findclear(pidmap, PID_MIN, &pid)) {
+			panic("pid_alloc: no free pids but nprocs is %d\n",
+			      nprocs);
+		}
 	}
-
-	pid = nextpid;
+	KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+	bitmap_mark(pidmap, pid);
+	nprocs++;
+	nextpid = pid == PID_MAX ? PID_MIN : pid + 1;
+	spinlock_release(&pidmap_lock);
 
 	pi = pidinfo_create(pid, curproc->p_pid);
 	if (pi==NULL) {
-		lock_release(pidlock);
+		pi_unmap(pid);
 		return ENOMEM;
 	}
 
+	pb = pid_bucket(pid);
+	lock_acquire(pb->pb_lock);
 	pi_put(pid, pi);
+	lock_release(pb->pb_lock);
 
-	inc_nextpid();
-
-	lock_release(pidlock);
+	atomic_add(&pi_self()->pi_nchildren, 1);
 
 	*retval = pid;
 	return 0;
@@ -286,11 +363,13 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
+	struct pidbucket *pb;
 	struct pidinfo *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	pb = pid_bucket(theirpid);
+	lock_acquire(pb->pb_lock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -304,7 +383,9 @@ pid_unalloc(pid_t theirpid)
 
 	pi_drop(theirpid);
 
-	lock_release(pidlock);
+	lock_release(pb->pb_lock);
+
+	pi_lostchild();
 }
 
 /*
@@ -314,11 +395,13 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
+	struct pidbucket *pb;
 	struct pidinfo *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	pb = pid_bucket(theirpid);
+	lock_acquire(pb->pb_lock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
@@ -329,7 +412,9 @@ pid_disown(pid_t theirpid)
 		pi_drop(them->pi_pid);
 	}
 
-	lock_release(pidlock);
+	lock_release(pb->pb_lock);
+
+	pi_lostchild();
 }
 
 /*
@@ -343,28 +428,38 @@ pid_disown(pid_t theirpid)
 void
 pid_setexitstatus(int status)
 {
-	struct pidinfo *us;
+	struct pidbucket *pb;
+	struct pidinfo *us, *pi, *next;
 	int i;
 
-	lock_acquire(pidlock);
 	KASSERT(curproc->p_pid != INVALID_PID);
+	us = pi_self();
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
+	/*
+	 * First, disown all children. They could be in any bucket, so
+	 * skip this if we know there aren't any, which is the usual
+	 * case.
+	 */
+	for (i=0; i<PIDHASH_SIZE && us->pi_nchildren > 0; i++) {
+		pb = &pidhash[i];
+		lock_acquire(pb->pb_lock);
+		for (pi = pb->pb_head; pi != NULL; pi = next) {
+			next = pi->pi_next;
+			if (pi->pi_ppid == curproc->p_pid) {
+				pi->pi_ppid = INVALID_PID;
+				if (pi->pi_exited) {
+					pi_drop(pi->pi_pid);
+				}
+				atomic_add(&us->pi_nchildren, -1);
 			}
 		}
+		lock_release(pb->pb_lock);
 	}
+	KASSERT(us->pi_nchildren == 0);
 
 	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
+	pb = pid_bucket(curproc->p_pid);
+	lock_acquire(pb->pb_lock);
 
 	us->pi_exitstatus = status;
 	us->pi_exited = true;
@@ -374,11 +469,11 @@ pid_setexitstatus(int status)
 		pi_drop(curproc->p_pid);
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		cv_broadcast(us->pi_cv, pb->pb_lock);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
+	lock_release(pb->pb_lock);
 }
 
 /*
@@ -392,6 +487,7 @@ pid_setexitstatus(int status)
 int
 pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 {
+	struct pidbucket *pb;
 	struct pidinfo *them;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
@@ -415,11 +511,12 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
+	pb = pid_bucket(theirpid);
+	lock_acquire(pb->pb_lock);
 
 	them = pi_get(theirpid);
 	if (them==NULL) {
-		lock_release(pidlock);
+		lock_release(pb->pb_lock);
 		return ESRCH;
 	}
 
@@ -427,19 +524,19 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 
 	/* Only allow waiting for own children. */
 	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
+		lock_release(pb->pb_lock);
 		return EPERM;
 	}
 
 	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			lock_release(pb->pb_lock);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
 		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
+		cv_wait(them->pi_cv, pb->pb_lock);
 		KASSERT(them->pi_exited == true);
 	}
 
@@ -460,6 +557,8 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 	them->pi_ppid = 0;
 	pi_drop(them->pi_pid);
 
-	lock_release(pidlock);
+	lock_release(pb->pb_lock);
+
+	pi_lostchild();
 	return 0;
 }
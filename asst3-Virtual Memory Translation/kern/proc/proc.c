@@ -90,6 +90,7 @@ proc_create(const char *name)
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
+	proc->p_vforksem = NULL;
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
@@ -135,6 +136,8 @@ proc_destroy(struct proc *proc)
 	}
 
 	/* VM fields */
+	/* A borrowed address space isn't ours to destroy */
+	proc_vforkdone(proc);
 	if (proc->p_addrspace) {
 		/*
 		 * If p is the current process, remove it safely from
@@ -259,11 +262,13 @@ proc_create_runprogram(const char *name, struct proc **ret)
  * is not null. (If RET is null, what we're creating is a kernel-only
  * thread and it doesn't need an address space or file handles.)
  * However, the new thread always inherits its current working
- * directory from the caller. The new thread is given no address space
- * (the caller decides that).
+ * directory from the caller. If COPYAS is set the new process gets a
+ * copy of the caller's address space; otherwise it gets none (and the
+ * caller decides what it should have).
  */
+static
 int
-proc_fork(struct proc **ret)
+proc_clone(struct proc **ret, bool copyas)
 {
 	struct proc *newproc;
 	struct addrspace *as;
@@ -293,7 +298,7 @@ proc_fork(struct proc **ret)
 
 	/* VM fields */
 	as = proc_getas();
-	if (as != NULL) {
+	if (as != NULL && copyas) {
 		result = as_copy(as, &newproc->p_addrspace);
 		if (result) {
 			pid_unalloc(newproc->p_pid);
@@ -301,6 +306,7 @@ proc_fork(struct proc **ret)
 			proc_destroy(newproc);
 			return result;
 		}
+		as_setpid(newproc->p_addrspace, newproc->p_pid);
 	}
 
 	/* VFS fields */
@@ -333,6 +339,73 @@ proc_fork(struct proc **ret)
 	return 0;
 }
 
+/*
+ * Clone the current process for fork: copy the address space.
+ */
+int
+proc_fork(struct proc **ret)
+{
+	return proc_clone(ret, true);
+}
+
+/*
+ * Clone the current process for vfork: lend it our address space.
+ * The caller must not touch the address space again until DONE is
+ * V'd, which proc_vforkdone does.
+ */
+int
+proc_vfork(struct semaphore *done, struct proc **ret)
+{
+	struct proc *newproc;
+	int result;
+
+	result = proc_clone(&newproc, false);
+	if (result) {
+		return result;
+	}
+	newproc->p_addrspace = proc_getas();
+	newproc->p_vforksem = done;
+
+	*ret = newproc;
+	return 0;
+}
+
+/*
+ * Clone the current process for spawn: no address space; the new
+ * process loads its own.
+ */
+int
+proc_spawn(struct proc **ret)
+{
+	return proc_clone(ret, false);
+}
+
+/*
+ * If PROC is borrowing its parent's address space (from vfork), give
+ * it back: drop our pointer to it and let the parent go. Called on
+ * exec, once the new address space is in place, and on exit.
+ */
+void
+proc_vforkdone(struct proc *proc)
+{
+	struct semaphore *done;
+
+	done = proc->p_vforksem;
+	if (done == NULL) {
+		return;
+	}
+	proc->p_vforksem = NULL;
+
+	if (proc == curproc) {
+		/* exec has already installed a new address space */
+		KASSERT(proc_getas() != NULL);
+	}
+	else {
+		proc->p_addrspace = NULL;
+	}
+	V(done);
+}
+
 /*
  * Undo proc_fork if nothing's run in the new process yet.
  */
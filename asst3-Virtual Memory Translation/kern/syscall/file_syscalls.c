@@ -38,6 +38,7 @@
 #include <kern/seek.h>
 #include <kern/stat.h>
 #include <lib.h>
+#include <limits.h>
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
@@ -105,20 +106,25 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for read, write, and their vector and positioned
+ * forms.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on the IOVCNT user
+ * buffers in IOV. If EXPLICITPOS, do the I/O at POS and leave the seek
+ * position alone; otherwise use and update the seek position. Only
+ * the latter needs the offset lock, so positioned I/O on a shared
+ * file doesn't serialize.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
+sys_readwrite(int fd, struct iovec *iov, unsigned iovcnt,
+	      bool explicitpos, off_t pos, enum uio_rw rw,
 	      int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
 	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -127,14 +133,27 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
-	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
-		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+	if (explicitpos) {
+		locked = false;
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			result = ESPIPE;
+			goto fail;
+		}
+		if (pos < 0) {
+			result = EINVAL;
+			goto fail;
+		}
 	}
 	else {
-		pos = 0;
+		/* Only lock the seek position if we're really using it. */
+		locked = VOP_ISSEEKABLE(file->of_vnode);
+		if (locked) {
+			lock_acquire(file->of_offsetlock);
+			pos = file->of_offset;
+		}
+		else {
+			pos = 0;
+		}
 	}
 
 	if (file->of_accmode == badaccmode) {
@@ -142,8 +161,9 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* set up a uio with the buffers and the offset */
+	uio_uinitv(iov, iovcnt, &useruio, pos, rw);
+	size = useruio.uio_resid;
 
 	/* do the read or write */
 	result = (rw == UIO_READ) ?
@@ -183,7 +203,12 @@ fail:
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, false, 0, UIO_READ, O_WRONLY,
+			     retval);
 }
 
 /*
@@ -192,7 +217,320 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, false, 0, UIO_WRITE, O_RDONLY,
+			     retval);
+}
+
+/*
+ * pread() - read at POS without using the seek position.
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, true, pos, UIO_READ, O_WRONLY,
+			     retval);
+}
+
+/*
+ * pwrite() - write at POS without using the seek position.
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, true, pos, UIO_WRITE, O_RDONLY,
+			     retval);
+}
+
+/*
+ * Number of iovecs readv/writev handle on the stack; more than this
+ * and we kmalloc the array.
+ */
+#define SMALL_IOV	8
+
+/*
+ * Common logic for readv and writev: copy in the iovec array, check
+ * it, and use sys_readwrite.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	struct iovec smalliov[SMALL_IOV];
+	struct iovec *iov;
+	size_t total;
+	int i, result;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= SMALL_IOV) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto out;
+	}
+
+	/* The total has to fit in the return value. */
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > (size_t)0x7fffffff - total) {
+			result = EINVAL;
+			goto out;
+		}
+		total += iov[i].iov_len;
+	}
+
+	result = sys_readwrite(fd, iov, iovcnt, false, 0, rw, badaccmode,
+			       retval);
+ out:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * Size of the kernel buffer sendfile copies through.
+ */
+#define SENDFILE_BUFSIZE	4096
+
+/*
+ * Copy up to COUNT bytes from one vnode to another through BUF,
+ * reading at *INPOS and writing at *OUTPOS and advancing both. Stops
+ * early at end of file, or if the output stops taking data, which
+ * counts as EIO. Returns the number of bytes moved in *DONE; if that's
+ * nonzero any error is dropped, like a short write.
+ */
+static
+int
+sendfile_copy(struct vnode *invn, off_t *inpos, struct vnode *outvn,
+	      off_t *outpos, size_t count, char *buf, size_t *done)
+{
+	struct iovec iov;
+	struct uio kuio;
+	size_t len, got, put, wrote;
+	int result;
+
+	*done = 0;
+	while (*done < count) {
+		len = count - *done;
+		if (len > SENDFILE_BUFSIZE) {
+			len = SENDFILE_BUFSIZE;
+		}
+
+		uio_kinit(&iov, &kuio, buf, len, *inpos, UIO_READ);
+		result = VOP_READ(invn, &kuio);
+		if (result) {
+			goto fail;
+		}
+		got = len - kuio.uio_resid;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+
+		put = 0;
+		while (put < got) {
+			uio_kinit(&iov, &kuio, buf + put, got - put,
+				  *outpos, UIO_WRITE);
+			result = VOP_WRITE(outvn, &kuio);
+			if (result) {
+				/* count what was written, discard the rest */
+				*inpos += put;
+				*done += put;
+				goto fail;
+			}
+			wrote = (got - put) - kuio.uio_resid;
+			if (wrote == 0) {
+				/* no room left (full disk or the like) */
+				*inpos += put;
+				*done += put;
+				result = EIO;
+				goto fail;
+			}
+			*outpos += wrote;
+			put += wrote;
+		}
+		*inpos += got;
+		*done += got;
+	}
+	return 0;
+
+ fail:
+	return *done > 0 ? 0 : result;
+}
+
+/*
+ * sendfile() - copy COUNT bytes from INFD to OUTFD inside the kernel.
+ *
+ * If OFFSETPTR is not null, read from the offset it points to and
+ * update it afterwards, leaving INFD's seek position alone; otherwise
+ * read at INFD's seek position, like read. The output is written like
+ * write.
+ *
+ * There's no buffer cache to lend us its pages, so the data goes
+ * through one kernel buffer: one copy in each direction, but no trips
+ * through user space and one trap for the whole transfer.
+ */
+int
+sys_sendfile(int outfd, int infd, userptr_t offsetptr, size_t count,
+	     int *retval)
+{
+	struct openfile *infile, *outfile;
+	struct lock *locks[2];
+	bool inlocked, outlocked;
+	off_t inpos, outpos;
+	size_t done;
+	char *buf;
+	unsigned i, nlocks;
+	int result;
+
+	if (count > 0x7fffffff) {
+		/* must fit in the return value */
+		count = 0x7fffffff;
+	}
+
+	result = filetable_get(curproc->p_filetable, infd, &infile);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(curproc->p_filetable, outfd, &outfile);
+	if (result) {
+		filetable_put(curproc->p_filetable, infd, infile);
+		return result;
+	}
+
+	if (infile->of_accmode == O_WRONLY ||
+	    outfile->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+	if (infile == outfile) {
+		/* would read what it's writing, and need its lock twice */
+		result = EINVAL;
+		goto out;
+	}
+
+	if (offsetptr != NULL) {
+		if (!VOP_ISSEEKABLE(infile->of_vnode)) {
+			result = ESPIPE;
+			goto out;
+		}
+		result = copyin(offsetptr, &inpos, sizeof(inpos));
+		if (result) {
+			goto out;
+		}
+		if (inpos < 0) {
+			result = EINVAL;
+			goto out;
+		}
+		inlocked = false;
+	}
+	else {
+		inlocked = VOP_ISSEEKABLE(infile->of_vnode);
+	}
+	outlocked = VOP_ISSEEKABLE(outfile->of_vnode);
+
+	buf = kmalloc(SENDFILE_BUFSIZE);
+	if (buf == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+
+	/*
+	 * Take the offset locks we need in address order, so two
+	 * sendfiles going opposite ways between the same files can't
+	 * deadlock.
+	 */
+	nlocks = 0;
+	if (inlocked) {
+		locks[nlocks++] = infile->of_offsetlock;
+	}
+	if (outlocked) {
+		locks[nlocks++] = outfile->of_offsetlock;
+	}
+	if (nlocks == 2 && (uintptr_t)locks[0] > (uintptr_t)locks[1]) {
+		locks[0] = outfile->of_offsetlock;
+		locks[1] = infile->of_offsetlock;
+	}
+	for (i=0; i<nlocks; i++) {
+		lock_acquire(locks[i]);
+	}
+
+	if (inlocked) {
+		inpos = infile->of_offset;
+	}
+	else if (offsetptr == NULL) {
+		inpos = 0;
+	}
+	outpos = outlocked ? outfile->of_offset : 0;
+
+	result = sendfile_copy(infile->of_vnode, &inpos,
+			       outfile->of_vnode, &outpos,
+			       count, buf, &done);
+
+	if (inlocked) {
+		infile->of_offset = inpos;
+	}
+	if (outlocked) {
+		outfile->of_offset = outpos;
+	}
+	for (i=nlocks; i-- > 0; ) {
+		lock_release(locks[i]);
+	}
+	kfree(buf);
+
+	if (result == 0 && offsetptr != NULL) {
+		result = copyout(&inpos, offsetptr, sizeof(inpos));
+	}
+	if (result == 0) {
+		*retval = done;
+	}
+
+ out:
+	filetable_put(curproc->p_filetable, outfd, outfile);
+	filetable_put(curproc->p_filetable, infd, infile);
+	return result;
 }
 
 /*
@@ -203,6 +541,7 @@ sys_close(int fd)
 {
 	struct filetable *ft;
 	struct openfile *file;
+	int result;
 
 	ft = curproc->p_filetable;
 
@@ -212,7 +551,9 @@ sys_close(int fd)
 	}
 
 	/* place null in the filetable and get the file previously there */
-	filetable_placeat(ft, NULL, fd, &file);
+	result = filetable_placeat(ft, NULL, fd, &file);
+	/* placing NULL never has to grow the table */
+	KASSERT(result == 0);
 
 	if (file == NULL) {
 		/* oops, it wasn't open, that's an error */
@@ -321,7 +662,11 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	filetable_put(ft, oldfd, oldfdfile);
 
 	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
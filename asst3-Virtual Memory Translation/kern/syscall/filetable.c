@@ -34,49 +34,110 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <bitmap.h>
 #include <openfile.h>
 #include <filetable.h>
 
 
 /*
- * Construct a filetable.
+ * Construct a filetable with SIZE slots.
  */
+static
 struct filetable *
-filetable_create(void)
+filetable_create_sized(unsigned size)
 {
 	struct filetable *ft;
-	int fd;
+
+	KASSERT(size > 0 && size <= OPEN_MAX);
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
 		return NULL;
 	}
+	ft->ft_openfiles = kmalloc(size * sizeof(struct openfile *));
+	if (ft->ft_openfiles == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+	ft->ft_used = bitmap_create(OPEN_MAX);
+	if (ft->ft_used == NULL) {
+		kfree(ft->ft_openfiles);
+		kfree(ft);
+		return NULL;
+	}
+	ft->ft_size = size;
 
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
-	}
+	bzero(ft->ft_openfiles, size * sizeof(struct openfile *));
 
 	return ft;
 }
 
+/*
+ * Construct a filetable.
+ */
+struct filetable *
+filetable_create(void)
+{
+	return filetable_create_sized(FILETABLE_INITSIZE);
+}
+
+/*
+ * Grow the slot array so that FD fits, by doubling.
+ */
+static
+int
+filetable_grow(struct filetable *ft, unsigned fd)
+{
+	struct openfile **newfiles;
+	unsigned newsize;
+
+	KASSERT(fd >= ft->ft_size && fd < OPEN_MAX);
+
+	newsize = ft->ft_size;
+	while (newsize <= fd) {
+		newsize *= 2;
+	}
+	if (newsize > OPEN_MAX) {
+		newsize = OPEN_MAX;
+	}
+
+	newfiles = kmalloc(newsize * sizeof(struct openfile *));
+	if (newfiles == NULL) {
+		return ENOMEM;
+	}
+	memcpy(newfiles, ft->ft_openfiles,
+	       ft->ft_size * sizeof(struct openfile *));
+	bzero(newfiles + ft->ft_size,
+	      (newsize - ft->ft_size) * sizeof(struct openfile *));
+
+	kfree(ft->ft_openfiles);
+	ft->ft_openfiles = newfiles;
+	ft->ft_size = newsize;
+	return 0;
+}
+
 /*
  * Destroy a filetable.
  */
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
+	unsigned fd;
 
 	KASSERT(ft != NULL);
 
 	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] != NULL) {
-			openfile_decref(ft->ft_openfiles[fd]);
-			ft->ft_openfiles[fd] = NULL;
-		}
+	fd = 0;
+	while (bitmap_findnext(ft->ft_used, fd, &fd) == 0) {
+		KASSERT(ft->ft_openfiles[fd] != NULL);
+		openfile_decref(ft->ft_openfiles[fd]);
+		ft->ft_openfiles[fd] = NULL;
+		bitmap_unmark(ft->ft_used, fd);
+		fd++;
 	}
+	bitmap_destroy(ft->ft_used);
+	kfree(ft->ft_openfiles);
 	kfree(ft);
 }
 
@@ -100,7 +161,7 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
 	struct openfile *file;
-	int fd;
+	unsigned fd;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,18 +169,21 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = filetable_create_sized(src->ft_size);
 	if (dest == NULL) {
 		return ENOMEM;
 	}
 
-	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	/* share the entries; only look at the ones that are open */
+	memcpy(bitmap_getdata(dest->ft_used), bitmap_getdata(src->ft_used),
+	       DIVROUNDUP(OPEN_MAX, CHAR_BIT));
+	fd = 0;
+	while (bitmap_findnext(src->ft_used, fd, &fd) == 0) {
 		file = src->ft_openfiles[fd];
-		if (file != NULL) {
-			openfile_incref(file);
-		}
+		KASSERT(file != NULL);
+		openfile_incref(file);
 		dest->ft_openfiles[fd] = file;
+		fd++;
 	}
 
 	*dest_ret = dest;
@@ -132,7 +196,7 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
+	/* Slots past ft_size are valid; they just aren't allocated yet */
 	(void)ft;
 
 	return (fd >= 0 && fd < OPEN_MAX);
@@ -145,13 +209,18 @@ filetable_okfd(struct filetable *ft, int fd)
  * This checks that the file handle is in range and fails rather than
  * returning a null openfile; it only yields files that are actually
  * open.
+ *
+ * This is on the path of every read and write, so it takes no locks:
+ * the table belongs to a single-threaded process and nothing else can
+ * change it underneath us. An fd past the end of the array can't be
+ * open, so the one comparison against ft_size covers okfd as well.
  */
 int
 filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
 	struct openfile *file;
 
-	if (!filetable_okfd(ft, fd)) {
+	if (fd < 0 || (unsigned)fd >= ft->ft_size) {
 		return EBADF;
 	}
 
@@ -184,6 +253,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
+	KASSERT(fd >= 0 && (unsigned)fd < ft->ft_size);
 	KASSERT(ft->ft_openfiles[fd] == file);
 }
 
@@ -195,22 +265,31 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
  * manipulating stdin/stdout/stderr.)
  *
  * Consumes a reference to the openfile object. (That reference is
- * placed in the table.)
+ * placed in the table.) Does not consume it on failure.
  */
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned fd;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
+	KASSERT(file != NULL);
+
+	if (bitmap_alloc(ft->ft_used, &fd)) {
+		return EMFILE;
+	}
+	if (fd >= ft->ft_size) {
+		result = filetable_grow(ft, fd);
+		if (result) {
+			bitmap_unmark(ft->ft_used, fd);
+			return result;
 		}
 	}
 
-	return EMFILE;
+	KASSERT(ft->ft_openfiles[fd] == NULL);
+	ft->ft_openfiles[fd] = file;
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
@@ -221,17 +300,41 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails (with ENOMEM, consuming nothing) only if the slot is past the
+ * end of the array and growing it runs out of memory.
  *
  * Note that you can use this to place NULL in the filetable, which is
- * potentially handy.
+ * potentially handy; that never fails.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
+	struct openfile *oldfile;
+	int result;
+
 	KASSERT(filetable_okfd(ft, fd));
 
-	*oldfile_ret = ft->ft_openfiles[fd];
+	if ((unsigned)fd >= ft->ft_size) {
+		if (newfile == NULL) {
+			/* nothing there, and nothing to put there */
+			*oldfile_ret = NULL;
+			return 0;
+		}
+		result = filetable_grow(ft, fd);
+		if (result) {
+			return result;
+		}
+	}
+
+	oldfile = ft->ft_openfiles[fd];
 	ft->ft_openfiles[fd] = newfile;
+	if (oldfile == NULL && newfile != NULL) {
+		bitmap_mark(ft->ft_used, fd);
+	}
+	else if (oldfile != NULL && newfile == NULL) {
+		bitmap_unmark(ft->ft_used, fd);
+	}
+	*oldfile_ret = oldfile;
+	return 0;
 }
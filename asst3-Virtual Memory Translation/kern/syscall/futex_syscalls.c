@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: the sleeping half of userlevel locks and semaphores.
+ *
+ * Userland keeps its lock or semaphore in an int and updates it with
+ * atomic instructions, only calling into the kernel when it has to
+ * wait (futex_wait) or might have to wake someone (futex_wake). So an
+ * uncontended operation never enters the kernel at all.
+ *
+ * Waiters are keyed by the physical address of the int, so processes
+ * sharing a page (see sys_mmap) can use futexes in it, and hashed
+ * into buckets each with a spinlock and wait channel. A wake wakes
+ * the whole bucket; waiters whose key didn't match just go back to
+ * sleep.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <addrspace.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+#define FUTEX_BUCKETS	64
+
+struct futex_waiter {
+	paddr_t fw_key;			/* physical address waited on */
+	bool fw_woken;			/* set by futex_wake */
+	struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;
+	struct wchan *fb_wchan;
+	struct futex_waiter *fb_head;	/* waiters, oldest first */
+	struct futex_waiter **fb_tailp;
+};
+
+static struct futex_bucket futex_buckets[FUTEX_BUCKETS];
+
+void
+futex_bootstrap(void)
+{
+	struct futex_bucket *fb;
+	unsigned i;
+
+	for (i = 0; i < FUTEX_BUCKETS; i++) {
+		fb = &futex_buckets[i];
+		spinlock_init(&fb->fb_lock);
+		fb->fb_wchan = wchan_create("futex");
+		if (fb->fb_wchan == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		fb->fb_head = NULL;
+		fb->fb_tailp = &fb->fb_head;
+	}
+}
+
+/*
+ * Find the key and bucket for the user int at UADDR.
+ */
+static
+int
+futex_lookup(userptr_t uaddr, paddr_t *key, struct futex_bucket **fb)
+{
+	int val, result;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	/* Checks it's a user address, and faults the page in. */
+	result = copyin(uaddr, &val, sizeof(val));
+	if (result) {
+		return result;
+	}
+
+	result = as_translate(proc_getas(), (vaddr_t)uaddr, key);
+	if (result) {
+		return result;
+	}
+	*fb = &futex_buckets[((*key >> 2) ^ (*key >> 12)) % FUTEX_BUCKETS];
+	return 0;
+}
+
+/*
+ * Sleep until woken by futex_wake on UADDR, unless *UADDR is no longer
+ * VAL, in which case fail with EAGAIN at once. The check and going to
+ * sleep are atomic with respect to futex_wake.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct futex_waiter waiter;
+	struct futex_bucket *fb;
+	int result;
+
+	result = futex_lookup(uaddr, &waiter.fw_key, &fb);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&fb->fb_lock);
+
+	/*
+	 * Read the value through the kernel's mapping of the frame;
+	 * we can't copyin while holding a spinlock.
+	 */
+	if (*(volatile int *)PADDR_TO_KVADDR(waiter.fw_key) != val) {
+		spinlock_release(&fb->fb_lock);
+		return EAGAIN;
+	}
+
+	waiter.fw_woken = false;
+	waiter.fw_next = NULL;
+	*fb->fb_tailp = &waiter;
+	fb->fb_tailp = &waiter.fw_next;
+
+	while (!waiter.fw_woken) {
+		wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+	}
+
+	spinlock_release(&fb->fb_lock);
+	return 0;
+}
+
+/*
+ * Wake up to N threads waiting on UADDR, oldest first. Returns the
+ * number woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int n, int *retval)
+{
+	struct futex_waiter **wp, *w;
+	struct futex_bucket *fb;
+	paddr_t key;
+	int result, woken;
+
+	result = futex_lookup(uaddr, &key, &fb);
+	if (result) {
+		return result;
+	}
+
+	woken = 0;
+	spinlock_acquire(&fb->fb_lock);
+	wp = &fb->fb_head;
+	while (woken < n && (w = *wp) != NULL) {
+		if (w->fw_key != key) {
+			wp = &w->fw_next;
+			continue;
+		}
+		*wp = w->fw_next;
+		if (fb->fb_tailp == &w->fw_next) {
+			fb->fb_tailp = wp;
+		}
+		w->fw_woken = true;
+		woken++;
+	}
+	if (woken > 0) {
+		wchan_wakeall(fb->fb_wchan, &fb->fb_lock);
+	}
+	spinlock_release(&fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
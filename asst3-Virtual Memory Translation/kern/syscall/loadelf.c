@@ -54,6 +54,7 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
+#include <synch.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
@@ -146,21 +147,196 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
+ * What load_elf needs to know about an executable: the entry point
+ * and the loadable segments. Ordinarily there will be one code
+ * segment, one read-only data segment, and one data/bss segment, so
+ * we don't bother with files that have more than ELF_MAXSEGS.
+ */
+#define ELF_MAXSEGS	8
+
+struct elfseg {
+	off_t es_offset;	/* where it is in the file */
+	vaddr_t es_vaddr;	/* where it goes in memory */
+	size_t es_memsize;
+	size_t es_filesize;
+	uint32_t es_flags;	/* PF_R, PF_W, PF_X */
+};
+
+struct elfimage {
+	struct vnode *ei_vnode;		/* the file; the cache holds a ref */
+	unsigned ei_writegen;		/* its vn_writegen when read */
+	unsigned ei_lastuse;		/* for replacing the oldest */
+	vaddr_t ei_entry;		/* entry point */
+	unsigned ei_nsegs;
+	struct elfseg ei_segs[ELF_MAXSEGS];
+};
+
+/*
+ * Executable image cache.
  *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * The shell and test drivers exec the same few programs over and
+ * over, so keep the elfimage for the last few loaded, and skip reading
+ * and checking the headers when the same file is loaded again. The
+ * segments themselves are still read from the file every time.
+ *
+ * Entries are found by vnode. Each one holds a reference to its
+ * vnode, so the vnode can't be recycled for some other file while the
+ * entry exists (and a removed program stays on disk until its entry
+ * is replaced or loadelf_flush is called). An entry is stale if the
+ * file has been written or truncated since it was read, or is being
+ * written now, which vnode_unchanged tells us; stale entries are
+ * replaced the next time the file is loaded. Headers read while a
+ * write was in progress aren't cached at all.
+ *
+ * The cache is small, so it's searched linearly, and the least
+ * recently used entry is replaced when it's full.
+ */
+#define ELFCACHE_SIZE	16
+
+static struct elfimage elfcache[ELFCACHE_SIZE];
+static unsigned elfcache_clock;
+static struct lock *elfcache_lock;
+
+/*
+ * Set up the cache.
+ */
+void
+loadelf_bootstrap(void)
+{
+	elfcache_lock = lock_create("elfcache");
+	if (elfcache_lock == NULL) {
+		panic("Cannot create executable image cache lock\n");
+	}
+}
+
+/*
+ * Look for V in the cache. If it's there and current, copy it to IMG
+ * and return true.
+ */
+static
+bool
+elfcache_lookup(struct vnode *v, struct elfimage *img)
+{
+	struct elfimage *ei;
+	bool found = false;
+	unsigned i;
+
+	lock_acquire(elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		ei = &elfcache[i];
+		if (ei->ei_vnode != v) {
+			continue;
+		}
+		if (vnode_unchanged(v, ei->ei_writegen)) {
+			ei->ei_lastuse = ++elfcache_clock;
+			*img = *ei;
+			found = true;
+		}
+		break;
+	}
+	lock_release(elfcache_lock);
+	return found;
+}
+
+/*
+ * Remember IMG, just read from V. Replaces a stale entry for V if
+ * there is one, otherwise an empty one, otherwise the oldest one.
+ * Does nothing if V was written while IMG was being read, since then
+ * IMG may not match what's in the file.
+ */
+static
+void
+elfcache_insert(struct vnode *v, const struct elfimage *img)
+{
+	struct elfimage *ei, *victim = NULL;
+	struct vnode *oldv = NULL;
+	unsigned i;
+
+	lock_acquire(elfcache_lock);
+	if (!vnode_unchanged(v, img->ei_writegen)) {
+		lock_release(elfcache_lock);
+		return;
+	}
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i].ei_vnode == v) {
+			victim = &elfcache[i];
+			break;
+		}
+	}
+	if (victim == NULL) {
+		victim = &elfcache[0];
+		for (i=1; i<ELFCACHE_SIZE && victim->ei_vnode != NULL; i++) {
+			ei = &elfcache[i];
+			if (ei->ei_vnode == NULL ||
+			    ei->ei_lastuse < victim->ei_lastuse) {
+				victim = ei;
+			}
+		}
+	}
+
+	if (victim->ei_vnode != v) {
+		oldv = victim->ei_vnode;
+		VOP_INCREF(v);
+	}
+	*victim = *img;
+	victim->ei_vnode = v;
+	victim->ei_lastuse = ++elfcache_clock;
+	lock_release(elfcache_lock);
+
+	/* This may reclaim the vnode, so do it without the lock. */
+	if (oldv != NULL) {
+		VOP_DECREF(oldv);
+	}
+}
+
+/*
+ * Empty the cache, dropping its vnode references. Used before
+ * unmounting, which fails if any of the filesystem's vnodes are in
+ * use.
+ */
+void
+loadelf_flush(void)
+{
+	struct vnode *vs[ELFCACHE_SIZE];
+	unsigned i;
+
+	if (elfcache_lock == NULL) {
+		/* not booted that far */
+		return;
+	}
+
+	lock_acquire(elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		vs[i] = elfcache[i].ei_vnode;
+		elfcache[i].ei_vnode = NULL;
+	}
+	lock_release(elfcache_lock);
+
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (vs[i] != NULL) {
+			VOP_DECREF(vs[i]);
+		}
+	}
+}
+
+/*
+ * Read the headers of the executable V into IMG, checking that it's
+ * something we can run.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elf_readimage(struct vnode *v, struct elfimage *img)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
 	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
+	struct elfseg *es;
 
-	as = proc_getas();
+	/* Before reading anything, so a write while we read shows */
+	img->ei_writegen = vnode_writegen(v);
+	img->ei_nsegs = 0;
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -203,12 +379,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	}
 
 	/*
-	 * Go through the list of segments and set up the address space.
-	 *
-	 * Ordinarily there will be one code segment, one read-only
-	 * data segment, and one data/bss segment, but there might
-	 * conceivably be more. You don't need to support such files
-	 * if it's unduly awkward to do so.
+	 * Go through the list of segments and collect the ones to load.
 	 *
 	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is
 	 * mandated by the ELF standard - we use sizeof(ph) to load,
@@ -243,11 +414,58 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
+		if (img->ei_nsegs == ELF_MAXSEGS) {
+			kprintf("loadelf: more than %d segments\n",
+				ELF_MAXSEGS);
+			return ENOEXEC;
+		}
+		es = &img->ei_segs[img->ei_nsegs++];
+		es->es_offset = ph.p_offset;
+		es->es_vaddr = ph.p_vaddr;
+		es->es_memsize = ph.p_memsz;
+		es->es_filesize = ph.p_filesz;
+		es->es_flags = ph.p_flags;
+	}
+
+	img->ei_entry = eh.e_entry;
+	return 0;
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct elfimage img;
+	struct elfseg *es;
+	struct addrspace *as;
+	unsigned i;
+	int result;
+
+	as = proc_getas();
+
+	if (!elfcache_lookup(v, &img)) {
+		result = elf_readimage(v, &img);
+		if (result) {
+			return result;
+		}
+		elfcache_insert(v, &img);
+	}
+
+	/*
+	 * Set up the address space.
+	 */
+
+	for (i=0; i<img.ei_nsegs; i++) {
+		es = &img.ei_segs[i];
 		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+					  es->es_vaddr, es->es_memsize,
+					  es->es_flags & PF_R,
+					  es->es_flags & PF_W,
+					  es->es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -262,35 +480,11 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * Now actually load each segment.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
-		if (result) {
-			return result;
-		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
-		}
-
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+	for (i=0; i<img.ei_nsegs; i++) {
+		es = &img.ei_segs[i];
+		result = load_segment(as, v, es->es_offset, es->es_vaddr,
+				      es->es_memsize, es->es_filesize,
+				      es->es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -301,7 +495,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
-	*entrypoint = eh.e_entry;
+	*entrypoint = img.ei_entry;
 
 	return 0;
 }
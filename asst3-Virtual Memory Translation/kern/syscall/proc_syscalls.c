@@ -40,6 +40,7 @@
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
+#include <synch.h>
 #include <copyinout.h>
 #include <pid.h>
 #include <syscall.h>
@@ -137,6 +138,64 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_vfork
+ *
+ * Like fork, but the child runs in our address space instead of a
+ * copy of it, and we sleep until the child is done with it (by
+ * execing or exiting). This saves copying the whole address space
+ * just to throw it away again in execv.
+ *
+ * The child is running on our user stack, so anything it does other
+ * than exec or _exit may mess us up; that's the vfork contract. (It
+ * also still sees our pid in the user info page, so getpid() in the
+ * child gives the wrong answer until it execs.)
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+	struct trapframe *ntf;
+	struct semaphore *done;
+	int result;
+	struct proc *newproc;
+
+	done = sem_create("vfork", 0);
+	if (done == NULL) {
+		return ENOMEM;
+	}
+
+	ntf = kmalloc(sizeof(struct trapframe));
+	if (ntf==NULL) {
+		sem_destroy(done);
+		return ENOMEM;
+	}
+	*ntf = *tf;
+
+	result = proc_vfork(done, &newproc);
+	if (result) {
+		kfree(ntf);
+		sem_destroy(done);
+		return result;
+	}
+	*retval = newproc->p_pid;
+
+	result = thread_fork(curthread->t_name, newproc,
+			     fork_newthread, ntf, 0);
+	if (result) {
+		/* this Vs done, which is harmless */
+		proc_unfork(newproc);
+		kfree(ntf);
+		sem_destroy(done);
+		return result;
+	}
+
+	/* Wait for the child to give our address space back. */
+	P(done);
+	sem_destroy(done);
+
+	return 0;
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
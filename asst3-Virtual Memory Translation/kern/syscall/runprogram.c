@@ -36,6 +36,7 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
 #include <proc.h>
@@ -47,6 +48,7 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pid.h>
 #include <syscall.h>
 #include <test.h>
 
@@ -54,24 +56,34 @@
  * argv buffer.
  *
  * This is an abstraction that holds an argv while it's being shuffled
- * through the kernel during exec.
+ * through the kernel during exec. The strings are kept in whole pages,
+ * which argbuf_copyout gives to the new address space as the top of
+ * its stack; so the strings are only copied once, on the way in, and
+ * nothing is ever allocated in pieces bigger than a page.
  */
+#define ARGBUF_MAXPAGES		(ARG_MAX / PAGE_SIZE)
+
 struct argbuf {
-	char *data;
+	vaddr_t pages[ARGBUF_MAXPAGES];	/* the strings, back to back */
+	unsigned npages;
 	size_t len;
-	size_t max;
 	int nargs;
 	bool tooksem;
 };
 
 /*
  * Throttle to limit the number of processes in exec at once. Or,
- * rather, the number trying to use large exec buffers at once. See
- * design notes for the rationale.
+ * rather, the number trying to use large exec buffers (more than one
+ * page) at once. See design notes for the rationale.
  */
 #define EXEC_BIGBUF_THROTTLE	1
 static struct semaphore *execthrottle;
 
+/*
+ * Number of argv pointers argbuf_copyout pushes out at a time.
+ */
+#define ARGBUF_PTRBATCH		32
+
 /*
  * Set things up.
  */
@@ -82,6 +94,7 @@ exec_bootstrap(void)
 	if (execthrottle == NULL) {
 		panic("Cannot create exec throttle semaphore\n");
 	}
+	loadelf_bootstrap();
 }
 
 /*
@@ -91,26 +104,29 @@ static
 void
 argbuf_init(struct argbuf *buf)
 {
-	buf->data = NULL;
+	buf->npages = 0;
 	buf->len = 0;
-	buf->max = 0;
 	buf->nargs = 0;
 	buf->tooksem = false;
 }
 
 /*
- * Clean up an argv buffer when done.
+ * Clean up an argv buffer when done. Pages argbuf_copyout has given
+ * away are zero and not ours to free.
  */
 static
 void
 argbuf_cleanup(struct argbuf *buf)
 {
-	if (buf->data != NULL) {
-		kfree(buf->data);
-		buf->data = NULL;
+	unsigned i;
+
+	for (i=0; i<buf->npages; i++) {
+		if (buf->pages[i] != 0) {
+			free_kpages(buf->pages[i]);
+		}
 	}
+	buf->npages = 0;
 	buf->len = 0;
-	buf->max = 0;
 	buf->nargs = 0;
 	if (buf->tooksem) {
 		V(execthrottle);
@@ -119,17 +135,51 @@ argbuf_cleanup(struct argbuf *buf)
 }
 
 /*
- * Allocate the memory for an argv buffer.
+ * Find where the next byte of string goes: hands back a pointer to
+ * it and how much room there is after it in the same page. Adds a
+ * page if the last one is full.
  */
 static
 int
-argbuf_allocate(struct argbuf *buf, size_t size)
+argbuf_room(struct argbuf *buf, char **ptr, size_t *room)
 {
-	buf->data = kmalloc(size);
-	if (buf->data == NULL) {
-		return ENOMEM;
+	vaddr_t page;
+	size_t offset;
+
+	if (buf->len == buf->npages * PAGE_SIZE) {
+		if (buf->npages == ARGBUF_MAXPAGES) {
+			return E2BIG;
+		}
+		if (buf->npages > 0 && !buf->tooksem) {
+			/* Wait on the semaphore, to throttle big buffers */
+			P(execthrottle);
+			buf->tooksem = true;
+		}
+		page = alloc_kpages(1);
+		if (page == 0) {
+			return ENOMEM;
+		}
+		buf->pages[buf->npages++] = page;
+	}
+
+	offset = buf->len % PAGE_SIZE;
+	*ptr = (char *)buf->pages[buf->len / PAGE_SIZE] + offset;
+	*room = PAGE_SIZE - offset;
+	return 0;
+}
+
+/*
+ * Finish off an argument: count it, and make sure the strings plus
+ * the argv pointers (including the ending NULL) are within ARG_MAX.
+ */
+static
+int
+argbuf_endarg(struct argbuf *buf)
+{
+	buf->nargs++;
+	if (buf->len + (buf->nargs + 1) * sizeof(userptr_t) > ARG_MAX) {
+		return E2BIG;
 	}
-	buf->max = size;
 	return 0;
 }
 
@@ -143,20 +193,26 @@ static
 int
 argbuf_fromkernel(struct argbuf *buf, const char *progname)
 {
-	size_t len;
+	size_t len, room;
+	char *dest;
 	int result;
 
 	len = strlen(progname) + 1;
-
-	result = argbuf_allocate(buf, len);
-	if (result) {
-		return result;
+	while (len > 0) {
+		result = argbuf_room(buf, &dest, &room);
+		if (result) {
+			return result;
+		}
+		if (room > len) {
+			room = len;
+		}
+		memcpy(dest, progname, room);
+		progname += room;
+		len -= room;
+		buf->len += room;
 	}
-	strcpy(buf->data, progname);
-	buf->len = len;
-	buf->nargs = 1;
 
-	return 0;
+	return argbuf_endarg(buf);
 }
 
 /*
@@ -164,14 +220,14 @@ argbuf_fromkernel(struct argbuf *buf, const char *progname)
  */
 static
 int
-argbuf_copyin(struct argbuf *buf, userptr_t uargv)
+argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
 {
 	userptr_t thisarg;
-	size_t thisarglen;
+	size_t thisarglen, room;
+	char *dest;
 	int result;
 
 	/* loop through the argv, grabbing each arg string */
-	buf->nargs = 0;
 	while (1) {
 		/*
 		 * First, grab the pointer at argv.
@@ -187,133 +243,143 @@ argbuf_copyin(struct argbuf *buf, userptr_t uargv)
 			break;
 		}
 
-		/* Use the pointer to fetch the argument string. */
-		result = copyinstr(thisarg, buf->data + buf->len,
-				   buf->max - buf->len, &thisarglen);
-		if (result == ENAMETOOLONG) {
-			return E2BIG;
+		/*
+		 * Use the pointer to fetch the argument string, a page
+		 * at a time. If it doesn't end in this page, copyinstr
+		 * fills the page; carry on in the next one.
+		 */
+		while (1) {
+			result = argbuf_room(buf, &dest, &room);
+			if (result) {
+				return result;
+			}
+			result = copyinstr(thisarg, dest, room, &thisarglen);
+			if (result == ENAMETOOLONG) {
+				buf->len += room;
+				thisarg += room;
+				continue;
+			}
+			else if (result) {
+				return result;
+			}
+			/* Note: thisarglen includes the \0. */
+			buf->len += thisarglen;
+			break;
 		}
-		else if (result) {
+
+		/* Move ahead. */
+		result = argbuf_endarg(buf);
+		if (result) {
 			return result;
 		}
-
-		/* Move ahead. Note: thisarglen includes the \0. */
-		buf->len += thisarglen;
 		uargv += sizeof(userptr_t);
-		buf->nargs++;
 	}
 
 	return 0;
 }
 
 /*
- * Get an argv from user space.
+ * Find the start of the argument after the one at POS.
  */
 static
-int
-argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
+size_t
+argbuf_nextarg(struct argbuf *buf, size_t pos)
 {
-	int result;
+	const char *page;
 
-	/* try with a small buffer */
-	result = argbuf_allocate(buf, PAGE_SIZE);
-	if (result) {
-		return result;
-	}
-
-	/* do the copyin */
-	result = argbuf_copyin(buf, uargv);
-	if (result == E2BIG) {
-		/*
-		 * Try again with the full-size buffer. Just start
-		 * over instead of trying to keep the page we already
-		 * did; this is a bit inefficient but it's not that
-		 * important.
-		 */
-		argbuf_cleanup(buf);
-		argbuf_init(buf);
-
-		/* Wait on the semaphore, to throttle this allocation */
-		P(execthrottle);
-		buf->tooksem = true;
-
-		result = argbuf_allocate(buf, ARG_MAX);
-		if (result) {
-			return result;
+	while (1) {
+		page = (const char *)buf->pages[pos / PAGE_SIZE];
+		if (page[pos % PAGE_SIZE] == 0) {
+			return pos + 1;
 		}
-
-		result = argbuf_copyin(buf, uargv);
+		pos++;
 	}
-	return result;
 }
 
 /*
- * Copy an argv out of kernel space to user space.
+ * Move an argv out of kernel space to user space. The pages holding
+ * the strings become the top of the user stack, so only the argv
+ * pointers need copying. After this the buffer no longer holds any
+ * pages, but still needs argbuf_cleanup.
  *
- * Note: ustackp is an in/out argument.
+ * Note: ustackp is an in/out argument, and must be page-aligned (as
+ * as_define_stack hands back).
  */
 static
 int
 argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
 	       int *argc_ret, userptr_t *uargv_ret)
 {
-	vaddr_t ustack;
-	userptr_t ustringbase, uargvbase, uargv_i;
-	userptr_t thisarg;
-	size_t thisarglen;
-	size_t pos;
+	struct addrspace *as;
+	vaddr_t ustack, ustringbase;
+	userptr_t uargvbase, uargv_i;
+	userptr_t ptrs[ARGBUF_PTRBATCH];
+	size_t pos, tail;
+	unsigned i, n;
+	int arg;
 	int result;
 
+	as = proc_getas();
+
 	/* Begin the stack at the passed in top. */
 	ustack = *ustackp;
+	KASSERT((ustack & PAGE_FRAME) == ustack);
 
 	/*
 	 * Allocate space.
 	 *
-	 * buf->pos is the amount of space used by the strings; put that
-	 * first, then align the stack, then make space for the argv
-	 * pointers. Allow an extra slot for the ending NULL.
+	 * The string pages go first, then the argv pointers, with an
+	 * extra slot for the ending NULL.
 	 */
 
-	ustack -= buf->len;
-	ustack -= (ustack & (sizeof(void *) - 1));
-	ustringbase = (userptr_t)ustack;
+	ustack -= buf->npages * PAGE_SIZE;
+	ustringbase = ustack;
 
 	ustack -= (buf->nargs + 1) * sizeof(userptr_t);
 	uargvbase = (userptr_t)ustack;
 
-	/* Now copy the data out. */
+	/* Push out the argv pointers, a batch at a time. */
 	pos = 0;
+	n = 0;
 	uargv_i = uargvbase;
-	while (pos < buf->len) {
-		/* The user address of the string will be ustringbase + pos. */
-		thisarg = ustringbase + pos;
-
-		/* Place it in the argv array. */
-		result = copyout(&thisarg, uargv_i, sizeof(thisarg));
-		if (result) {
-			return result;
+	for (arg = 0; arg <= buf->nargs; arg++) {
+		if (arg < buf->nargs) {
+			/* The user address of the string is ustringbase + pos */
+			ptrs[n++] = (userptr_t)(ustringbase + pos);
+			pos = argbuf_nextarg(buf, pos);
 		}
-
-		/* Push out the string. */
-		result = copyoutstr(buf->data + pos, thisarg,
-				    buf->len - pos, &thisarglen);
-		if (result) {
-			return result;
+		else {
+			/* Add the NULL. */
+			ptrs[n++] = NULL;
+		}
+		if (n == ARGBUF_PTRBATCH || arg == buf->nargs) {
+			result = copyout(ptrs, uargv_i, n * sizeof(userptr_t));
+			if (result) {
+				return result;
+			}
+			uargv_i += n * sizeof(userptr_t);
+			n = 0;
 		}
-
-		/* thisarglen includes the \0 */
-		pos += thisarglen;
-		uargv_i += sizeof(thisarg);
 	}
 	/* Should have come out even... */
 	KASSERT(pos == buf->len);
 
-	/* Add the NULL. */
-	thisarg = NULL;
-	result = copyout(&thisarg, uargv_i, sizeof(userptr_t));
-	if (result) {
-		return result;
+	/* Don't leak whatever the last page held before. */
+	tail = buf->len % PAGE_SIZE;
+	if (tail != 0) {
+		bzero((char *)buf->pages[buf->npages - 1] + tail,
+		      PAGE_SIZE - tail);
+	}
+
+	/* Now hand over the strings. */
+	for (i=0; i<buf->npages; i++) {
+		result = as_placepage(as, ustringbase + i * PAGE_SIZE,
+				      buf->pages[i]);
+		if (result) {
+			return result;
+		}
+		/* the address space owns it now */
+		buf->pages[i] = 0;
 	}
 
 	*ustackp = ustack;
@@ -354,6 +420,7 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		kfree(newname);
 		return ENOMEM;
 	}
+	as_setpid(newvm, curproc->p_pid);
 
 	/* replace address spaces, and activate the new one */
 	oldvm = proc_setas(newvm);
@@ -391,7 +458,11 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 	 * Note: once this is done, execv() must not fail, because there's
 	 * nothing left for it to return an error to.
 	 */
-	if (oldvm) {
+	if (curproc->p_vforksem != NULL) {
+		/* oldvm belongs to our parent (see sys_vfork); give it back */
+		proc_vforkdone(curproc);
+	}
+	else if (oldvm) {
 		as_destroy(oldvm);
 	}
 
@@ -431,7 +502,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
@@ -611,3 +686,135 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	panic("enter_new_process returned\n");
 	return EINVAL;
 }
+
+/*
+ * Handoff between sys___spawn and the new process's first thread.
+ * Lives on the parent's stack; the child must not touch it after
+ * V'ing si_done.
+ */
+struct spawninfo {
+	char *si_path;			/* program to run */
+	struct argbuf *si_args;		/* its argv */
+	struct semaphore *si_done;	/* child is done with the above */
+	int si_result;			/* whether the load worked */
+};
+
+/*
+ * First thread of a spawned process: load the program and go.
+ */
+static
+void
+spawn_newthread(void *vsi, unsigned long junk)
+{
+	struct spawninfo *si = vsi;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv = NULL;
+	int argc = 0;
+	int result;
+
+	(void)junk;
+
+	result = loadexec(si->si_path, &entrypoint, &stackptr);
+	if (result == 0) {
+		result = argbuf_copyout(si->si_args, &stackptr,
+					&argc, &uargv);
+		if (result) {
+			/* If copyout fails, *we* messed up, so panic */
+			panic("spawn: copyout_args failed: %s\n",
+			      strerror(result));
+		}
+	}
+	si->si_result = result;
+	V(si->si_done);
+
+	if (result) {
+		/* the parent will collect us and report RESULT */
+		proc_exit(_MKWAIT_EXIT(127));
+	}
+
+	/* Warp to user mode. */
+	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+}
+
+/*
+ * __spawn: start a new process running PROG with argument vector
+ * UARGV, and return its pid. It gets copies of our file handles and
+ * our current directory, just as if we had forked and the child had
+ * called execv, but we never make a copy of our address space.
+ *
+ * The new process does the load itself, so it happens in the right
+ * process, but we wait for it so that we can report the error if the
+ * load fails. (In that case the process has exited and we collect it
+ * here, so the caller never sees its pid.)
+ */
+int
+sys___spawn(userptr_t prog, userptr_t uargv, pid_t *retval)
+{
+	struct spawninfo si;
+	struct argbuf kargv;
+	struct proc *newproc;
+	pid_t pid;
+	int result;
+
+	si.si_path = kmalloc(PATH_MAX);
+	if (si.si_path == NULL) {
+		return ENOMEM;
+	}
+
+	/* Get the filename. */
+	result = copyinstr(prog, si.si_path, PATH_MAX, NULL);
+	if (result) {
+		kfree(si.si_path);
+		return result;
+	}
+
+	/* get the argv strings. */
+	argbuf_init(&kargv);
+	result = argbuf_fromuser(&kargv, uargv);
+	if (result) {
+		argbuf_cleanup(&kargv);
+		kfree(si.si_path);
+		return result;
+	}
+
+	si.si_args = &kargv;
+	si.si_done = sem_create("spawn", 0);
+	if (si.si_done == NULL) {
+		argbuf_cleanup(&kargv);
+		kfree(si.si_path);
+		return ENOMEM;
+	}
+	si.si_result = 0;
+
+	result = proc_spawn(&newproc);
+	if (result) {
+		goto out;
+	}
+	pid = newproc->p_pid;
+
+	result = thread_fork(curthread->t_name, newproc,
+			     spawn_newthread, &si, 0);
+	if (result) {
+		proc_unfork(newproc);
+		goto out;
+	}
+
+	/* Wait for the child to load, and then reap it if that failed. */
+	P(si.si_done);
+	result = si.si_result;
+	if (result) {
+		pid_wait(pid, NULL, 0, NULL);
+	}
+	else {
+		*retval = pid;
+	}
+
+ out:
+	sem_destroy(si.si_done);
+	argbuf_cleanup(&kargv);
+	kfree(si.si_path);
+	return result;
+}
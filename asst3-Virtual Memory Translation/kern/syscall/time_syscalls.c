@@ -28,6 +28,8 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -56,3 +58,35 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the requested interval. Sleeps aren't interrupted in
+ * OS/161, so if REM is given it always comes back zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec ts;
+	int result;
+
+	result = copyin(user_req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	clock_nsleep((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+
+	if (user_rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, user_rem, sizeof(ts));
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
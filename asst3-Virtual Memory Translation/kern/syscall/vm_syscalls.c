@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <addrspace.h>
+#include <proc.h>
+#include <syscall.h>
+
+/* Protection bits; these match PROT_READ and PROT_WRITE in <unistd.h>. */
+#define MMAP_PROT_READ	1
+#define MMAP_PROT_WRITE	2
+
+/*
+ * mmap, UNSW style: mmap(length, prot, fd, offset).
+ *
+ * Only anonymous mappings (FD == -1, OFFSET == 0) are supported. They
+ * are zero-filled and shared with any children forked afterwards,
+ * which is what lets processes put semaphores and the like in memory
+ * they all see (see futex_wait). Mapping files is not implemented.
+ */
+int
+sys_mmap(size_t length, int prot, int fd, off_t offset, int *retval)
+{
+	vaddr_t addr;
+	int result;
+
+	if (fd != -1) {
+		return ENOSYS;
+	}
+	if (offset != 0 || length == 0) {
+		return EINVAL;
+	}
+	if (prot & ~(MMAP_PROT_READ | MMAP_PROT_WRITE)) {
+		return EINVAL;
+	}
+
+	result = as_define_shared(proc_getas(), length,
+				  (prot & MMAP_PROT_WRITE) != 0, &addr);
+	if (result) {
+		return result;
+	}
+	*retval = (int)addr;
+	return 0;
+}
@@ -89,6 +89,34 @@ bitmaptest(int nargs, char **args)
 		}
 	}
 
+	/* findnext should visit exactly the set bits, in order */
+	i = 0;
+	while (bitmap_findnext(b, i, &x)==0) {
+		KASSERT(x < TESTSIZE);
+		for (; i < (int)x; i++) {
+			KASSERT(data[i]==1);
+		}
+		KASSERT(data[x]==0);
+		i = x + 1;
+	}
+	for (; i<TESTSIZE; i++) {
+		KASSERT(data[i]==1);
+	}
+
+	/* and findclear the clear ones */
+	i = 0;
+	while (bitmap_findclear(b, i, &x)==0) {
+		KASSERT(x < TESTSIZE);
+		for (; i < (int)x; i++) {
+			KASSERT(data[i]==0);
+		}
+		KASSERT(data[x]==1);
+		i = x + 1;
+	}
+	for (; i<TESTSIZE; i++) {
+		KASSERT(data[i]==0);
+	}
+
 	while (bitmap_alloc(b, &x)==0) {
 		KASSERT(x < TESTSIZE);
 		KASSERT(bitmap_isset(b, x));
@@ -400,3 +400,688 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Contended lock benchmark.
+ *
+ * NBENCHTHREADS threads each take the lock NBENCHLOOPS times around a
+ * tiny critical section, the way counter_increment() does, with a
+ * little work outside the lock. We do this once with the lock
+ * adaptive and once with it forced to always sleep, and print the
+ * average time per acquire for each. With more than one cpu, the
+ * adaptive run should be noticeably faster.
+ */
+
+#define NBENCHTHREADS	8
+#define NBENCHLOOPS	2000
+#define NBENCHWORK	50
+
+static struct lock *benchlock;
+static volatile unsigned long benchcount;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	unsigned i;
+	volatile unsigned j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NBENCHLOOPS; i++) {
+		lock_acquire(benchlock);
+		benchcount++;
+		lock_release(benchlock);
+		for (j=0; j<NBENCHWORK; j++);
+	}
+	V(donesem);
+}
+
+static
+void
+lockbenchrun(bool adaptive)
+{
+	struct timespec before, after;
+	uint64_t nsecs;
+	unsigned long total;
+	int i, result;
+
+	lock_set_adaptive(benchlock, adaptive);
+	benchcount = 0;
+
+	gettime(&before);
+	for (i=0; i<NBENCHTHREADS; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NBENCHTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+
+	total = NBENCHTHREADS * NBENCHLOOPS;
+	if (benchcount != total) {
+		kprintf("lockbench: count is %lu, should be %lu\n",
+			benchcount, total);
+		kprintf("Test failed\n");
+	}
+
+	timespec_sub(&after, &before, &after);
+	nsecs = after.tv_sec * 1000000000ULL + after.tv_nsec;
+	kprintf("%s: %lu acquires in %llu.%09lu seconds, %llu ns each\n",
+		adaptive ? "adaptive" : "blocking", total,
+		(unsigned long long)after.tv_sec,
+		(unsigned long)after.tv_nsec, nsecs / total);
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	benchlock = lock_create("lockbench");
+	if (benchlock == NULL) {
+		panic("lockbench: lock_create failed\n");
+	}
+
+	kprintf("Starting contended lock benchmark...\n");
+	lockbenchrun(false);
+	lockbenchrun(true);
+
+	lock_destroy(benchlock);
+	benchlock = NULL;
+
+	kprintf("Contended lock benchmark done.\n");
+	return 0;
+}
+
+/*
+ * Lock fairness benchmark.
+ *
+ * NFAIRTHREADS threads take the lock over and over, doing a little
+ * work inside and outside it, until FAIRNSECS have passed. We count
+ * each thread's acquires and print the total, the fewest and most any
+ * one thread got, and Jain's fairness index (times 1000; 1000 means
+ * every thread got the same share, 1000/NFAIRTHREADS means one thread
+ * got everything). This is done once with the usual barging release
+ * and once with direct handoff, which should be much fairer and may
+ * be slower.
+ */
+
+#define NFAIRTHREADS	8
+#define FAIRNSECS	1000000000ULL	/* 1 second */
+
+static volatile bool fairstop;
+static volatile unsigned long faircount[NFAIRTHREADS];
+
+static
+void
+lockfairthread(void *junk, unsigned long num)
+{
+	volatile unsigned j;
+
+	(void)junk;
+
+	while (!fairstop) {
+		lock_acquire(benchlock);
+		faircount[num]++;
+		for (j=0; j<NBENCHWORK; j++);
+		lock_release(benchlock);
+		for (j=0; j<NBENCHWORK; j++);
+	}
+	V(donesem);
+}
+
+static
+void
+lockfairrun(bool handoff)
+{
+	unsigned long total, min, max;
+	uint64_t sumsq;
+	int i, result;
+
+	lock_set_handoff(benchlock, handoff);
+	fairstop = false;
+	for (i=0; i<NFAIRTHREADS; i++) {
+		faircount[i] = 0;
+	}
+
+	for (i=0; i<NFAIRTHREADS; i++) {
+		result = thread_fork("lockfair", NULL, lockfairthread,
+				     NULL, i);
+		if (result) {
+			panic("lockfair: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	clock_nsleep(FAIRNSECS);
+	fairstop = true;
+	for (i=0; i<NFAIRTHREADS; i++) {
+		P(donesem);
+	}
+
+	total = 0;
+	sumsq = 0;
+	min = max = faircount[0];
+	for (i=0; i<NFAIRTHREADS; i++) {
+		total += faircount[i];
+		sumsq += (uint64_t)faircount[i] * faircount[i];
+		if (faircount[i] < min) {
+			min = faircount[i];
+		}
+		if (faircount[i] > max) {
+			max = faircount[i];
+		}
+	}
+
+	kprintf("%s: %lu acquires in %llu ms, per thread min %lu max %lu, "
+		"fairness %llu/1000\n",
+		handoff ? "handoff" : "barging", total, FAIRNSECS / 1000000,
+		min, max,
+		sumsq == 0 ? 0 :
+		(uint64_t)total * total * 1000 / (NFAIRTHREADS * sumsq));
+}
+
+int
+lockfairbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	benchlock = lock_create("lockfair");
+	if (benchlock == NULL) {
+		panic("lockfair: lock_create failed\n");
+	}
+
+	kprintf("Starting lock fairness benchmark...\n");
+	lockfairrun(false);
+	lockfairrun(true);
+
+	lock_destroy(benchlock);
+	benchlock = NULL;
+
+	kprintf("Lock fairness benchmark done.\n");
+	return 0;
+}
+
+/*
+ * CV broadcast benchmark.
+ *
+ * NBCASTTHREADS threads wait on one CV; each round we wake them all,
+ * wait for every one of them to run and come back to wait again, and
+ * repeat NBCASTROUNDS times. We report the average time spent inside
+ * the wakeup call itself and for the whole round. This is done once
+ * with cv_broadcast and once with NBCASTTHREADS cv_signals, which
+ * makes the waiters runnable one at a time.
+ */
+
+#define NBCASTTHREADS	64
+#define NBCASTROUNDS	200
+
+static struct lock *bcastlock;
+static struct cv *bcastcv;
+static struct cv *bcastreadycv;
+static unsigned bcastgen;
+static unsigned bcastready;
+static bool bcaststop;
+
+static
+void
+bcastthread(void *junk, unsigned long num)
+{
+	unsigned gen;
+
+	(void)junk;
+	(void)num;
+
+	lock_acquire(bcastlock);
+	gen = bcastgen;
+	while (!bcaststop) {
+		bcastready++;
+		if (bcastready == NBCASTTHREADS) {
+			cv_signal(bcastreadycv, bcastlock);
+		}
+		while (bcastgen == gen) {
+			cv_wait(bcastcv, bcastlock);
+		}
+		gen = bcastgen;
+	}
+	lock_release(bcastlock);
+	V(donesem);
+}
+
+/*
+ * Wait until every thread is waiting on bcastcv, then wake them all,
+ * telling them to exit if STOP.
+ */
+static
+void
+bcastwake(bool broadcast, bool stop, uint64_t *wakensecs)
+{
+	struct timespec before, after;
+	unsigned i;
+
+	lock_acquire(bcastlock);
+	while (bcastready < NBCASTTHREADS) {
+		cv_wait(bcastreadycv, bcastlock);
+	}
+	bcastready = 0;
+	bcaststop = stop;
+	bcastgen++;
+
+	gettime(&before);
+	if (broadcast) {
+		cv_broadcast(bcastcv, bcastlock);
+	}
+	else {
+		for (i=0; i<NBCASTTHREADS; i++) {
+			cv_signal(bcastcv, bcastlock);
+		}
+	}
+	gettime(&after);
+	lock_release(bcastlock);
+
+	timespec_sub(&after, &before, &after);
+	*wakensecs += after.tv_sec * 1000000000ULL + after.tv_nsec;
+}
+
+static
+void
+bcastrun(bool broadcast)
+{
+	struct timespec before, after;
+	uint64_t wakensecs, stopnsecs, nsecs;
+	unsigned i;
+	int result;
+
+	bcastgen = 0;
+	bcastready = 0;
+	bcaststop = false;
+	for (i=0; i<NBCASTTHREADS; i++) {
+		result = thread_fork("bcast", NULL, bcastthread, NULL, i);
+		if (result) {
+			panic("bcast: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	wakensecs = 0;
+	gettime(&before);
+	for (i=0; i<NBCASTROUNDS; i++) {
+		bcastwake(broadcast, false, &wakensecs);
+	}
+	gettime(&after);
+
+	/* One more round, whose time we don't count, to stop them. */
+	stopnsecs = 0;
+	bcastwake(broadcast, true, &stopnsecs);
+	for (i=0; i<NBCASTTHREADS; i++) {
+		P(donesem);
+	}
+
+	timespec_sub(&after, &before, &after);
+	nsecs = after.tv_sec * 1000000000ULL + after.tv_nsec;
+	kprintf("%s: %u waiters, %u rounds: wakeup %llu ns, "
+		"round %llu ns\n",
+		broadcast ? "cv_broadcast" : "cv_signal x N",
+		NBCASTTHREADS, NBCASTROUNDS,
+		wakensecs / NBCASTROUNDS, nsecs / NBCASTROUNDS);
+}
+
+int
+cvbcastbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	bcastlock = lock_create("bcast");
+	bcastcv = cv_create("bcast");
+	bcastreadycv = cv_create("bcastready");
+	if (bcastlock == NULL || bcastcv == NULL || bcastreadycv == NULL) {
+		panic("bcast: out of memory\n");
+	}
+
+	kprintf("Starting CV broadcast benchmark...\n");
+	bcastrun(true);
+	bcastrun(false);
+
+	cv_destroy(bcastreadycv);
+	cv_destroy(bcastcv);
+	lock_destroy(bcastlock);
+	bcastreadycv = bcastcv = NULL;
+	bcastlock = NULL;
+
+	kprintf("CV broadcast benchmark done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Reader-writer lock tests.
+ *
+ * rwtest runs a mix of readers and writers. Writers change testval1
+ * and testval2 together, yielding in between, and readers check they
+ * always see the pair consistent. We also count who is inside the
+ * lock and complain about any reader overlapping a writer or two
+ * writers overlapping.
+ */
+
+#define NRWLOOPS	60
+
+static struct rwlock *testrw;
+static struct spinlock rwinside_lock = SPINLOCK_INITIALIZER;
+static unsigned rwreaders_inside;
+static unsigned rwwriters_inside;
+static volatile bool rwfailed;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: %s\n", num, msg);
+	rwfailed = true;
+}
+
+static
+void
+rwreader(unsigned long num)
+{
+	rwlock_acquire_read(testrw);
+
+	spinlock_acquire(&rwinside_lock);
+	rwreaders_inside++;
+	if (rwwriters_inside != 0) {
+		rwfail(num, "reader got in with a writer");
+	}
+	spinlock_release(&rwinside_lock);
+
+	if (testval2 != testval1*testval1) {
+		rwfail(num, "reader saw testval1/testval2 mismatch");
+	}
+	thread_yield();
+	if (testval2 != testval1*testval1) {
+		rwfail(num, "testval1/testval2 changed under a reader");
+	}
+
+	spinlock_acquire(&rwinside_lock);
+	rwreaders_inside--;
+	spinlock_release(&rwinside_lock);
+
+	rwlock_release_read(testrw);
+}
+
+static
+void
+rwwriter(unsigned long num)
+{
+	rwlock_acquire_write(testrw);
+
+	spinlock_acquire(&rwinside_lock);
+	rwwriters_inside++;
+	if (rwwriters_inside != 1 || rwreaders_inside != 0) {
+		rwfail(num, "writer got in with someone else");
+	}
+	spinlock_release(&rwinside_lock);
+
+	testval1 = num;
+	thread_yield();
+	testval2 = num*num;
+
+	spinlock_acquire(&rwinside_lock);
+	rwwriters_inside--;
+	spinlock_release(&rwinside_lock);
+
+	rwlock_release_write(testrw);
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		/* One thread in four is a writer. */
+		if (num % 4 == 0) {
+			rwwriter(num);
+		}
+		else {
+			rwreader(num);
+		}
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	testval1 = testval2 = 0;
+	rwfailed = false;
+
+	kprintf("Starting rwlock test...\n");
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+
+	kprintf("rwlock test %s\n", rwfailed ? "FAILED" : "done.");
+	return 0;
+}
+
+/*
+ * Check writer preference: with the lock held for reading and a
+ * writer waiting, a new reader must wait, and must get in only after
+ * the writer.
+ */
+
+static char rworder[3];
+static volatile unsigned rworderpos;
+
+static
+void
+rwprefwriter(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	rwlock_acquire_write(testrw);
+	rworder[rworderpos++] = 'W';
+	rwlock_release_write(testrw);
+	V(donesem);
+}
+
+static
+void
+rwprefreader(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	rwlock_acquire_read(testrw);
+	rworder[rworderpos++] = 'R';
+	rwlock_release_read(testrw);
+	V(donesem);
+}
+
+int
+rwtest2(int nargs, char **args)
+{
+	int result;
+	bool ok;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest2: rwlock_create failed\n");
+	}
+	rworderpos = 0;
+
+	kprintf("Starting rwlock writer preference test...\n");
+
+	rwlock_acquire_read(testrw);
+
+	result = thread_fork("rwtest2", NULL, rwprefwriter, NULL, 0);
+	if (result) {
+		panic("rwtest2: thread_fork failed: %s\n", strerror(result));
+	}
+	/* Wait for the writer to queue up. (Peeking is ok in a test.) */
+	while (testrw->rw_waitingwriters == 0) {
+		thread_yield();
+	}
+
+	result = thread_fork("rwtest2", NULL, rwprefreader, NULL, 0);
+	if (result) {
+		panic("rwtest2: thread_fork failed: %s\n", strerror(result));
+	}
+	/* Give the reader plenty of time to (wrongly) get in. */
+	clock_nsleep(50000000);
+	ok = (rworderpos == 0);
+
+	rwlock_release_read(testrw);
+	P(donesem);
+	P(donesem);
+
+	ok = ok && rworderpos == 2 && rworder[0] == 'W' && rworder[1] == 'R';
+	rwlock_destroy(testrw);
+	testrw = NULL;
+
+	kprintf("rwlock writer preference test %s\n", ok ? "done." : "FAILED");
+	return 0;
+}
+
+/*
+ * Multi-reader throughput benchmark. NBENCHTHREADS threads do nothing
+ * but take the lock for reading around a short read-only critical
+ * section, once with a rwlock and once with a plain lock, and we print
+ * the average time per acquire for each.
+ */
+
+#define NRWBENCHWORK	200
+
+static struct lock *rwbenchlock;
+
+static
+void
+rwbenchthread(void *junk, unsigned long num)
+{
+	unsigned i;
+	volatile unsigned j;
+	unsigned long sum;
+
+	(void)junk;
+
+	sum = 0;
+	for (i=0; i<NBENCHLOOPS; i++) {
+		if (num) {
+			rwlock_acquire_read(testrw);
+		}
+		else {
+			lock_acquire(rwbenchlock);
+		}
+		for (j=0; j<NRWBENCHWORK; j++) {
+			sum += testval1;
+		}
+		if (num) {
+			rwlock_release_read(testrw);
+		}
+		else {
+			lock_release(rwbenchlock);
+		}
+	}
+	(void)sum;
+	V(donesem);
+}
+
+static
+void
+rwbenchrun(bool userw)
+{
+	struct timespec before, after;
+	uint64_t nsecs;
+	unsigned long total;
+	int i, result;
+
+	gettime(&before);
+	for (i=0; i<NBENCHTHREADS; i++) {
+		result = thread_fork("rwbench", NULL, rwbenchthread,
+				     NULL, userw);
+		if (result) {
+			panic("rwbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NBENCHTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+
+	total = NBENCHTHREADS * NBENCHLOOPS;
+	timespec_sub(&after, &before, &after);
+	nsecs = after.tv_sec * 1000000000ULL + after.tv_nsec;
+	kprintf("%s: %lu reads in %llu.%09lu seconds, %llu ns each\n",
+		userw ? "rwlock" : "lock", total,
+		(unsigned long long)after.tv_sec,
+		(unsigned long)after.tv_nsec, nsecs / total);
+}
+
+int
+rwbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	testrw = rwlock_create("rwbench");
+	rwbenchlock = lock_create("rwbench");
+	if (testrw == NULL || rwbenchlock == NULL) {
+		panic("rwbench: out of memory\n");
+	}
+
+	kprintf("Starting multi-reader benchmark...\n");
+	rwbenchrun(false);
+	rwbenchrun(true);
+
+	lock_destroy(rwbenchlock);
+	rwbenchlock = NULL;
+	rwlock_destroy(testrw);
+	testrw = NULL;
+
+	kprintf("Multi-reader benchmark done.\n");
+	return 0;
+}
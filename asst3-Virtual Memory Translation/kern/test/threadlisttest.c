@@ -309,6 +309,51 @@ threadlisttest_f(void)
 	KASSERT(tl.tl_count == 0);
 }
 
+static
+void
+threadlisttest_g(void)
+{
+	struct threadlist tl, tl2;
+	struct thread *t;
+	unsigned i;
+
+	threadlist_init(&tl);
+	threadlist_init(&tl2);
+
+	/* joining an empty list changes nothing */
+	threadlist_join(&tl, &tl2);
+	KASSERT(tl.tl_count == 0);
+	threadlist_addtail(&tl, fakethreads[0]);
+	threadlist_join(&tl, &tl2);
+	KASSERT(tl.tl_count == 1);
+	check_order(&tl, false);
+
+	/* joining onto an empty list moves everything */
+	threadlist_join(&tl2, &tl);
+	KASSERT(tl.tl_count == 0);
+	KASSERT(threadlist_isempty(&tl));
+	KASSERT(tl2.tl_count == 1);
+	check_order(&tl2, false);
+	check_order(&tl2, true);
+
+	for (i=1; i<NUMNAMES; i++) {
+		threadlist_addtail(&tl, fakethreads[i]);
+	}
+	threadlist_join(&tl2, &tl);
+	KASSERT(tl.tl_count == 0);
+	KASSERT(tl2.tl_count == NUMNAMES);
+	check_order(&tl2, false);
+
+	for (i=0; i<NUMNAMES; i++) {
+		t = threadlist_remtail(&tl2);
+		KASSERT(t == fakethreads[NUMNAMES - i - 1]);
+	}
+	KASSERT(tl2.tl_count == 0);
+
+	threadlist_cleanup(&tl2);
+	threadlist_cleanup(&tl);
+}
+
 ////////////////////////////////////////////////////////////
 // external interface
 
@@ -332,6 +377,7 @@ threadlisttest(int nargs, char **args)
 	threadlisttest_d();
 	threadlisttest_e();
 	threadlisttest_f();
+	threadlisttest_g();
 
 	for (i=0; i<NUMNAMES; i++) {
 		fakethread_destroy(fakethreads[i]);
@@ -31,12 +31,15 @@
  * Thread test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
+#define NBENCHTHREADS  2000
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +147,67 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+static
+void
+emptythread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+/*
+ * Thread create/exit benchmark. Forks threads that exit immediately,
+ * NTHREADS at a time, and reports the average cost of a thread's
+ * whole life. This is dominated by thread_fork, the context switches,
+ * and cleaning up after thread_exit. Takes an optional thread count.
+ */
+int
+threadbench(int nargs, char **args)
+{
+	unsigned long count, i, j, batch;
+	struct timespec before, after;
+	uint64_t nsecs;
+	int result;
+
+	count = NBENCHTHREADS;
+	if (nargs > 1) {
+		count = atoi(args[1]);
+	}
+	if (count == 0) {
+		kprintf("Usage: tt4 [count]\n");
+		return EINVAL;
+	}
+
+	init_sem();
+	kprintf("Starting thread create/exit benchmark (%lu threads)...\n",
+		count);
+
+	gettime(&before);
+	for (i=0; i<count; i+=batch) {
+		batch = count - i < NTHREADS ? count - i : NTHREADS;
+		for (j=0; j<batch; j++) {
+			result = thread_fork("threadbench", NULL,
+					     emptythread, NULL, j);
+			if (result) {
+				panic("threadbench: thread_fork failed %s)\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<batch; j++) {
+			P(tsem);
+		}
+	}
+	gettime(&after);
+
+	timespec_sub(&after, &before, &after);
+	nsecs = after.tv_sec * 1000000000ULL + after.tv_nsec;
+	kprintf("%lu threads in %llu.%09lu seconds: %llu ns per thread\n",
+		count, (unsigned long long)after.tv_sec,
+		(unsigned long)after.tv_nsec, nsecs / count);
+	kprintf("Thread create/exit benchmark done.\n");
+
+	return 0;
+}
@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Tests and a benchmark for copyin, copyout, copyinstr, and
+ * copyoutstr.
+ *
+ * These need user memory, so they borrow the current process (which
+ * from the menu is the kernel process) and give it a small address
+ * space with one read/write region, which is thrown away afterwards.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <test.h>
+
+#define UCT_BASE	0x10000000	/* where the test region goes */
+#define UCT_PAGES	4
+#define UCT_SIZE	(UCT_PAGES * PAGE_SIZE)
+
+#define UCT_MAXLEN	200		/* longest block/string tested */
+#define UCT_GUARD	0xa5		/* fill for bytes that mustn't change */
+
+#define UCB_LOOPS	2000
+
+static char uct_kbuf[UCT_MAXLEN + 16];
+static char uct_check[UCT_MAXLEN + 16];
+static char uct_pattern[UCT_MAXLEN + 16];
+static char uct_bigbuf[PAGE_SIZE + 8];
+
+/*
+ * Give the current process a fresh address space with the test
+ * region in it. Hands back the old one for uct_teardown.
+ */
+static
+int
+uct_setup(struct addrspace **oldas)
+{
+	struct addrspace *as;
+	int result;
+
+	as = as_create();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+	result = as_define_region(as, UCT_BASE, UCT_SIZE, 1, 1, 0);
+	if (result == 0) {
+		result = as_prepare_load(as);
+	}
+	if (result == 0) {
+		result = as_complete_load(as);
+	}
+	if (result) {
+		as_destroy(as);
+		return result;
+	}
+	*oldas = proc_setas(as);
+	as_activate();
+	return 0;
+}
+
+static
+void
+uct_teardown(struct addrspace *oldas)
+{
+	struct addrspace *as;
+
+	as = proc_setas(oldas);
+	as_activate();
+	as_destroy(as);
+}
+
+/*
+ * Check the buffer against what it should hold, guard bytes and all.
+ * (There's no memcmp in the kernel.)
+ */
+static
+bool
+uct_same(void)
+{
+	unsigned i;
+
+	for (i=0; i<sizeof(uct_kbuf); i++) {
+		if (uct_kbuf[i] != uct_check[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Make the pattern: all nonzero, so it can be used for strings too.
+ */
+static
+void
+uct_mkpattern(void)
+{
+	unsigned i;
+
+	for (i=0; i<sizeof(uct_pattern); i++) {
+		uct_pattern[i] = 1 + random() % 255;
+	}
+}
+
+/*
+ * Check copyout then copyin of LEN bytes, at every alignment of the
+ * kernel and user ends. Returns the number of failures.
+ */
+static
+unsigned
+uct_block(size_t len)
+{
+	userptr_t uptr;
+	unsigned koff, uoff, fails = 0;
+	int result;
+
+	for (uoff = 0; uoff < 4; uoff++) {
+		for (koff = 0; koff < 4; koff++) {
+			uptr = (userptr_t)(UCT_BASE + 8 + uoff);
+
+			result = copyout(uct_pattern + koff, uptr, len);
+			if (result) {
+				kprintf("copyout %zu (%u/%u): %s\n", len,
+					koff, uoff, strerror(result));
+				fails++;
+				continue;
+			}
+
+			memset(uct_kbuf, UCT_GUARD, sizeof(uct_kbuf));
+			memset(uct_check, UCT_GUARD, sizeof(uct_check));
+			memcpy(uct_check + 4 + koff, uct_pattern + koff, len);
+
+			result = copyin(uptr, uct_kbuf + 4 + koff, len);
+			if (result) {
+				kprintf("copyin %zu (%u/%u): %s\n", len,
+					koff, uoff, strerror(result));
+				fails++;
+				continue;
+			}
+			if (!uct_same()) {
+				kprintf("copyin/out %zu (%u/%u): wrong data\n",
+					len, koff, uoff);
+				fails++;
+			}
+		}
+	}
+	return fails;
+}
+
+/*
+ * Check copyoutstr then copyinstr of a LEN-character string, at every
+ * alignment, with room for it and with one byte too few. Returns the
+ * number of failures.
+ */
+static
+unsigned
+uct_string(size_t len)
+{
+	userptr_t uptr;
+	unsigned koff, uoff, fails = 0;
+	size_t got;
+	int result;
+
+	for (uoff = 0; uoff < 4; uoff++) {
+		for (koff = 0; koff < 4; koff++) {
+			uptr = (userptr_t)(UCT_BASE + 8 + uoff);
+
+			memcpy(uct_check, uct_pattern, len);
+			uct_check[len] = 0;
+			result = copyoutstr(uct_check, uptr, len + 1, &got);
+			if (result || got != len + 1) {
+				kprintf("copyoutstr %zu (%u/%u): %s, got %zu\n",
+					len, koff, uoff, strerror(result), got);
+				fails++;
+				continue;
+			}
+
+			memset(uct_kbuf, UCT_GUARD, sizeof(uct_kbuf));
+			memset(uct_check, UCT_GUARD, sizeof(uct_check));
+			memcpy(uct_check + 4 + koff, uct_pattern, len);
+			uct_check[4 + koff + len] = 0;
+
+			result = copyinstr(uptr, uct_kbuf + 4 + koff, len + 1,
+					   &got);
+			if (result || got != len + 1) {
+				kprintf("copyinstr %zu (%u/%u): %s, got %zu\n",
+					len, koff, uoff, strerror(result), got);
+				fails++;
+				continue;
+			}
+			if (!uct_same()) {
+				kprintf("copyinstr %zu (%u/%u): wrong data\n",
+					len, koff, uoff);
+				fails++;
+			}
+
+			if (len == 0) {
+				/* no such thing as a zero-length copy */
+				continue;
+			}
+			result = copyinstr(uptr, uct_kbuf + 4 + koff, len,
+					   &got);
+			if (result != ENAMETOOLONG) {
+				kprintf("copyinstr %zu (%u/%u) short: %s\n",
+					len, koff, uoff, strerror(result));
+				fails++;
+			}
+		}
+	}
+	return fails;
+}
+
+/*
+ * A string with no end, running off the top of the region, must give
+ * EFAULT and not ENAMETOOLONG or a crash.
+ */
+static
+unsigned
+uct_runoff(void)
+{
+	userptr_t uptr;
+	unsigned fails = 0;
+	size_t got;
+	int result;
+
+	uptr = (userptr_t)(UCT_BASE + UCT_SIZE - 7);
+	result = copyout(uct_pattern, uptr, 7);
+	if (result) {
+		kprintf("copyout at end of region: %s\n", strerror(result));
+		return 1;
+	}
+	result = copyinstr(uptr, uct_kbuf, 64, &got);
+	if (result != EFAULT) {
+		kprintf("copyinstr off the end: %s, should be EFAULT\n",
+			strerror(result));
+		fails++;
+	}
+	result = copyin(uptr, uct_kbuf, 8);
+	if (result != EFAULT) {
+		kprintf("copyin off the end: %s, should be EFAULT\n",
+			strerror(result));
+		fails++;
+	}
+	return fails;
+}
+
+int
+usercopytest(int nargs, char **args)
+{
+	struct addrspace *oldas;
+	unsigned fails = 0;
+	size_t len;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting user copy test...\n");
+
+	result = uct_setup(&oldas);
+	if (result) {
+		kprintf("usercopytest: %s\n", strerror(result));
+		return result;
+	}
+	uct_mkpattern();
+
+	/* (copyin and copyout of nothing fail with EFAULT) */
+	for (len = 1; len <= UCT_MAXLEN; len++) {
+		fails += uct_block(len);
+	}
+	for (len = 0; len < UCT_MAXLEN; len++) {
+		fails += uct_string(len);
+	}
+	fails += uct_runoff();
+
+	uct_teardown(oldas);
+
+	if (fails > 0) {
+		kprintf("usercopytest: %u failures\n", fails);
+		kprintf("Test failed\n");
+		return EINVAL;
+	}
+	kprintf("User copy test done.\n");
+	return 0;
+}
+
+/*
+ * Time LOOPS calls of one kind of copy.
+ */
+static
+void
+ucb_report(const char *what, size_t len, const struct timespec *before,
+	   const struct timespec *after)
+{
+	struct timespec diff;
+	uint64_t nsecs;
+
+	timespec_sub(after, before, &diff);
+	nsecs = diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+	kprintf("%-24s %5zu bytes: %llu ns each", what, len,
+		nsecs / UCB_LOOPS);
+	if (nsecs > 0) {
+		kprintf(", %llu MB/s",
+			(unsigned long long)len * UCB_LOOPS * 1000 / nsecs);
+	}
+	kprintf("\n");
+}
+
+static
+void
+ucb_block(const char *what, unsigned uoff, unsigned koff, size_t len,
+	  bool out)
+{
+	struct timespec before, after;
+	userptr_t uptr;
+	unsigned i;
+	int result;
+
+	uptr = (userptr_t)(UCT_BASE + uoff);
+	gettime(&before);
+	for (i=0; i<UCB_LOOPS; i++) {
+		if (out) {
+			result = copyout(uct_bigbuf + koff, uptr, len);
+		}
+		else {
+			result = copyin(uptr, uct_bigbuf + koff, len);
+		}
+		if (result) {
+			kprintf("%s: %s\n", what, strerror(result));
+			return;
+		}
+	}
+	gettime(&after);
+	ucb_report(what, len, &before, &after);
+}
+
+static
+void
+ucb_string(const char *what, unsigned uoff, size_t len)
+{
+	struct timespec before, after;
+	userptr_t uptr;
+	unsigned i;
+	size_t got;
+	int result;
+
+	uptr = (userptr_t)(UCT_BASE + uoff);
+	memset(uct_bigbuf, 'x', len);
+	uct_bigbuf[len] = 0;
+	result = copyoutstr(uct_bigbuf, uptr, len + 1, &got);
+	if (result) {
+		kprintf("%s: %s\n", what, strerror(result));
+		return;
+	}
+
+	gettime(&before);
+	for (i=0; i<UCB_LOOPS; i++) {
+		/* as sys_open does: allow the full PATH_MAX */
+		result = copyinstr(uptr, uct_bigbuf, PATH_MAX, &got);
+		if (result) {
+			kprintf("%s: %s\n", what, strerror(result));
+			return;
+		}
+	}
+	gettime(&after);
+	ucb_report(what, len, &before, &after);
+}
+
+int
+usercopybench(int nargs, char **args)
+{
+	struct addrspace *oldas;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting user copy benchmark...\n");
+
+	result = uct_setup(&oldas);
+	if (result) {
+		kprintf("usercopybench: %s\n", strerror(result));
+		return result;
+	}
+
+	/* Touch the region so page faults aren't timed. */
+	memset(uct_bigbuf, 0, sizeof(uct_bigbuf));
+	for (i=0; i<UCT_PAGES; i++) {
+		result = copyout(uct_bigbuf,
+				 (userptr_t)(UCT_BASE + i * PAGE_SIZE),
+				 PAGE_SIZE);
+		if (result) {
+			kprintf("usercopybench: %s\n", strerror(result));
+			uct_teardown(oldas);
+			return result;
+		}
+	}
+
+	ucb_block("copyin aligned", 0, 0, PAGE_SIZE, false);
+	ucb_block("copyin misaligned", 1, 0, PAGE_SIZE, false);
+	ucb_block("copyin odd length", 0, 0, PAGE_SIZE - 1, false);
+	ucb_block("copyout aligned", 0, 0, PAGE_SIZE, true);
+	ucb_block("copyout misaligned", 0, 3, PAGE_SIZE, true);
+	ucb_block("copyin small", 0, 0, 12, false);
+	ucb_string("copyinstr short path", 0, 16);
+	ucb_string("copyinstr long path", 1, PATH_MAX - 1);
+
+	uct_teardown(oldas);
+
+	kprintf("User copy benchmark done.\n");
+	return 0;
+}
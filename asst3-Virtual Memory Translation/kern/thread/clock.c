@@ -29,18 +29,24 @@
 
 #include <types.h>
 #include <lib.h>
+#include <spl.h>
 #include <cpu.h>
 #include <wchan.h>
 #include <clock.h>
+#include <timer.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
+#include <userinfo.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Each CPU has a one-shot timer interrupt, which we reprogram every
+ * time it goes off for whichever comes first: the next hardclock, or
+ * the next kernel timer on that CPU (see timer.c). Idle CPUs don't
+ * need hardclock, so they only wake up when a timer is due or when
+ * somebody sends them work.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -51,13 +57,31 @@
  * the scheduler.
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define HARDCLOCK_NSECS		(1000000000ULL / HZ)
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Set once the time-of-day clock has been attached. Until then
+ * clock_now() can't be used, so we just tick.
  */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
+static bool clock_started;
+
+/*
+ * Sleeping threads wait on one of several shared wait channels,
+ * chosen by hashing the address of the sleep record, and recheck
+ * their own flag when woken. This avoids creating a wait channel per
+ * sleep without waking every sleeper in the system every time.
+ */
+#define NSLEEPQS	16
+
+static struct sleepq {
+	struct wchan *sq_wchan;
+	struct spinlock sq_lock;
+} sleepqs[NSLEEPQS];
+
+struct sleeper {
+	struct sleepq *sl_queue;
+	volatile bool sl_done;
+};
 
 /*
  * Setup.
@@ -65,29 +89,147 @@ static struct spinlock lbolt_lock;
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	unsigned i;
+
+	for (i=0; i<NSLEEPQS; i++) {
+		spinlock_init(&sleepqs[i].sq_lock);
+		sleepqs[i].sq_wchan = wchan_create("sleep");
+		if (sleepqs[i].sq_wchan == NULL) {
+			panic("Couldn't create sleep queue\n");
+		}
+	}
+}
+
+/*
+ * Current time in nanoseconds, for timers and sleeps.
+ */
+uint64_t
+clock_now(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Program this cpu's timer for the earlier of the next hardclock
+ * and the next kernel timer. Interrupts must be off.
+ */
+static
+void
+clock_program(void)
+{
+	uint64_t now, next;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	next = timerwheel_next(&curcpu->c_timers);
+	if (curcpu->c_nexttick < next) {
+		next = curcpu->c_nexttick;
+	}
+	curcpu->c_nextevent = next;
+
+	now = clock_now();
+	mainbus_timer_set(next > now ? next - now : 0);
+}
+
+/*
+ * Called once the time-of-day clock is available. Switches the boot
+ * cpu over from plain ticking; the others aren't running yet and
+ * switch over on their first timer interrupt.
+ */
+void
+clock_start(void)
+{
+	int spl;
+
+	spl = splhigh();
+	clock_started = true;
+	curcpu->c_nexttick = clock_now() + HARDCLOCK_NSECS;
+	clock_program();
+	splx(spl);
+}
+
+/*
+ * Make sure this cpu's timer goes off no later than WHEN. Called when
+ * a timer is started. Interrupts must be off.
+ */
+void
+clock_reprogram(uint64_t when)
+{
+	if (clock_started && when < curcpu->c_nextevent) {
+		clock_program();
+	}
+}
+
+/*
+ * This cpu is going idle: stop hardclock.
+ */
+void
+clock_idle(void)
+{
+	if (clock_started) {
+		curcpu->c_nexttick = TIMER_NEVER;
+		clock_program();
 	}
 }
 
 /*
- * This is called once per second, on one processor, by the timer
- * code.
+ * This cpu has something to do again: restart hardclock.
  */
 void
-timerclock(void)
+clock_unidle(void)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
+	uint64_t now;
+
+	if (clock_started) {
+		now = clock_now();
+		/* we may have been idle for a while; catch the page up */
+		userinfo_settime(now);
+		curcpu->c_nexttick = now + HARDCLOCK_NSECS;
+		clock_program();
+	}
+}
+
+/*
+ * This is called by the MD code when this cpu's timer goes off.
+ */
+void
+clock_interrupt(void)
+{
+	uint64_t now;
+	bool tick;
+
+	if (!clock_started) {
+		mainbus_timer_set(HARDCLOCK_NSECS);
+		hardclock();
+		return;
+	}
+
+	now = clock_now();
+	timerwheel_run(&curcpu->c_timers, now);
+
+	tick = (now >= curcpu->c_nexttick);
+	if (tick) {
+		curcpu->c_nexttick += HARDCLOCK_NSECS;
+		if (curcpu->c_nexttick <= now) {
+			/* Fell behind; don't try to catch up. */
+			curcpu->c_nexttick = now + HARDCLOCK_NSECS;
+		}
+	}
+
+	/* Must reprogram first; hardclock() may switch threads. */
+	clock_program();
+	if (tick) {
+		userinfo_settime(now);
+		hardclock();
+	}
 }
 
 /*
- * This is called HZ times a second (on each processor) by the timer
- * code.
+ * This is called HZ times a second on each processor that isn't idle
+ * by the timer code.
  */
 void
 hardclock(void)
@@ -97,25 +239,61 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
-		thread_consider_migration();
-	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
 	thread_yield();
 }
 
+/*
+ * Timer function for clock_nsleep.
+ */
+static
+void
+clock_wakeup(void *data)
+{
+	struct sleeper *sl = data;
+	struct sleepq *sq = sl->sl_queue;
+
+	spinlock_acquire(&sq->sq_lock);
+	sl->sl_done = true;
+	wchan_wakeall(sq->sq_wchan, &sq->sq_lock);
+	/* SL may disappear as soon as we unlock. */
+	spinlock_release(&sq->sq_lock);
+}
+
+/*
+ * Suspend execution for NSECS nanoseconds.
+ */
+void
+clock_nsleep(uint64_t nsecs)
+{
+	struct sleeper sl;
+	struct timer t;
+	struct sleepq *sq;
+
+	/* Each thread has its own stack, so this spreads sleepers out. */
+	sq = &sleepqs[((uintptr_t)&sl / STACK_SIZE) % NSLEEPQS];
+	sl.sl_queue = sq;
+	sl.sl_done = false;
+
+	timer_init(&t, clock_wakeup, &sl);
+	timer_start(&t, clock_now() + nsecs);
+
+	spinlock_acquire(&sq->sq_lock);
+	while (!sl.sl_done) {
+		wchan_sleep(sq->sq_wchan, &sq->sq_lock);
+	}
+	spinlock_release(&sq->sq_lock);
+}
+
 /*
  * Suspend execution for n seconds.
  */
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > 0) {
+		clock_nsleep((uint64_t)num_secs * 1000000000ULL);
 	}
-	spinlock_release(&lbolt_lock);
 }
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock order validator.
+ *
+ * This is the lock-order counterpart to hangman: hangman looks at who
+ * is waiting for what right now, and this looks at every order in
+ * which sleep locks have ever been taken.
+ *
+ * Each lock belongs to a class, found by name when the lock is
+ * created. Whenever a thread acquires a lock of class B while holding
+ * one of class A, we record the edge A -> B. If B -> ... -> A is
+ * already in the graph, two threads doing these things at the same
+ * time could deadlock, so we print both orders and panic, the same
+ * way hangman does when it finds an actual cycle.
+ *
+ * Edges are only ever added, so once a thread's current set of held
+ * locks has been seen before, acquiring costs a few bit tests and no
+ * global lock.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <current.h>
+#include <thread.h>
+#include <lockdep.h>
+
+#define LOCKDEP_MAXCLASSES	256
+#define LOCKDEP_NAMELEN		32
+#define LOCKDEP_WORDS		(LOCKDEP_MAXCLASSES / 32)
+
+static struct spinlock lockdep_lock = SPINLOCK_INITIALIZER;
+
+/* Class table, hashed by name; protected by lockdep_lock. */
+static char lockdep_names[LOCKDEP_MAXCLASSES][LOCKDEP_NAMELEN];
+static bool lockdep_inuse[LOCKDEP_MAXCLASSES];
+static unsigned lockdep_nclasses;
+static bool lockdep_fullwarned;
+
+/*
+ * The order graph: bit B of lockdep_after[A] is set once some thread
+ * has acquired a lock of class B while holding one of class A. Bits
+ * are set under lockdep_lock but may be tested without it.
+ */
+static volatile uint32_t lockdep_after[LOCKDEP_MAXCLASSES][LOCKDEP_WORDS];
+
+/* Scratch space for lockdep_search(); protected by lockdep_lock. */
+static int lockdep_queue[LOCKDEP_MAXCLASSES];
+static int lockdep_from[LOCKDEP_MAXCLASSES];
+
+static
+bool
+lockdep_edge(int a, int b)
+{
+	return (lockdep_after[a][b / 32] & ((uint32_t)1 << (b % 32))) != 0;
+}
+
+/*
+ * Copy NAME into BUF, truncated the same way class names are.
+ */
+static
+void
+lockdep_truncname(char *buf, const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < LOCKDEP_NAMELEN - 1 && name[i] != 0; i++) {
+		buf[i] = name[i];
+	}
+	buf[i] = 0;
+}
+
+/*
+ * Find the class for NAME, making a new one if needed. Returns -1 if
+ * the table is full.
+ */
+static
+int
+lockdep_findclass(const char *name)
+{
+	char buf[LOCKDEP_NAMELEN];
+	unsigned hash, i, n;
+	const char *s;
+
+	lockdep_truncname(buf, name);
+	hash = 5381;
+	for (s = buf; *s != 0; s++) {
+		hash = hash * 33 + (unsigned char)*s;
+	}
+
+	for (n = 0; n < LOCKDEP_MAXCLASSES; n++) {
+		i = (hash + n) % LOCKDEP_MAXCLASSES;
+		if (!lockdep_inuse[i]) {
+			if (lockdep_nclasses == LOCKDEP_MAXCLASSES - 1) {
+				/* keep one slot empty so lookups stop */
+				break;
+			}
+			strcpy(lockdep_names[i], buf);
+			lockdep_inuse[i] = true;
+			lockdep_nclasses++;
+			return i;
+		}
+		if (!strcmp(lockdep_names[i], buf)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void
+lockdep_lockinit(struct lockdep_lock *l, const char *name)
+{
+	bool warn;
+
+	spinlock_acquire(&lockdep_lock);
+	l->ll_name = name;
+	l->ll_class = lockdep_findclass(name);
+	warn = l->ll_class < 0 && !lockdep_fullwarned;
+	if (warn) {
+		lockdep_fullwarned = true;
+	}
+	spinlock_release(&lockdep_lock);
+
+	if (warn) {
+		kprintf("lockdep: class table full; not tracking %s "
+			"or any further new lock names\n", name);
+	}
+}
+
+/*
+ * Breadth-first search of the order graph for a path from START to
+ * TARGET. If there is one, leaves lockdep_from[] pointing back along
+ * it.
+ */
+static
+bool
+lockdep_search(int start, int target)
+{
+	unsigned head, tail;
+	int cur, next;
+
+	for (next = 0; next < LOCKDEP_MAXCLASSES; next++) {
+		lockdep_from[next] = -1;
+	}
+	head = tail = 0;
+	lockdep_queue[tail++] = start;
+	lockdep_from[start] = start;
+
+	while (head < tail) {
+		cur = lockdep_queue[head++];
+		if (cur == target) {
+			return true;
+		}
+		for (next = 0; next < LOCKDEP_MAXCLASSES; next++) {
+			if (lockdep_from[next] < 0 && lockdep_edge(cur, next)) {
+				lockdep_from[next] = cur;
+				lockdep_queue[tail++] = next;
+			}
+		}
+	}
+	return false;
+}
+
+/*
+ * Report that acquiring L while holding HELD inverts the order found
+ * by lockdep_search, and panic.
+ */
+static
+void
+lockdep_report(const struct lockdep_lock *l, const struct lockdep_lock *held)
+{
+	unsigned len;
+	int cur;
+
+	/* Turn the back-pointers into the path, in order. */
+	len = 0;
+	for (cur = held->ll_class; cur != l->ll_class;
+	     cur = lockdep_from[cur]) {
+		lockdep_queue[len++] = cur;
+	}
+	lockdep_queue[len++] = l->ll_class;
+
+	/* As in hangman_check(). */
+	splhigh();
+	spinlock_release(&lockdep_lock);
+
+	kprintf("lockdep: Detected lock order inversion!\n");
+	kprintf("lockdep: %s (%p) acquiring %s (%p)\n",
+		curthread->t_name, curthread, l->ll_name, l);
+	kprintf("lockdep: while holding %s (%p), but earlier:\n",
+		held->ll_name, held);
+	while (len > 1) {
+		len--;
+		kprintf("   %s was held while acquiring %s\n",
+			lockdep_names[lockdep_queue[len]],
+			lockdep_names[lockdep_queue[len - 1]]);
+	}
+	panic("Lock order inversion.\n");
+}
+
+/*
+ * Note that the current thread, whose held locks are H, is about to
+ * acquire L. Call before waiting, so inversions are caught whether or
+ * not they deadlock this time.
+ */
+void
+lockdep_acquire(struct lockdep_held *h, const struct lockdep_lock *l)
+{
+	unsigned i;
+	int a, b;
+
+	b = l->ll_class;
+	if (b < 0) {
+		return;
+	}
+
+	/* Fast path: every edge this adds is already known. */
+	for (i = 0; i < h->lh_count; i++) {
+		a = h->lh_locks[i]->ll_class;
+		if (a != b && !lockdep_edge(a, b)) {
+			break;
+		}
+	}
+
+	if (i < h->lh_count) {
+		spinlock_acquire(&lockdep_lock);
+		for (; i < h->lh_count; i++) {
+			a = h->lh_locks[i]->ll_class;
+			/*
+			 * Nesting two locks of the same class isn't
+			 * checked; whatever orders them (e.g. inode
+			 * number) isn't visible here.
+			 */
+			if (a == b || lockdep_edge(a, b)) {
+				continue;
+			}
+			if (lockdep_search(b, a)) {
+				lockdep_report(l, h->lh_locks[i]);
+			}
+			lockdep_after[a][b / 32] |= (uint32_t)1 << (b % 32);
+		}
+		spinlock_release(&lockdep_lock);
+	}
+
+	if (h->lh_count == LOCKDEP_MAXHELD) {
+		panic("lockdep: %s holding too many locks acquiring %s\n",
+		      curthread->t_name, l->ll_name);
+	}
+	h->lh_locks[h->lh_count++] = l;
+}
+
+/*
+ * Note that the current thread, whose held locks are H, has released
+ * L. Locks need not be released in the order they were taken.
+ */
+void
+lockdep_release(struct lockdep_held *h, const struct lockdep_lock *l)
+{
+	unsigned i;
+
+	if (l->ll_class < 0) {
+		return;
+	}
+
+	for (i = h->lh_count; i-- > 0; ) {
+		if (h->lh_locks[i] == l) {
+			break;
+		}
+	}
+	if (i >= h->lh_count) {
+		panic("lockdep_release: %s (%p) not held\n", l->ll_name, l);
+	}
+
+	h->lh_count--;
+	for (; i < h->lh_count; i++) {
+		h->lh_locks[i] = h->lh_locks[i + 1];
+	}
+}
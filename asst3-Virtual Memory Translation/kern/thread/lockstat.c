@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics.
+ *
+ * The counts in a struct lockstat are updated while holding the lock
+ * it describes (for a sleep lock, its lk_lock; for a CV, its
+ * cv_wchanlock), so they need no locking of their own. The first
+ * time a lock is contended it is put on a global list, which is what
+ * lockstat_print() looks at; uncontended locks never get there.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <lockstat.h>
+
+/* Protects the list. Its own statistics are not collected. */
+static struct spinlock lockstat_listlock = SPINLOCK_INITIALIZER;
+static struct lockstat *lockstat_list;
+static unsigned lockstat_nlisted;
+
+/* Set once clock_now() works. */
+static volatile bool lockstat_enabled;
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_enabled = true;
+}
+
+void
+lockstat_init(struct lockstat *ls, const char *kind, const char *name)
+{
+	ls->ls_name = name;
+	ls->ls_kind = kind;
+	ls->ls_next = ls->ls_prev = NULL;
+	ls->ls_listed = false;
+	ls->ls_acquires = 0;
+	ls->ls_contended = 0;
+	ls->ls_waitns = 0;
+	ls->ls_maxwaitns = 0;
+	ls->ls_holdsite = NULL;
+	ls->ls_maxsite = NULL;
+}
+
+void
+lockstat_cleanup(struct lockstat *ls)
+{
+	if (!ls->ls_listed) {
+		return;
+	}
+
+	spinlock_acquire(&lockstat_listlock);
+	if (ls->ls_prev != NULL) {
+		ls->ls_prev->ls_next = ls->ls_next;
+	}
+	else {
+		lockstat_list = ls->ls_next;
+	}
+	if (ls->ls_next != NULL) {
+		ls->ls_next->ls_prev = ls->ls_prev;
+	}
+	ls->ls_listed = false;
+	lockstat_nlisted--;
+	spinlock_release(&lockstat_listlock);
+}
+
+void
+lockstat_contended(struct lockstat *ls, struct lockstat_wait *w,
+		   const void *site)
+{
+	if (w->lw_waited || !lockstat_enabled) {
+		return;
+	}
+	w->lw_waited = true;
+	w->lw_start = clock_now();
+	w->lw_site = site != NULL ? site : ls->ls_holdsite;
+}
+
+void
+lockstat_acquired(struct lockstat *ls, struct lockstat_wait *w,
+		  const void *site)
+{
+	uint64_t wait;
+
+	if (!lockstat_enabled || ls == &lockstat_listlock.splk_lockstat) {
+		return;
+	}
+
+	ls->ls_acquires++;
+	ls->ls_holdsite = site;
+	if (!w->lw_waited) {
+		return;
+	}
+
+	wait = clock_now() - w->lw_start;
+	ls->ls_contended++;
+	ls->ls_waitns += wait;
+	if (wait >= ls->ls_maxwaitns) {
+		ls->ls_maxwaitns = wait;
+		ls->ls_maxsite = w->lw_site;
+	}
+
+	if (!ls->ls_listed) {
+		spinlock_acquire(&lockstat_listlock);
+		ls->ls_prev = NULL;
+		ls->ls_next = lockstat_list;
+		if (lockstat_list != NULL) {
+			lockstat_list->ls_prev = ls;
+		}
+		lockstat_list = ls;
+		ls->ls_listed = true;
+		lockstat_nlisted++;
+		spinlock_release(&lockstat_listlock);
+	}
+}
+
+/*
+ * A copy of one lock's statistics, made under lockstat_listlock so it
+ * can be printed (which may take other locks) without it.
+ */
+struct lockstat_report {
+	const void *lr_addr;
+	const char *lr_kind;
+	char lr_name[24];
+	unsigned lr_acquires;
+	unsigned lr_contended;
+	uint64_t lr_waitns;
+	uint64_t lr_maxwaitns;
+	const void *lr_maxsite;
+};
+
+#define LOCKSTAT_MAXREPORT 64
+
+void
+lockstat_print(unsigned n)
+{
+	struct lockstat_report *reports, *r;
+	struct lockstat *ls;
+	unsigned nreports, total, i, j;
+
+	if (n > LOCKSTAT_MAXREPORT) {
+		n = LOCKSTAT_MAXREPORT;
+	}
+	reports = kmalloc(n * sizeof(*reports));
+	if (reports == NULL) {
+		kprintf("lockstat: out of memory\n");
+		return;
+	}
+
+	/* Keep the N with the most total wait, in order, by insertion. */
+	nreports = 0;
+	spinlock_acquire(&lockstat_listlock);
+	total = lockstat_nlisted;
+	for (ls = lockstat_list; ls != NULL; ls = ls->ls_next) {
+		if (ls->ls_contended == 0) {
+			/* reset since */
+			continue;
+		}
+		for (i = nreports; i > 0; i--) {
+			if (reports[i - 1].lr_waitns >= ls->ls_waitns) {
+				break;
+			}
+		}
+		if (i == n) {
+			continue;
+		}
+		if (nreports < n) {
+			nreports++;
+		}
+		for (j = nreports - 1; j > i; j--) {
+			reports[j] = reports[j - 1];
+		}
+
+		r = &reports[i];
+		r->lr_addr = ls;
+		r->lr_kind = ls->ls_kind != NULL ? ls->ls_kind : "spinlock";
+		r->lr_name[0] = 0;
+		if (ls->ls_name != NULL) {
+			for (j = 0; j < sizeof(r->lr_name) - 1; j++) {
+				r->lr_name[j] = ls->ls_name[j];
+				if (ls->ls_name[j] == 0) {
+					break;
+				}
+			}
+			r->lr_name[j] = 0;
+		}
+		r->lr_acquires = ls->ls_acquires;
+		r->lr_contended = ls->ls_contended;
+		r->lr_waitns = ls->ls_waitns;
+		r->lr_maxwaitns = ls->ls_maxwaitns;
+		r->lr_maxsite = ls->ls_maxsite;
+	}
+	spinlock_release(&lockstat_listlock);
+
+	kprintf("lockstat: %u of %u contended locks, by total wait\n",
+		nreports, total);
+	kprintf("%-8s %-23s %10s %10s %12s %10s %10s\n", "kind", "name",
+		"acquires", "contended", "total us", "max us", "max site");
+	for (i = 0; i < nreports; i++) {
+		r = &reports[i];
+		if (r->lr_name[0] == 0) {
+			snprintf(r->lr_name, sizeof(r->lr_name), "%p",
+				 r->lr_addr);
+		}
+		kprintf("%-8s %-23s %10u %10u %12llu %10llu %10p\n",
+			r->lr_kind, r->lr_name, r->lr_acquires,
+			r->lr_contended, r->lr_waitns / 1000,
+			r->lr_maxwaitns / 1000, r->lr_maxsite);
+	}
+
+	kfree(reports);
+}
+
+/*
+ * Zero the counts of every lock. Updates racing with this may be
+ * lost or survive it, which is fine for statistics.
+ */
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+
+	spinlock_acquire(&lockstat_listlock);
+	for (ls = lockstat_list; ls != NULL; ls = ls->ls_next) {
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waitns = 0;
+		ls->ls_maxwaitns = 0;
+		ls->ls_maxsite = NULL;
+	}
+	spinlock_release(&lockstat_listlock);
+}
@@ -30,6 +30,8 @@
 /* Make sure to build out-of-line versions of inline functions */
 #define SPINLOCK_INLINE   /* empty */
 #define MEMBAR_INLINE     /* empty */
+#define ATOMIC_INLINE     /* empty */
+#define REFCOUNT_INLINE   /* empty */
 
 #include <types.h>
 #include <lib.h>
@@ -37,6 +39,8 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <membar.h>
+#include <atomic.h>
+#include <refcount.h>
 #include <current.h>	/* for curcpu */
 
 /*
@@ -53,6 +57,7 @@ spinlock_init(struct spinlock *splk)
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+	LOCKSTAT_INIT(&splk->splk_lockstat, NULL, NULL);
 }
 
 /*
@@ -63,6 +68,7 @@ spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
 	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	LOCKSTAT_CLEANUP(&splk->splk_lockstat);
 }
 
 /*
@@ -76,6 +82,7 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	LOCKSTAT_WAIT(wait);
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -105,9 +112,11 @@ spinlock_acquire(struct spinlock *splk)
 		 * we don't.
 		 */
 		if (spinlock_data_get(&splk->splk_lock) != 0) {
+			LOCKSTAT_CONTENDED(&splk->splk_lockstat, wait, NULL);
 			continue;
 		}
 		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+			LOCKSTAT_CONTENDED(&splk->splk_lockstat, wait, NULL);
 			continue;
 		}
 		break;
@@ -115,6 +124,8 @@ spinlock_acquire(struct spinlock *splk)
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+	LOCKSTAT_ACQUIRED(&splk->splk_lockstat, wait,
+			  __builtin_return_address(0));
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
@@ -38,6 +38,7 @@
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <cpu.h>
 #include <synch.h>
 
 ////////////////////////////////////////////////////////////
@@ -155,6 +156,8 @@ lock_create(const char *name)
 	}
 
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
+	LOCKDEP_LOCKINIT(&lock->lk_lockdep, lock->lk_name);
+	LOCKSTAT_INIT(&lock->lk_lockstat, "lock", lock->lk_name);
 
 	lock->lk_wchan = wchan_create(lock->lk_name);
 	if (lock->lk_wchan == NULL) {
@@ -164,6 +167,8 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	lock->lk_adaptive = true;
+	lock->lk_handoff = false;
 
 	return lock;
 }
@@ -174,6 +179,7 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	LOCKSTAT_CLEANUP(&lock->lk_lockstat);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -181,23 +187,90 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+void
+lock_set_adaptive(struct lock *lock, bool adaptive)
+{
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	lock->lk_adaptive = adaptive;
+	spinlock_release(&lock->lk_lock);
+}
+
+void
+lock_set_handoff(struct lock *lock, bool handoff)
+{
+	DEBUGASSERT(lock != NULL);
+
+	spinlock_acquire(&lock->lk_lock);
+	lock->lk_handoff = handoff;
+	spinlock_release(&lock->lk_lock);
+}
+
+/*
+ * Check if HOLDER is running on some other cpu, which makes it worth
+ * spinning for the lock instead of sleeping.
+ *
+ * This looks at another thread's state without any locks, so the
+ * answer is only a hint; the caller rechecks lk_holder. (The holder
+ * might even have released the lock and exited, but thread structures
+ * live in the kernel's direct-mapped memory, so the worst case is a
+ * wrong answer.)
+ */
+static
+bool
+lock_holder_running(struct thread *holder)
+{
+	const volatile struct thread *h = holder;
+
+	return h->t_state == S_RUN && h->t_cpu != curcpu->c_self;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+	struct thread *holder;
+	LOCKSTAT_WAIT(wait);
+
 	DEBUGASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
 
+	/* Check the lock order before we might wait */
+	LOCKDEP_ACQUIRE(&curthread->t_lockdep, &lock->lk_lockdep);
+
 	spinlock_acquire(&lock->lk_lock);
 
 	/* Call this (atomically) before waiting for a lock */
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
-	while (lock->lk_holder != NULL) {
+	while ((holder = lock->lk_holder) != NULL) {
+		if (holder == curthread) {
+			/* lock_release handed it to us while we slept */
+			break;
+		}
+		LOCKSTAT_CONTENDED(&lock->lk_lockstat, wait, NULL);
+		if (lock->lk_adaptive && lock_holder_running(holder)) {
+			/*
+			 * Spin without the spinlock (and with
+			 * interrupts on) until the lock changes hands
+			 * or the holder is switched out, then go
+			 * around again.
+			 */
+			spinlock_release(&lock->lk_lock);
+			while (lock->lk_holder == holder &&
+			       lock_holder_running(holder)) {
+				/* spin */
+			}
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
 		/* As in the semaphore. */
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
 	lock->lk_holder = curthread;
+	LOCKSTAT_ACQUIRED(&lock->lk_lockstat, wait,
+			  __builtin_return_address(0));
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -213,13 +286,25 @@ lock_release(struct lock *lock)
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
-	lock->lk_holder = NULL;
-	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+	if (lock->lk_handoff) {
+		/*
+		 * The new holder (if any) is already the holder when
+		 * it wakes up, so nobody can barge in ahead of it.
+		 */
+		lock->lk_holder = wchan_wakehead(lock->lk_wchan,
+						 &lock->lk_lock);
+	}
+	else {
+		lock->lk_holder = NULL;
+		wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+	}
 
 	/* Call this (atomically) when the lock is released */
 	HANGMAN_RELEASE(&curthread->t_hangman, &lock->lk_hangman);
 
 	spinlock_release(&lock->lk_lock);
+
+	LOCKDEP_RELEASE(&curthread->t_lockdep, &lock->lk_lockdep);
 }
 
 bool
@@ -265,6 +350,7 @@ cv_create(const char *name)
 	}
 
 	spinlock_init(&cv->cv_wchanlock);
+	LOCKSTAT_INIT(&cv->cv_lockstat, "cv", cv->cv_name);
 	return cv;
 }
 
@@ -273,6 +359,7 @@ cv_destroy(struct cv *cv)
 {
 	KASSERT(cv != NULL);
 
+	LOCKSTAT_CLEANUP(&cv->cv_lockstat);
 	spinlock_cleanup(&cv->cv_wchanlock);
 	wchan_destroy(cv->cv_wchan);
 
@@ -283,9 +370,15 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+	LOCKSTAT_WAIT(wait);
+
 	spinlock_acquire(&cv->cv_wchanlock);
+	LOCKSTAT_CONTENDED(&cv->cv_lockstat, wait,
+			   __builtin_return_address(0));
 	lock_release(lock);
 	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
+	LOCKSTAT_ACQUIRED(&cv->cv_lockstat, wait,
+			  __builtin_return_address(0));
 	/*
 	 * It is kind of silly to acquire this spinlock in wchan_sleep
 	 * and then release it right away. If we were going for
@@ -315,3 +408,127 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rw_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_writewchan = wchan_create(rw->rw_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_waitingwriters = 0;
+	rw->rw_writer = NULL;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_waitingwriters == 0);
+	KASSERT(rw->rw_writer == NULL);
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+	kfree(rw->rw_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	/* Stay out if a writer has it, or is waiting for it. */
+	while (rw->rw_writer != NULL || rw->rw_waitingwriters > 0) {
+		wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+	}
+	rw->rw_readers++;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0) {
+		/* Readers only ever wait behind writers. */
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	rw->rw_waitingwriters++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+	}
+	rw->rw_waitingwriters--;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	if (rw->rw_waitingwriters > 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+	else {
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
@@ -42,6 +42,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <membar.h>
 #include <wchan.h>
 #include <thread.h>
 #include <threadlist.h>
@@ -51,6 +52,7 @@
 #include <synch.h>
 #include <addrspace.h>
 #include <mainbus.h>
+#include <clock.h>
 #include <vnode.h>
 #include <pid.h>
 
@@ -72,6 +74,23 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/*
+ * Bitmask of CPUs (by c_number) currently sitting in cpu_idle(). This
+ * is only a hint: it is updated under idlecpus_lock but read without
+ * it, so readers must tolerate stale values.
+ */
+static volatile uint32_t idlecpus;
+static struct spinlock idlecpus_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Maximum number of exited threads each cpu keeps for reuse. Each one
+ * holds on to a STACK_SIZE stack, so don't make this too large.
+ */
+#define THREADPOOL_MAX	8
+
+/* Forward declaration. */
+static struct thread *thread_steal(void);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,6 +130,35 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Initialize the fields of a thread, other than the name and stack.
+ * Used both for new threads and for threads reused from the pool.
+ */
+static
+void
+thread_initfields(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_lastrun = 0;
+	thread->t_proc = NULL;
+	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+	LOCKDEP_HELDINIT(&thread->t_lockdep);
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -133,24 +181,8 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
-
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
-
-	/* If you add to struct thread, be sure to initialize here */
+	thread_initfields(thread);
 
 	return thread;
 }
@@ -180,8 +212,12 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadpool);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_nexttick = 0;
+	c->c_nextevent = TIMER_NEVER;
+	timerwheel_init(&c->c_timers);
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -290,9 +326,80 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Put a dead thread in the current cpu's pool for thread_fork to
+ * reuse, or destroy it if the pool is full. Keeping the thread and
+ * its stack together saves thread_fork a page-sized kmalloc (and the
+ * kfree here) for every short-lived thread.
+ *
+ * Must be called with interrupts off, as the pool is per-cpu.
+ */
+static
+void
+thread_recycle(struct thread *thread)
+{
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_state != S_RUN);
+	KASSERT(curthread->t_curspl > 0);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadpool.tl_count >= THREADPOOL_MAX) {
+		thread_destroy(thread);
+		return;
+	}
+
+	/*
+	 * Undo the parts of thread_create that thread_initfields will
+	 * redo. The stack guard band was checked in thread_exit and
+	 * nobody has run on the stack since, so it's still intact.
+	 */
+	KASSERT(thread->t_proc == NULL);
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_wchan_name = "RECYCLED";
+	kfree(thread->t_name);
+	thread->t_name = NULL;
+
+	threadlist_addhead(&curcpu->c_threadpool, thread);
+}
+
+/*
+ * Get a thread, with stack, from the current cpu's pool. Returns
+ * NULL if the pool is empty, in which case the caller should make a
+ * new one.
+ */
+static
+struct thread *
+thread_reuse(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	DEBUGASSERT(name != NULL);
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadpool);
+	splx(spl);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->t_name = kstrdup(name);
+	if (thread->t_name == NULL) {
+		thread_destroy(thread);
+		return NULL;
+	}
+	thread_checkstack(thread);
+	thread_initfields(thread);
+
+	return thread;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Where possible they
+ * are kept for reuse instead.
  *
  * The list of zombies is per-cpu.
  */
@@ -305,7 +412,7 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		thread_recycle(z);
 	}
 }
 
@@ -423,6 +530,15 @@ cpu_hatch(unsigned software_number)
 	thread_exit();
 }
 
+/*
+ * Number of cpus.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Start up secondary cpus. Called from boot().
  */
@@ -445,6 +561,61 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Mark the current cpu as idle or not idle in idlecpus.
+ */
+static
+void
+thread_setidle(bool isidle)
+{
+	uint32_t mask;
+
+	mask = (uint32_t)1 << curcpu->c_number;
+	spinlock_acquire(&idlecpus_lock);
+	if (isidle) {
+		idlecpus |= mask;
+	}
+	else {
+		idlecpus &= ~mask;
+	}
+	spinlock_release(&idlecpus_lock);
+}
+
+/*
+ * Poke some idle cpu other than TARGETCPU, if there is one, so it
+ * comes and steals work. This is a hint; if the cpu we pick has
+ * already unidled it will simply find nothing worth taking.
+ */
+static
+void
+thread_kick_idle(struct cpu *targetcpu)
+{
+	uint32_t mask;
+	unsigned i;
+	struct cpu *c;
+
+	/*
+	 * The thread we just queued must be visible before we look at
+	 * idlecpus; this pairs with thread_switch, which sets its idle
+	 * bit and then looks for work one last time.
+	 */
+	membar_any_any();
+	mask = idlecpus;
+	mask &= ~((uint32_t)1 << targetcpu->c_number);
+	mask &= ~((uint32_t)1 << curcpu->c_number);
+	if (mask == 0) {
+		return;
+	}
+
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		if (mask & ((uint32_t)1 << i)) {
+			c = cpuarray_get(&allcpus, i);
+			ipi_send(c, IPI_UNIDLE);
+			return;
+		}
+	}
+}
+
 /*
  * Make a thread runnable.
  *
@@ -471,12 +642,25 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	target->t_state = S_READY;
 	threadlist_addtail(&targetcpu->c_runqueue, target);
 
-	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
+	if (targetcpu->c_isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
 		 * sure it unidles.
 		 */
-		ipi_send(targetcpu, IPI_UNIDLE);
+		if (targetcpu != curcpu->c_self) {
+			ipi_send(targetcpu, IPI_UNIDLE);
+		}
+	}
+	else if (!already_have_lock) {
+		/*
+		 * A thread that was woken up or newly created is going
+		 * to wait behind whatever targetcpu is running. If some
+		 * other cpu is idle, get it to come and take it. (We
+		 * don't do this for threads that are merely yielding,
+		 * which is the already_have_lock case; they are cache-hot
+		 * and nobody would steal them anyway.)
+		 */
+		thread_kick_idle(targetcpu);
 	}
 
 	if (!already_have_lock) {
@@ -484,6 +668,39 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Make all the threads on LIST runnable, moving them to the end of
+ * the run queue of TARGETCPU, which must be the cpu they all belong
+ * to. This takes the run queue lock and sends any IPI once for the
+ * whole list rather than once per thread. LIST is left empty.
+ */
+static
+void
+thread_make_runnable_list(struct cpu *targetcpu, struct threadlist *list)
+{
+	struct thread *target;
+
+	spinlock_acquire(&targetcpu->c_runqueue_lock);
+
+	THREADLIST_FORALL(target, *list) {
+		KASSERT(target->t_cpu == targetcpu);
+		target->t_state = S_READY;
+	}
+	threadlist_join(&targetcpu->c_runqueue, list);
+
+	/* As in thread_make_runnable. */
+	if (targetcpu->c_isidle) {
+		if (targetcpu != curcpu->c_self) {
+			ipi_send(targetcpu, IPI_UNIDLE);
+		}
+	}
+	else {
+		thread_kick_idle(targetcpu);
+	}
+
+	spinlock_release(&targetcpu->c_runqueue_lock);
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -503,18 +720,22 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Use a recycled thread and stack if there is one */
+	newthread = thread_reuse(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -565,6 +786,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	bool wasidle;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -623,9 +845,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	}
 	cur->t_state = newstate;
+	cur->t_lastrun = curcpu->c_hardclocks;
 
 	/*
-	 * Get the next thread. While there isn't one, call cpu_idle().
+	 * Get the next thread. While there isn't one, try to steal one
+	 * from another cpu, and failing that call cpu_idle().
 	 * curcpu->c_isidle must be true when cpu_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
 	 * things can be added to it.
@@ -639,19 +863,49 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * Note that c_isidle becomes true briefly even if we don't go
 	 * idle. However, because one is supposed to hold the runqueue
 	 * lock to look at it, this should not be visible or matter.
+	 *
+	 * Stealing is also done with our own runqueue unlocked, so we
+	 * never hold two runqueue locks at once and two idle cpus
+	 * stealing from each other can't deadlock. A stolen thread is
+	 * on no list at all until we switch to it, which is fine since
+	 * nobody else looks for S_READY threads except on run queues.
 	 */
 
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
+	wasidle = false;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			next = thread_steal();
+			if (next == NULL) {
+				/*
+				 * Say we're idle, then look once more:
+				 * a cpu that queued work before it could
+				 * see our bit didn't kick us, and with
+				 * no hardclock nothing else would wake us
+				 * to take it.
+				 */
+				thread_setidle(true);
+				next = thread_steal();
+				if (next == NULL) {
+					if (!wasidle) {
+						/* No hardclock while idle. */
+						clock_idle();
+						wasidle = true;
+					}
+					cpu_idle();
+				}
+				thread_setidle(false);
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	if (wasidle) {
+		clock_unidle();
+	}
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -835,125 +1089,132 @@ schedule(void)
 }
 
 /*
- * Thread migration.
+ * Work stealing.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * When a CPU runs out of things to do, rather than waiting for some
+ * busy CPU to notice and push threads over, it pulls a ready thread
+ * off the back of the busiest other CPU's run queue. Busy CPUs never
+ * pay anything for this; idle CPUs are the ones doing the looking.
  *
  * Migrating threads isn't free because of cache affinity; a thread's
  * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
+ * which is fairly slow. So we prefer threads that have not run on
+ * their CPU for a while (STEAL_HOT_HARDCLOCKS), and take a cache-hot
+ * one only if the victim is backed up badly enough that it would
+ * have gone cold waiting anyway (STEAL_OVERLOAD).
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * System/161 does not (yet) model such cache effects, so the
+ * constants here are a guess and are on the aggressive side.
  */
-void
-thread_consider_migration(void)
+
+#define STEAL_HOT_HARDCLOCKS	2	/* Ran this recently: cache-hot. */
+#define STEAL_SCAN		4	/* Queue entries to look at. */
+#define STEAL_OVERLOAD		4	/* Queue length to ignore hotness. */
+
+/*
+ * Choose the cpu to steal from: the one with the most threads waiting
+ * on its run queue. The counts are read without taking any locks, so
+ * this costs one pass over the cpu array and no lock traffic; the
+ * answer is only a hint and is rechecked by the caller under the
+ * victim's lock. Idle cpus are skipped, as they're about to run
+ * whatever they have.
+ */
+static
+struct cpu *
+thread_steal_victim(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	unsigned i, n, numcpus, count, bestcount;
+	struct cpu *c, *best;
 
-	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
+	best = NULL;
+	bestcount = 0;
+
+	/* Start just after ourselves so idle cpus spread out. */
+	for (n=1; n<numcpus; n++) {
+		i = (curcpu->c_number + n) % numcpus;
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+		if (c->c_isidle) {
+			continue;
+		}
+		count = c->c_runqueue.tl_count;
+		if (count > bestcount) {
+			best = c;
+			bestcount = count;
 		}
-		spinlock_release(&c->c_runqueue_lock);
 	}
+	return best;
+}
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
-	}
+/*
+ * Try to take a thread from another cpu's run queue to run on this
+ * one. Returns the thread, which is on no list and now belongs to
+ * curcpu, or NULL if there was nothing worth taking.
+ *
+ * Called from thread_switch with interrupts off and our own run queue
+ * unlocked.
+ */
+static
+struct thread *
+thread_steal(void)
+{
+	struct cpu *victim;
+	struct thread *t, *found;
+	unsigned scanned;
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	victim = thread_steal_victim();
+	if (victim == NULL) {
+		return NULL;
 	}
-	spinlock_release(&curcpu->c_runqueue_lock);
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
+	found = NULL;
+	scanned = 0;
+	spinlock_acquire(&victim->c_runqueue_lock);
+	THREADLIST_FORALL_REV(t, victim->c_runqueue) {
+		if (scanned++ == STEAL_SCAN) {
+			break;
+		}
+		/*
+		 * Ordinarily, the victim's curthread will not appear on
+		 * its run queue. However, it can under the following
+		 * circumstances:
+		 *   - it went to sleep;
+		 *   - the processor became idle, so it
+		 *     remained curthread;
+		 *   - it was reawakened, so it was put on the
+		 *     run queue;
+		 *   - and the processor hasn't fully unidled
+		 *     yet, so all these things are still true.
+		 *
+		 * Taking a thread that is still curthread somewhere
+		 * else can cause bad things to happen (Exercise: Why?
+		 * And what?) so leave it alone.
+		 */
+		if (t == victim->c_curthread) {
 			continue;
 		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+		if (victim->c_hardclocks - t->t_lastrun >=
+		    STEAL_HOT_HARDCLOCKS) {
+			found = t;
+			break;
 		}
-		spinlock_release(&c->c_runqueue_lock);
-	}
-
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+		if (found == NULL &&
+		    victim->c_runqueue.tl_count >= STEAL_OVERLOAD) {
+			/* Cache-hot, but remember it as a fallback. */
+			found = t;
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
 	}
+	if (found != NULL) {
+		threadlist_remove(&victim->c_runqueue, found);
+		found->t_cpu = curcpu->c_self;
+	}
+	spinlock_release(&victim->c_runqueue_lock);
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	if (found != NULL) {
+		DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+		      found->t_name, victim->c_number, curcpu->c_number);
+	}
+	return found;
 }
 
 ////////////////////////////////////////////////////////////
@@ -1024,17 +1285,26 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
  */
 void
 wchan_wakeone(struct wchan *wc, struct spinlock *lk)
+{
+	(void)wchan_wakehead(wc, lk);
+}
+
+/*
+ * Wake up the longest sleeper on a wait channel, and return it.
+ */
+struct thread *
+wchan_wakehead(struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *target;
 
 	KASSERT(spinlock_do_i_hold(lk));
 
-	/* Grab a thread from the channel */
+	/* Grab the first thread from the channel */
 	target = threadlist_remhead(&wc->wc_threads);
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
-		return;
+		return NULL;
 	}
 
 	/*
@@ -1046,6 +1316,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 */
 
 	thread_make_runnable(target, false);
+	return target;
 }
 
 /*
@@ -1054,30 +1325,45 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 void
 wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 {
-	struct thread *target;
-	struct threadlist list;
+	struct thread *target, *next;
+	struct threadlist list, batch;
+	struct cpu *targetcpu;
 
 	KASSERT(spinlock_do_i_hold(lk));
 
 	threadlist_init(&list);
+	threadlist_init(&batch);
 
 	/*
 	 * Grab all the threads from the channel, moving them to a
 	 * private list.
 	 */
-	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
-		threadlist_addtail(&list, target);
-	}
+	threadlist_join(&list, &wc->wc_threads);
 
 	/*
-	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
+	 * Sort them by cpu: take the cpu of the first thread left,
+	 * pull out every thread that belongs to it (keeping them in
+	 * the order they went to sleep), and put that batch on its
+	 * run queue in one go. So with many sleepers each run queue
+	 * lock is taken once, not once per thread. There are only a
+	 * few cpus, so the repeated passes over the list are cheap
+	 * next to the lock traffic they save.
 	 */
-	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
+	while (!threadlist_isempty(&list)) {
+		targetcpu = list.tl_head.tln_next->tln_self->t_cpu;
+		for (target = list.tl_head.tln_next->tln_self;
+		     target != NULL;
+		     target = next) {
+			next = target->t_listnode.tln_next->tln_self;
+			if (target->t_cpu == targetcpu) {
+				threadlist_remove(&list, target);
+				threadlist_addtail(&batch, target);
+			}
+		}
+		thread_make_runnable_list(targetcpu, &batch);
 	}
 
+	threadlist_cleanup(&batch);
 	threadlist_cleanup(&list);
 }
 
@@ -215,6 +215,32 @@ threadlist_remtail(struct threadlist *tl)
 	return tln->tln_self;
 }
 
+void
+threadlist_join(struct threadlist *dst, struct threadlist *src)
+{
+	struct threadlistnode *first, *last;
+
+	DEBUGASSERT(dst != NULL);
+	DEBUGASSERT(src != NULL);
+	DEBUGASSERT(dst != src);
+
+	if (src->tl_count == 0) {
+		return;
+	}
+	first = src->tl_head.tln_next;
+	last = src->tl_tail.tln_prev;
+
+	first->tln_prev = dst->tl_tail.tln_prev;
+	last->tln_next = &dst->tl_tail;
+	first->tln_prev->tln_next = first;
+	dst->tl_tail.tln_prev = last;
+	dst->tl_count += src->tl_count;
+
+	src->tl_head.tln_next = &src->tl_tail;
+	src->tl_tail.tln_prev = &src->tl_head;
+	src->tl_count = 0;
+}
+
 void
 threadlist_insertafter(struct threadlist *tl,
 		       struct thread *onlist, struct thread *addee)
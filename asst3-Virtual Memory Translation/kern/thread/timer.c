@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel timers: per-CPU hierarchical timing wheels.
+ *
+ * Each wheel has TIMER_LEVELS levels of TIMER_SLOTS slots. A timer
+ * due within TIMER_SLOTS level 0 slots of the wheel's current time
+ * goes in level 0, indexed by its slot number; one due within
+ * TIMER_SLOTS^2 goes in level 1, indexed by its slot number divided
+ * by TIMER_SLOTS; and so on. When the wheel's time crosses a level L
+ * boundary, the corresponding level L slot is "cascaded": its timers
+ * are put back in at whatever lower level they now belong. So insert
+ * and cancel are constant time, and every timer is moved at most
+ * TIMER_LEVELS times before it goes off.
+ *
+ * Within level 0 we keep the exact expiry time, and the clock code
+ * programs the hardware for the earliest one, so timers have much
+ * finer resolution than a level 0 slot; the slot width only limits
+ * how often the wheel needs to be looked at.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <clock.h>
+#include <timer.h>
+#include <current.h>
+
+#define TIMER_SLOTMASK		(TIMER_SLOTS - 1)
+
+/* Shift from a level 0 slot number to a level L slot number. */
+#define LEVELSHIFT(l)		((l) * TIMER_SLOTSHIFT)
+
+/* Number of level 0 slots spanned by one slot of level L. */
+#define LEVELSPAN(l)		((uint64_t)1 << LEVELSHIFT(l))
+
+////////////////////////////////////////////////////////////
+//
+// Wheel internals. All of these are called with tw_lock held.
+
+static
+bool
+timerwheel_isempty(struct timerwheel *tw)
+{
+	unsigned level;
+
+	for (level = 0; level < TIMER_LEVELS; level++) {
+		if (tw->tw_count[level] > 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Put a timer in the right slot for its expiry time.
+ */
+static
+void
+timerwheel_add(struct timerwheel *tw, struct timer *t)
+{
+	uint64_t when, delta;
+	unsigned level, slot;
+
+	when = t->tm_expires >> TIMER_RESSHIFT;
+	if (when < tw->tw_now) {
+		/* Overdue; goes in the current slot. */
+		when = tw->tw_now;
+	}
+	delta = when - tw->tw_now;
+	if (delta >= LEVELSPAN(TIMER_LEVELS)) {
+		/* Too far out; park it at the far end. */
+		when = tw->tw_now + LEVELSPAN(TIMER_LEVELS) - 1;
+		delta = when - tw->tw_now;
+	}
+
+	for (level = 0; level < TIMER_LEVELS - 1; level++) {
+		if (delta < LEVELSPAN(level + 1)) {
+			break;
+		}
+	}
+	slot = (when >> LEVELSHIFT(level)) & TIMER_SLOTMASK;
+
+	t->tm_level = level;
+	t->tm_next = tw->tw_slots[level][slot];
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = &t->tm_next;
+	}
+	t->tm_prevp = &tw->tw_slots[level][slot];
+	tw->tw_slots[level][slot] = t;
+	tw->tw_count[level]++;
+}
+
+/*
+ * Take a timer out of its slot.
+ */
+static
+void
+timerwheel_remove(struct timerwheel *tw, struct timer *t)
+{
+	KASSERT(t->tm_prevp != NULL);
+
+	*t->tm_prevp = t->tm_next;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = t->tm_prevp;
+	}
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+
+	KASSERT(tw->tw_count[t->tm_level] > 0);
+	tw->tw_count[t->tm_level]--;
+}
+
+/*
+ * Redistribute the timers in the current slot of level LEVEL.
+ */
+static
+void
+timerwheel_cascade(struct timerwheel *tw, unsigned level)
+{
+	struct timer *list, *t;
+	unsigned slot;
+
+	slot = (tw->tw_now >> LEVELSHIFT(level)) & TIMER_SLOTMASK;
+	list = tw->tw_slots[level][slot];
+	tw->tw_slots[level][slot] = NULL;
+
+	while ((t = list) != NULL) {
+		list = t->tm_next;
+		KASSERT(tw->tw_count[level] > 0);
+		tw->tw_count[level]--;
+		timerwheel_add(tw, t);
+	}
+}
+
+/*
+ * Advance the wheel's time towards TARGET, cascading as needed.
+ *
+ * If the lowest levels are empty, nothing can happen until the next
+ * boundary of the lowest level that isn't, so jump straight there.
+ * This keeps catching up after a long idle period cheap.
+ */
+static
+void
+timerwheel_step(struct timerwheel *tw, uint64_t target)
+{
+	unsigned level;
+	uint64_t next;
+
+	for (level = 0; level < TIMER_LEVELS; level++) {
+		if (tw->tw_count[level] > 0) {
+			break;
+		}
+	}
+	if (level == TIMER_LEVELS) {
+		tw->tw_now = target;
+		return;
+	}
+
+	next = (tw->tw_now | (LEVELSPAN(level) - 1)) + 1;
+	if (next > target) {
+		tw->tw_now = target;
+		return;
+	}
+	tw->tw_now = next;
+
+	/* Cascade from the top down, so timers can fall several levels. */
+	for (level = TIMER_LEVELS - 1; level > 0; level--) {
+		if ((next & (LEVELSPAN(level) - 1)) == 0) {
+			timerwheel_cascade(tw, level);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Wheel interface.
+
+void
+timerwheel_init(struct timerwheel *tw)
+{
+	unsigned level, slot;
+
+	spinlock_init(&tw->tw_lock);
+	tw->tw_now = 0;
+	for (level = 0; level < TIMER_LEVELS; level++) {
+		tw->tw_count[level] = 0;
+		for (slot = 0; slot < TIMER_SLOTS; slot++) {
+			tw->tw_slots[level][slot] = NULL;
+		}
+	}
+}
+
+/*
+ * Run all timers due at time NOW.
+ *
+ * The timer functions are called with tw_lock released, since they
+ * will generally want to wake threads up. Expired timers stay marked
+ * as belonging to this cpu (but off the wheel) until just before
+ * their function is called, so nobody can restart one while it's
+ * still linked on our private list.
+ */
+void
+timerwheel_run(struct timerwheel *tw, uint64_t now)
+{
+	struct timer *expired, *list, *t;
+	void (*func)(void *);
+	void *data;
+	uint64_t target;
+	unsigned slot;
+
+	expired = NULL;
+	target = now >> TIMER_RESSHIFT;
+
+	spinlock_acquire(&tw->tw_lock);
+	while (1) {
+		slot = tw->tw_now & TIMER_SLOTMASK;
+		list = tw->tw_slots[0][slot];
+		tw->tw_slots[0][slot] = NULL;
+		while ((t = list) != NULL) {
+			list = t->tm_next;
+			KASSERT(tw->tw_count[0] > 0);
+			tw->tw_count[0]--;
+			if (t->tm_expires <= now) {
+				t->tm_prevp = NULL;
+				t->tm_next = expired;
+				expired = t;
+			}
+			else {
+				/* Later in the current slot; put it back. */
+				timerwheel_add(tw, t);
+			}
+		}
+		if (tw->tw_now >= target) {
+			break;
+		}
+		timerwheel_step(tw, target);
+	}
+
+	while ((t = expired) != NULL) {
+		expired = t->tm_next;
+		t->tm_next = NULL;
+		func = t->tm_func;
+		data = t->tm_data;
+		t->tm_cpu = NULL;
+
+		/* T may be reused as soon as we unlock. */
+		spinlock_release(&tw->tw_lock);
+		func(data);
+		spinlock_acquire(&tw->tw_lock);
+	}
+	spinlock_release(&tw->tw_lock);
+}
+
+/*
+ * Work out when the wheel next needs running: the earliest timer in
+ * the first non-empty level 0 slot, or the next time a non-empty slot
+ * of a higher level is due to be cascaded, whichever comes first.
+ */
+uint64_t
+timerwheel_next(struct timerwheel *tw)
+{
+	struct timer *t;
+	uint64_t next, base, when;
+	unsigned level, slot, i;
+
+	next = TIMER_NEVER;
+
+	spinlock_acquire(&tw->tw_lock);
+	if (tw->tw_count[0] > 0) {
+		for (i = 0; i < TIMER_SLOTS && next == TIMER_NEVER; i++) {
+			slot = (tw->tw_now + i) & TIMER_SLOTMASK;
+			for (t = tw->tw_slots[0][slot]; t != NULL;
+			     t = t->tm_next) {
+				if (t->tm_expires < next) {
+					next = t->tm_expires;
+				}
+			}
+		}
+	}
+	for (level = 1; level < TIMER_LEVELS; level++) {
+		if (tw->tw_count[level] == 0) {
+			continue;
+		}
+		base = tw->tw_now >> LEVELSHIFT(level);
+		for (i = 1; i <= TIMER_SLOTS; i++) {
+			slot = (base + i) & TIMER_SLOTMASK;
+			if (tw->tw_slots[level][slot] != NULL) {
+				when = (base + i) <<
+					(LEVELSHIFT(level) + TIMER_RESSHIFT);
+				if (when < next) {
+					next = when;
+				}
+				break;
+			}
+		}
+	}
+	spinlock_release(&tw->tw_lock);
+
+	return next;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timers.
+
+void
+timer_init(struct timer *t, void (*func)(void *), void *data)
+{
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+	t->tm_expires = TIMER_NEVER;
+	t->tm_func = func;
+	t->tm_data = data;
+	t->tm_cpu = NULL;
+	t->tm_level = 0;
+}
+
+/*
+ * Start a timer on the current cpu. Interrupts are kept off
+ * throughout so we can't get moved to another cpu between putting
+ * the timer on the wheel and reprogramming the hardware.
+ */
+void
+timer_start(struct timer *t, uint64_t when)
+{
+	struct timerwheel *tw;
+	int spl;
+
+	KASSERT(t->tm_func != NULL);
+	KASSERT(t->tm_cpu == NULL);
+
+	spl = splhigh();
+
+	tw = &curcpu->c_timers;
+	spinlock_acquire(&tw->tw_lock);
+
+	/*
+	 * If the wheel is empty, its time doesn't matter; move it up
+	 * to here so we don't have to step through all the empty
+	 * slots in between later. (It's fine for the wheel to be
+	 * ahead of the real time; anything earlier is treated as
+	 * overdue and goes in the current slot, where the exact
+	 * expiry times are still checked.)
+	 */
+	if (timerwheel_isempty(tw)) {
+		tw->tw_now = when >> TIMER_RESSHIFT;
+	}
+
+	t->tm_expires = when;
+	t->tm_cpu = curcpu->c_self;
+	timerwheel_add(tw, t);
+	spinlock_release(&tw->tw_lock);
+
+	clock_reprogram(when);
+
+	splx(spl);
+}
+
+/*
+ * Cancel a timer. A timer can't change cpus while pending, so if it
+ * is still on the same cpu once we have that cpu's wheel locked, it
+ * is still pending there. One that has been pulled off the wheel to
+ * go off (tm_prevp is NULL) is left alone.
+ */
+bool
+timer_cancel(struct timer *t)
+{
+	struct cpu *c;
+	struct timerwheel *tw;
+	bool ret;
+
+	c = t->tm_cpu;
+	if (c == NULL) {
+		return false;
+	}
+	tw = &c->c_timers;
+
+	spinlock_acquire(&tw->tw_lock);
+	if (t->tm_cpu == c && t->tm_prevp != NULL) {
+		timerwheel_remove(tw, t);
+		t->tm_cpu = NULL;
+		ret = true;
+	}
+	else {
+		ret = false;
+	}
+	spinlock_release(&tw->tw_lock);
+
+	return ret;
+}
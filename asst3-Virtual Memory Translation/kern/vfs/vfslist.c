@@ -43,6 +43,7 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include <addrspace.h>
 
 /*
  * Structure for a single named device.
@@ -640,6 +641,9 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
+	/* The exec cache holds vnodes; let go of them */
+	loadelf_flush();
+
 	vfs_biglock_acquire();
 
 	result = findmount(devname, &kd);
@@ -724,6 +728,9 @@ vfs_unmountall(void)
 	unsigned i, num;
 	int result;
 
+	/* The exec cache holds vnodes; let go of them */
+	loadelf_flush();
+
 	vfs_biglock_acquire();
 
 	num = knowndevarray_num(knowndevs);
@@ -33,6 +33,8 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <atomic.h>
+#include <membar.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
@@ -48,8 +50,9 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	KASSERT(ops != NULL);
 
 	vn->vn_ops = ops;
-	vn->vn_refcount = 1;
-	spinlock_init(&vn->vn_countlock);
+	refcount_init(&vn->vn_refcount, 1);
+	vn->vn_writers = 0;
+	vn->vn_writegen = 0;
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
 	return 0;
@@ -61,12 +64,10 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 void
 vnode_cleanup(struct vnode *vn)
 {
-	KASSERT(vn->vn_refcount == 1);
-
-	spinlock_cleanup(&vn->vn_countlock);
+	KASSERT(refcount_get(&vn->vn_refcount) == 1);
 
 	vn->vn_ops = NULL;
-	vn->vn_refcount = 0;
+	refcount_init(&vn->vn_refcount, 0);
 	vn->vn_fs = NULL;
 	vn->vn_data = NULL;
 }
@@ -81,9 +82,7 @@ vnode_incref(struct vnode *vn)
 {
 	KASSERT(vn != NULL);
 
-	spinlock_acquire(&vn->vn_countlock);
-	vn->vn_refcount++;
-	spinlock_release(&vn->vn_countlock);
+	refcount_inc(&vn->vn_refcount);
 }
 
 /*
@@ -94,34 +93,119 @@ vnode_incref(struct vnode *vn)
 void
 vnode_decref(struct vnode *vn)
 {
-	bool destroy;
 	int result;
 
 	KASSERT(vn != NULL);
 
-	spinlock_acquire(&vn->vn_countlock);
-
-	KASSERT(vn->vn_refcount > 0);
-	if (vn->vn_refcount > 1) {
-		vn->vn_refcount--;
-		destroy = false;
+	if (refcount_dec_unless_last(&vn->vn_refcount)) {
+		return;
 	}
-	else {
-		/* Don't decrement; pass the reference to VOP_RECLAIM. */
-		destroy = true;
-	}
-	spinlock_release(&vn->vn_countlock);
-
-	if (destroy) {
-		result = VOP_RECLAIM(vn);
-		if (result != 0 && result != EBUSY) {
-			// XXX: lame.
-			kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
-				strerror(result));
-		}
+
+	/*
+	 * Don't decrement; pass the reference to VOP_RECLAIM, which
+	 * must check again (with refcount_dec_unless_last) under
+	 * whatever lock its fs uses to hand out new references.
+	 */
+	result = VOP_RECLAIM(vn);
+	if (result != 0 && result != EBUSY) {
+		// XXX: lame.
+		kprintf("vfs: Warning: VOP_RECLAIM: %s\n",
+			strerror(result));
 	}
 }
 
+/*
+ * Write tracking, for caches of things read from files (see
+ * loadelf.c).
+ *
+ * vn_writers counts the writes and truncates in progress, and
+ * vn_writegen is bumped when each one finishes. A reader that sees no
+ * writers and the generation it started with afterwards can't have
+ * raced with one. A single counter bumped before and after, seqlock
+ * style, isn't enough: two overlapping writes would leave it even.
+ *
+ * The barriers order the counters against the filesystem's accesses
+ * to the file and against each other: a writer is counted before it
+ * touches the file, and bumps the generation before it stops being
+ * counted.
+ */
+static
+void
+vnode_startwrite(struct vnode *vn)
+{
+	atomic_add(&vn->vn_writers, 1);
+	membar_any_any();
+}
+
+static
+void
+vnode_endwrite(struct vnode *vn)
+{
+	membar_any_any();
+	atomic_add(&vn->vn_writegen, 1);
+	membar_any_any();
+	atomic_add(&vn->vn_writers, (unsigned)-1);
+}
+
+/*
+ * VOP_WRITE.
+ */
+int
+vnode_write(struct vnode *vn, struct uio *uio)
+{
+	int result;
+
+	KASSERT(vn != NULL);
+
+	vnode_startwrite(vn);
+	result = __VOP(vn, write)(vn, uio);
+	vnode_endwrite(vn);
+	return result;
+}
+
+/*
+ * VOP_TRUNCATE.
+ */
+int
+vnode_truncate(struct vnode *vn, off_t pos)
+{
+	int result;
+
+	KASSERT(vn != NULL);
+
+	vnode_startwrite(vn);
+	result = __VOP(vn, truncate)(vn, pos);
+	vnode_endwrite(vn);
+	return result;
+}
+
+/*
+ * Get the generation to check against later, before reading.
+ */
+unsigned
+vnode_writegen(struct vnode *vn)
+{
+	unsigned gen;
+
+	gen = vn->vn_writegen;
+	membar_any_any();
+	return gen;
+}
+
+/*
+ * Check that nothing has written VN since vnode_writegen returned GEN.
+ */
+bool
+vnode_unchanged(struct vnode *vn, unsigned gen)
+{
+	unsigned writers;
+
+	membar_any_any();
+	writers = vn->vn_writers;
+	membar_any_any();
+	return writers == 0 && vn->vn_writegen == gen;
+}
+
 /*
  * Check for various things being valid.
  * Called before all VOP_* calls.
@@ -129,6 +213,8 @@ vnode_decref(struct vnode *vn)
 void
 vnode_check(struct vnode *v, const char *opstr)
 {
+	unsigned refcount;
+
 	/* not safe, and not really needed to check constant fields */
 	/*vfs_biglock_acquire();*/
 
@@ -159,20 +245,17 @@ vnode_check(struct vnode *v, const char *opstr)
 		panic("vnode_check: vop_%s: deadbeef fs pointer\n", opstr);
 	}
 
-	spinlock_acquire(&v->vn_countlock);
-
-	if (v->vn_refcount < 0) {
+	refcount = refcount_get(&v->vn_refcount);
+	if ((int)refcount < 0) {
 		panic("vnode_check: vop_%s: negative refcount %d\n", opstr,
-		      v->vn_refcount);
+		      (int)refcount);
 	}
-	else if (v->vn_refcount == 0) {
+	else if (refcount == 0) {
 		panic("vnode_check: vop_%s: zero refcount\n", opstr);
 	}
-	else if (v->vn_refcount > 0x100000) {
-		kprintf("vnode_check: vop_%s: warning: large refcount %d\n",
-			opstr, v->vn_refcount);
+	else if (refcount > 0x100000) {
+		kprintf("vnode_check: vop_%s: warning: large refcount %u\n",
+			opstr, refcount);
 	}
-
-	spinlock_release(&v->vn_countlock);
 	/*vfs_biglock_release();*/
 }
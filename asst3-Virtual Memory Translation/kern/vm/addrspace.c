@@ -37,6 +37,7 @@
 #include <addrspace.h>
 #include <vm.h>
 #include <proc.h>
+#include <userinfo.h>
 
 #include <elf.h>
 
@@ -50,6 +51,50 @@
  *
  */
 
+static
+void
+as_shared_free(struct as_shared *sh)
+{
+    size_t i;
+
+    for (i = 0; i < sh->sh_npages; i++) {
+        if (sh->sh_pages[i] != 0) {
+            free_kpages(PADDR_TO_KVADDR(sh->sh_pages[i]));
+        }
+    }
+    kfree(sh->sh_pages);
+    kfree(sh);
+}
+
+static
+void
+as_shared_release(struct as_shared *sh)
+{
+    if (refcount_dec(&sh->sh_refcount)) {
+        as_shared_free(sh);
+    }
+}
+
+/*
+ * Find the page table entry for VADDR, or NULL if there's no level 3
+ * table for it yet. Indexes the same way as vm_fault.
+ */
+static
+paddr_t *
+as_pte(struct addrspace *as, vaddr_t vaddr)
+{
+    paddr_t index = KVADDR_TO_PADDR(vaddr);
+    uint32_t lv1_index = index >> 24;
+    uint32_t lv2_index = (index << 8) >> 26;
+    uint32_t lv3_index = (index << 14) >> 26;
+
+    if (as->pagetable[lv1_index] == NULL ||
+        as->pagetable[lv1_index][lv2_index] == NULL) {
+        return NULL;
+    }
+    return &as->pagetable[lv1_index][lv2_index][lv3_index];
+}
+
 struct addrspace *
 as_create(void)
 {
@@ -76,6 +121,17 @@ as_create(void)
     for(int i = 0; i < FIRST_LEVEL; i++){
         as->pagetable[i] = NULL;
     }
+    // the pid page; vm_fault maps it read-only
+    vaddr_t v_page = alloc_kpages(1);
+    if (v_page == 0) {
+        kfree(as->pagetable);
+        kfree(as);
+        return NULL;
+    }
+    bzero((void *)v_page, PAGE_SIZE);
+    as->as_procinfo = KVADDR_TO_PADDR(v_page);
+    // shared regions go below the user info pages
+    as->as_mmaptop = USERINFO_GLOBAL;
 
     return as;
 }
@@ -118,6 +174,18 @@ as_copy(struct addrspace *old, struct addrspace **ret)
                     newas->pagetable[lv1_index][lv2_index][lv3_index] = 0;
                     continue;
                 }
+                // Pid page: the new one gets its own, from as_create
+                if ((old->pagetable[lv1_index][lv2_index][lv3_index] & PAGE_FRAME) ==
+                    old->as_procinfo) {
+                    newas->pagetable[lv1_index][lv2_index][lv3_index] = 0;
+                    continue;
+                }
+                // Shared page: map the same frame
+                if (old->pagetable[lv1_index][lv2_index][lv3_index] & PTE_SHARED) {
+                    newas->pagetable[lv1_index][lv2_index][lv3_index] =
+                        old->pagetable[lv1_index][lv2_index][lv3_index];
+                    continue;
+                }
                 // LV3 old page exists
                 int dirty = old->pagetable[lv1_index][lv2_index][lv3_index] & TLBLO_DIRTY;
                 vaddr_t v_page = alloc_kpages(1);
@@ -148,6 +216,10 @@ as_copy(struct addrspace *old, struct addrspace **ret)
         segment->npage = old_seg->npage;
         segment->mode = old_seg->mode;
         segment->prev_mode = old_seg->prev_mode;
+        segment->shared = old_seg->shared;
+        if (segment->shared != NULL) {
+            refcount_inc(&segment->shared->sh_refcount);
+        }
         segment->next = NULL;
         if (new_seg == NULL) {
             // First node
@@ -159,6 +231,7 @@ as_copy(struct addrspace *old, struct addrspace **ret)
         // keep new_seg the last node in the list
         new_seg = segment;
     }
+    newas->as_mmaptop = old->as_mmaptop;
     *ret = newas;
     return 0;
 }
@@ -182,7 +255,8 @@ as_destroy(struct addrspace *as)
                 if (as->pagetable[i][j] != NULL) {
                     //level 3
                     for (k = 0; k < THIRD_LEVEL; k++) {
-                        if (as->pagetable[i][j][k] != 0) {
+                        if (as->pagetable[i][j][k] != 0 &&
+                            !(as->pagetable[i][j][k] & PTE_SHARED)) {
                             free_kpages(PADDR_TO_KVADDR(as->pagetable[i][j][k] & PAGE_FRAME));
                         }
                     }
@@ -193,12 +267,16 @@ as_destroy(struct addrspace *as)
         }
     }
     kfree(as->pagetable);
+    free_kpages(PADDR_TO_KVADDR(as->as_procinfo));
 
     // free segement
     struct as_segment *curr = as->as_segment;
     struct as_segment *next;
 	while (curr != NULL) {
 		next = curr->next;
+		if (curr->shared != NULL) {
+			as_shared_release(curr->shared);
+		}
 		kfree(curr);
 		curr = next;
 	}
@@ -274,6 +352,7 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
     segment->npage = npage;
     segment->mode = writeable;
     segment->prev_mode = segment->mode;
+    segment->shared = NULL;
     segment->next = NULL;
     //add region to addrsapce
     if (as->as_segment != NULL) {
@@ -340,3 +419,148 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
     return 0;
 }
 
+
+int
+as_define_shared(struct addrspace *as, size_t sz, int writeable, vaddr_t *ret)
+{
+    struct as_segment *segment, *curr;
+    struct as_shared *sh;
+    size_t npage, i;
+    vaddr_t vbase, v_page;
+
+    npage = ROUNDUP(sz, PAGE_SIZE) / PAGE_SIZE;
+    if (npage == 0) {
+        return EINVAL;
+    }
+    if (npage > as->as_mmaptop / PAGE_SIZE) {
+        return ENOMEM;
+    }
+    vbase = as->as_mmaptop - npage * PAGE_SIZE;
+
+    // Must not run into any other region
+    for (curr = as->as_segment; curr != NULL; curr = curr->next) {
+        if (vbase < curr->vbase + curr->npage * PAGE_SIZE &&
+            curr->vbase < as->as_mmaptop) {
+            return ENOMEM;
+        }
+    }
+
+    sh = kmalloc(sizeof(struct as_shared));
+    if (sh == NULL) {
+        return ENOMEM;
+    }
+    refcount_init(&sh->sh_refcount, 1);
+    sh->sh_npages = npage;
+    sh->sh_pages = kmalloc(npage * sizeof(paddr_t));
+    if (sh->sh_pages == NULL) {
+        kfree(sh);
+        return ENOMEM;
+    }
+    for (i = 0; i < npage; i++) {
+        sh->sh_pages[i] = 0;
+    }
+    // Allocate the frames now, so every sharer sees the same ones
+    for (i = 0; i < npage; i++) {
+        v_page = alloc_kpages(1);
+        if (v_page == 0) {
+            as_shared_free(sh);
+            return ENOMEM;
+        }
+        bzero((void *)v_page, PAGE_SIZE);
+        sh->sh_pages[i] = KVADDR_TO_PADDR(v_page) & PAGE_FRAME;
+    }
+
+    segment = kmalloc(sizeof(struct as_segment));
+    if (segment == NULL) {
+        as_shared_free(sh);
+        return ENOMEM;
+    }
+    segment->vbase = vbase;
+    segment->npage = npage;
+    segment->mode = writeable;
+    segment->prev_mode = segment->mode;
+    segment->shared = sh;
+    segment->next = as->as_segment;
+    as->as_segment = segment;
+
+    as->as_mmaptop = vbase;
+    *ret = vbase;
+    return 0;
+}
+
+int
+as_translate(struct addrspace *as, vaddr_t vaddr, paddr_t *ret)
+{
+    paddr_t *pte;
+
+    if (as == NULL || vaddr >= USERSPACETOP) {
+        return EFAULT;
+    }
+    pte = as_pte(as, vaddr);
+    if (pte == NULL || *pte == 0) {
+        return EFAULT;
+    }
+    *ret = (*pte & PAGE_FRAME) | (vaddr & ~(vaddr_t)PAGE_FRAME);
+    return 0;
+}
+
+/*
+ * Install KPAGE as VADDR's page. Like vm_fault but without the fault:
+ * the frame is already there, so just make the page table entry.
+ */
+int
+as_placepage(struct addrspace *as, vaddr_t vaddr, vaddr_t kpage)
+{
+    struct as_segment *seg;
+    paddr_t index = KVADDR_TO_PADDR(vaddr);
+    uint32_t lv1_index = index >> 24;
+    uint32_t lv2_index = (index << 8) >> 26;
+    uint32_t lv3_index = (index << 14) >> 26;
+
+    KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+    for (seg = as->as_segment; seg != NULL; seg = seg->next) {
+        if (vaddr >= seg->vbase &&
+            vaddr < seg->vbase + seg->npage * PAGE_SIZE) {
+            break;
+        }
+    }
+    if (seg == NULL || seg->shared != NULL || !seg->mode) {
+        return EFAULT;
+    }
+
+    if (as->pagetable[lv1_index] == NULL) {
+        as->pagetable[lv1_index] = kmalloc(sizeof(paddr_t *) * SECOND_LEVEL);
+        if (as->pagetable[lv1_index] == NULL) {
+            return ENOMEM;
+        }
+        for (int i = 0; i < SECOND_LEVEL; i++) {
+            as->pagetable[lv1_index][i] = NULL;
+        }
+    }
+    if (as->pagetable[lv1_index][lv2_index] == NULL) {
+        // An empty LV1 table is harmless; as_destroy frees it
+        as->pagetable[lv1_index][lv2_index] = kmalloc(sizeof(paddr_t) * THIRD_LEVEL);
+        if (as->pagetable[lv1_index][lv2_index] == NULL) {
+            return ENOMEM;
+        }
+        for (int j = 0; j < THIRD_LEVEL; j++) {
+            as->pagetable[lv1_index][lv2_index][j] = 0;
+        }
+    }
+    KASSERT(as->pagetable[lv1_index][lv2_index][lv3_index] == 0);
+
+    // Never in the TLB, since it wasn't mapped, so no flush needed
+    as->pagetable[lv1_index][lv2_index][lv3_index] =
+        (KVADDR_TO_PADDR(kpage) & PAGE_FRAME) | TLBLO_DIRTY | TLBLO_VALID;
+    return 0;
+}
+
+void
+as_setpid(struct addrspace *as, pid_t pid)
+{
+    struct userinfo_proc *up;
+
+    up = (struct userinfo_proc *)PADDR_TO_KVADDR(as->as_procinfo);
+    up->up_pid = pid;
+}
@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <endian.h>
 #include <lib.h>
 #include <setjmp.h>
 #include <thread.h>
@@ -142,11 +143,101 @@ copycheck(const_userptr_t userptr, size_t len, size_t *stoplen)
 	return 0;
 }
 
+/*
+ * Word-at-a-time copying.
+ *
+ * memcpy only copies by words when both pointers and the length are
+ * all word-aligned, and user buffers (and lengths) often aren't. So
+ * copyin and copyout use copymem, which copies bytes up to a word
+ * boundary in the destination, then whole words, then whatever odd
+ * bytes are left. If the source is aligned differently from the
+ * destination, each word is put together from the two aligned source
+ * words it straddles.
+ *
+ * Every source word read contains at least one byte that's part of
+ * the copy, so no page outside the buffer is ever touched. This
+ * matters because one side is user memory.
+ */
+
+#define WORD_SIZE	sizeof(uint32_t)
+#define WORD_ALIGNED(p)	((uintptr_t)(p) % WORD_SIZE == 0)
+
+/* Nonzero if any byte of W is zero. */
+#define WORD_HASZERO(w)	(((w) - 0x01010101U) & ~(w) & 0x80808080U)
+
+#if _BYTE_ORDER == _BIG_ENDIAN
+/* The first byte in memory is the most significant. */
+#define WORD_MERGE(cur, next, off) \
+	(((cur) << (8 * (off))) | ((next) >> (8 * (WORD_SIZE - (off)))))
+#define WORD_BYTE(w, i)	((char)((w) >> (8 * (WORD_SIZE - 1 - (i)))))
+#else
+#define WORD_MERGE(cur, next, off) \
+	(((cur) >> (8 * (off))) | ((next) << (8 * (WORD_SIZE - (off)))))
+#define WORD_BYTE(w, i)	((char)((w) >> (8 * (i))))
+#endif
+
+static
+void
+copymem(void *dest, const void *src, size_t len)
+{
+	char *d = dest;
+	const char *s = src;
+	uint32_t *dw;
+	const uint32_t *sw;
+	uint32_t cur, next;
+	unsigned off;
+
+	/* Bytes until the destination is aligned. */
+	while (len > 0 && !WORD_ALIGNED(d)) {
+		*d++ = *s++;
+		len--;
+	}
+
+	dw = (uint32_t *)d;
+	off = (uintptr_t)s % WORD_SIZE;
+	if (off == 0) {
+		sw = (const uint32_t *)s;
+		while (len >= 4 * WORD_SIZE) {
+			dw[0] = sw[0];
+			dw[1] = sw[1];
+			dw[2] = sw[2];
+			dw[3] = sw[3];
+			dw += 4;
+			sw += 4;
+			len -= 4 * WORD_SIZE;
+		}
+		while (len >= WORD_SIZE) {
+			*dw++ = *sw++;
+			len -= WORD_SIZE;
+		}
+		s = (const char *)sw;
+	}
+	else if (len >= WORD_SIZE) {
+		sw = (const uint32_t *)(s - off);
+		cur = *sw++;
+		while (len >= WORD_SIZE) {
+			next = *sw++;
+			*dw++ = WORD_MERGE(cur, next, off);
+			cur = next;
+			len -= WORD_SIZE;
+		}
+		/* sw is one word past the last source word used */
+		s = (const char *)(sw - 1) + off;
+	}
+	d = (char *)dw;
+
+	/* The odd bytes at the end. */
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
+	}
+}
+
 /*
  * copyin
  *
  * Copy a block of memory of length LEN from user-level address USERSRC
- * to kernel address DEST. We can use memcpy because it's protected by
+ * to kernel address DEST. We can use copymem because it's protected by
  * the tm_badfaultfunc/copyfail logic.
  */
 int
@@ -172,7 +263,7 @@ copyin(const_userptr_t usersrc, void *dest, size_t len)
 		return EFAULT;
 	}
 
-	memcpy(dest, (const void *)usersrc, len);
+	copymem(dest, (const void *)usersrc, len);
 
 	curthread->t_machdep.tm_badfaultfunc = NULL;
 	return 0;
@@ -182,7 +273,7 @@ copyin(const_userptr_t usersrc, void *dest, size_t len)
  * copyout
  *
  * Copy a block of memory of length LEN from kernel address SRC to
- * user-level address USERDEST. We can use memcpy because it's
+ * user-level address USERDEST. We can use copymem because it's
  * protected by the tm_badfaultfunc/copyfail logic.
  */
 int
@@ -208,7 +299,7 @@ copyout(const void *src, userptr_t userdest, size_t len)
 		return EFAULT;
 	}
 
-	memcpy((void *)userdest, src, len);
+	copymem((void *)userdest, src, len);
 
 	curthread->t_machdep.tm_badfaultfunc = NULL;
 	return 0;
@@ -235,16 +326,45 @@ int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
-
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	size_t i, limit;
+	uint32_t w;
+
+	limit = maxlen < stoplen ? maxlen : stoplen;
+
+	/*
+	 * Whenever SRC + i is aligned and a whole word fits, look at a
+	 * word at a time, and only go byte by byte through a word that
+	 * has the null in it. Reading the whole of the word with the
+	 * null in it is safe: it's all on the same page. The bytes are
+	 * stored from W, not read again, in case they're changing
+	 * under us.
+	 */
+	i = 0;
+	while (i < limit) {
+		if (WORD_ALIGNED(src + i) && limit - i >= WORD_SIZE) {
+			w = *(const uint32_t *)(src + i);
+			if (!WORD_HASZERO(w)) {
+				if (WORD_ALIGNED(dest + i)) {
+					*(uint32_t *)(dest + i) = w;
+				}
+				else {
+					dest[i] = WORD_BYTE(w, 0);
+					dest[i+1] = WORD_BYTE(w, 1);
+					dest[i+2] = WORD_BYTE(w, 2);
+					dest[i+3] = WORD_BYTE(w, 3);
+				}
+				i += WORD_SIZE;
+				continue;
+			}
+		}
 		dest[i] = src[i];
-		if (src[i] == 0) {
+		if (dest[i] == 0) {
 			if (gotlen != NULL) {
 				*gotlen = i+1;
 			}
 			return 0;
 		}
+		i++;
 	}
 	if (stoplen < maxlen) {
 		/* ran into user-kernel boundary */
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * The global user info page.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <cpu.h>
+#include <vm.h>
+#include <userinfo.h>
+
+static struct userinfo *userinfo;
+static struct spinlock userinfo_lock;
+static uint64_t userinfo_last;		/* NOW of the last update */
+
+void
+userinfo_bootstrap(void)
+{
+	vaddr_t page;
+
+	spinlock_init(&userinfo_lock);
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		panic("userinfo_bootstrap: Out of memory\n");
+	}
+	bzero((void *)page, PAGE_SIZE);
+
+	userinfo = (struct userinfo *)page;
+	userinfo->ui_ncpu = cpu_count();
+	userinfo_last = 0;
+}
+
+/*
+ * Every cpu that isn't idle calls this on each tick, so updates can
+ * arrive out of order; just drop the stale ones.
+ */
+void
+userinfo_settime(uint64_t now)
+{
+	if (userinfo == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&userinfo_lock);
+	if (now > userinfo_last) {
+		userinfo_last = now;
+		userinfo->ui_seq++;
+		membar_store_store();
+		userinfo->ui_sec = now / 1000000000ULL;
+		userinfo->ui_nsec = now % 1000000000ULL;
+		membar_store_store();
+		userinfo->ui_seq++;
+	}
+	spinlock_release(&userinfo_lock);
+}
+
+paddr_t
+userinfo_frame(void)
+{
+	KASSERT(userinfo != NULL);
+	return KVADDR_TO_PADDR((vaddr_t)userinfo);
+}
@@ -11,6 +11,7 @@
 #include <spinlock.h>
 #include <proc.h>
 #include <current.h>
+#include <userinfo.h>
 /* Place your page table functions here */
 
 
@@ -21,6 +22,10 @@ void vm_bootstrap(void)
      * You may or may not need to add anything here depending what's
      * provided or required by the assignment spec.
      */
+
+    /* The user info pages must sit right below the stack */
+    KASSERT(USERINFO_GLOBAL + PAGE_SIZE == USERINFO_PROC);
+    KASSERT(USERINFO_PROC + PAGE_SIZE == USERSTACK - STACK_PAGES * PAGE_SIZE);
 }
 
 int
@@ -44,6 +49,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     uint32_t lv2_index = (paddr << 8) >> 26;
     uint32_t lv3_index = (paddr << 14) >> 26;
     int dirty = 0;
+    paddr_t infoframe = 0;
     if (curproc == NULL) {
         /*
          * No process. This is probably a kernel fault early
@@ -72,7 +78,15 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     }
     // If virtual address legal
     bool found = false;
-    while (current_seg != NULL) {
+    // The user info pages are read-only and in no segment
+    if ((faultaddress & PAGE_FRAME) == USERINFO_GLOBAL) {
+        infoframe = userinfo_frame();
+        found = true;
+    } else if ((faultaddress & PAGE_FRAME) == USERINFO_PROC) {
+        infoframe = as->as_procinfo;
+        found = true;
+    }
+    while (!found && current_seg != NULL) {
         vaddr_t vbase = current_seg->vbase;
         vaddr_t vtop = vbase + current_seg->npage * PAGE_SIZE;
         if (faultaddress >= vbase && faultaddress < vtop) {
@@ -116,6 +130,20 @@ vm_fault(int faulttype, vaddr_t faultaddress)
             as->pagetable[lv1_index][lv2_index][j] = 0;
         }
     }
+    // User info page: map its frame, never dirty. PTE_SHARED keeps
+    // as_destroy from freeing it with the page table.
+    if (as->pagetable[lv1_index][lv2_index][lv3_index] == 0 &&
+        infoframe != 0) {
+        as->pagetable[lv1_index][lv2_index][lv3_index] =
+            infoframe | PTE_SHARED | TLBLO_VALID;
+    }
+    // Shared region: use the region's frame
+    if (as->pagetable[lv1_index][lv2_index][lv3_index] == 0 &&
+        current_seg->shared != NULL) {
+        size_t page = (faultaddress - current_seg->vbase) / PAGE_SIZE;
+        as->pagetable[lv1_index][lv2_index][lv3_index] =
+            current_seg->shared->sh_pages[page] | PTE_SHARED | dirty | TLBLO_VALID;
+    }
     // New page
     if (as->pagetable[lv1_index][lv2_index][lv3_index] == 0) {
         vaddr_t v_page = alloc_kpages(1);
@@ -132,7 +160,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
         as->pagetable[lv1_index][lv2_index][lv3_index] = (KVADDR_TO_PADDR(v_page) & PAGE_FRAME) | dirty | TLBLO_VALID;
     }
     uint32_t entryhi = faultaddress & PAGE_FRAME;
-    uint32_t entrylow = as->pagetable[lv1_index][lv2_index][lv3_index];
+    uint32_t entrylow = as->pagetable[lv1_index][lv2_index][lv3_index] & ~PTE_SHARED;
     int spl = splhigh();
     // Randomly add pagetable entry to the TLB.
     tlb_random(entryhi, entrylow);
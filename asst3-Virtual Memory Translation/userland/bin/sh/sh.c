@@ -371,7 +371,7 @@ docommand(char *buf, struct exitinfo *ei)
 	char *s;
 	pid_t pid;
 	int status;
-	int bg=0;
+	volatile int bg=0;	/* live across vfork */
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
 
@@ -421,11 +421,15 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
+	/*
+	 * vfork, not fork: the child only execs or exits, so there's no
+	 * point copying our address space for it.
+	 */
+	pid = vfork();
 	switch (pid) {
 		case -1:
 			/* error */
-			warn("fork");
+			warn("vfork");
 			exitinfo_exit(ei, 255);
 			return;
 		case 0:
@@ -40,6 +40,7 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
@@ -65,6 +66,8 @@
  *     open:     fcntl.h or sys/fcntl.h
  *     reboot:   sys/reboot.h
  *     ioctl:    sys/ioctl.h
+ *     readv:    sys/uio.h
+ *     writev:   sys/uio.h
  *     remove:   stdio.h
  *     rename:   stdio.h
  *     time:     time.h
@@ -128,7 +131,7 @@ int sync(void);
 int rmdir(const char *dirname);
 
 /* Recommended. */
-pid_t getpid(void);
+pid_t __getpid(void);
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
 int fsync(int filehandle);
@@ -140,13 +143,45 @@ int link(const char *oldfile, const char *newfile);
 int chdir(const char *path);
 
 /* Optional. */
+/*
+ * vfork is fork without the copy: the child runs in the parent's
+ * memory, on the parent's stack, and the parent is suspended until
+ * the child calls execv or _exit, which are all it should do.
+ */
+pid_t vfork(void);
+/*
+ * __spawn starts a new process running PROG with ARGS, and returns
+ * its pid; it fails (and there is no new process) if PROG can't be
+ * loaded. The new process inherits file handles and the current
+ * directory as across fork.
+ */
+pid_t __spawn(const char *prog, char *const *args);
 void *sbrk(__intptr_t change);
 ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+/*
+ * sendfile copies up to COUNT bytes from INFD to OUTFD without passing
+ * them through user memory. If OFFSET is not NULL it reads from
+ * *OFFSET and updates it, leaving INFD's seek position alone.
+ */
+ssize_t sendfile(int outfd, int infd, off_t *offset, size_t count);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+/*
+ * futex_wait sleeps until futex_wake is called on ADDR, unless *ADDR
+ * is not VAL, in which case it fails at once with EAGAIN. futex_wake
+ * wakes up to N waiters and returns how many it woke. ADDR may be in
+ * memory shared between processes by mmap.
+ */
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int n);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -156,12 +191,27 @@ ssize_t __getcwd(char *buf, size_t buflen);
  */
 
 int execvp(const char *prog, char *const *args); /* calls execv */
+/*
+ * posix_spawn calls __spawn. There are no file actions, attributes,
+ * or environment yet, so those must be NULL. Returns an error number
+ * rather than setting errno, as POSIX specifies.
+ */
+typedef struct __posix_spawn_file_actions posix_spawn_file_actions_t;
+typedef struct __posix_spawnattr posix_spawnattr_t;
+int posix_spawn(pid_t *pid, const char *prog,
+		const posix_spawn_file_actions_t *file_actions,
+		const posix_spawnattr_t *attr,
+		char *const *args, char *const *env);
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
-time_t time(time_t *seconds);			/* calls __time */
+pid_t getpid(void);				/* no system call */
+time_t time(time_t *seconds);			/* no system call */
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
  * You should implement this version as this is what we expect to test.
+ *
+ * With FD -1 (and OFFSET 0), mmap makes anonymous zero-filled memory
+ * that is shared with child processes forked afterwards.
  */
 
 #define PROT_READ 1
@@ -20,6 +20,12 @@ awk '
 	print $2, $3;
     }
 ' | awk '{
+	# getpid is a libc function that reads the user info page
+	# (see unix/getpid.c); the system call itself is __getpid.
+	if ($1 == "getpid") {
+		$1 = "__getpid";
+	}
+
 	# output something simple that will work in syscalls.S.
 	printf "SYSCALL(%s, %s)\n", $1, $2;
 }'
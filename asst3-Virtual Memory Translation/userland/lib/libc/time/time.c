@@ -28,15 +28,30 @@
  */
 
 #include <unistd.h>
+#include <kern/userinfo.h>
 
 /*
  * POSIX C function: retrieve time in seconds since the epoch.
- * Uses the OS/161 system call __time, which does the same thing
- * but also returns nanoseconds.
+ * Reads the clock the kernel keeps in the user info page (see
+ * <kern/userinfo.h>) instead of calling __time, which does the same
+ * thing but also returns nanoseconds and costs a system call.
  */
 
 time_t
 time(time_t *t)
 {
-	return __time(t, NULL);
+	volatile const struct userinfo *ui;
+	unsigned seq;
+	time_t now;
+
+	ui = (volatile const struct userinfo *)USERINFO_GLOBAL;
+	do {
+		seq = ui->ui_seq;
+		now = ui->ui_sec;
+	} while ((seq & 1) != 0 || seq != ui->ui_seq);
+
+	if (t != NULL) {
+		*t = now;
+	}
+	return now;
 }
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * POSIX C function: start a new process running PROG. This is one
+ * trip into the kernel, __spawn, instead of fork and execv, so
+ * nothing of the parent's address space gets copied or even looked
+ * at.
+ *
+ * OS/161 has no environment in the kernel, and __spawn takes neither
+ * file actions nor attributes, so those must all be NULL. Like the
+ * rest of posix_spawn*, this returns an error number instead of
+ * setting errno.
+ */
+int
+posix_spawn(pid_t *pid, const char *prog,
+	    const posix_spawn_file_actions_t *file_actions,
+	    const posix_spawnattr_t *attr,
+	    char *const *args, char *const *env)
+{
+	pid_t child;
+	int saveerrno, result;
+
+	if (file_actions != NULL || attr != NULL || env != NULL) {
+		return ENOSYS;
+	}
+
+	saveerrno = errno;
+	child = __spawn(prog, args);
+	if (child < 0) {
+		result = errno;
+		errno = saveerrno;
+		return result;
+	}
+	if (pid != NULL) {
+		*pid = child;
+	}
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * argbench - measure the cost of passing arguments through exec.
+ * usage: argbench [-n execs]
+ *
+ * For each of several argument lists, from none up to nearly ARG_MAX
+ * (the sizes bigexec checks), times a chain of EXECS execs of this
+ * program by itself, each passing the whole list on. The difference
+ * from the empty list is what exec pays to move the arguments.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <err.h>
+
+#define _PATH_MYSELF "/testbin/argbench"
+
+static const struct {
+	const char *name;
+	unsigned nwords;
+	unsigned wordlen;
+} sizes[] = {
+	{ "no args",       0,    0 },
+	{ "4K in 4",       4, 1000 },
+	{ "16K in 16",    16, 1000 },
+	{ "60K in 60",    60, 1000 },
+	{ "3000 words", 3000,    8 },
+};
+static const unsigned nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+static unsigned nexecs = 100;
+static char word[1001];
+static char countbuf[16];
+static char *args[3000 + 4];
+
+/*
+ * We were exec'd by ourselves: argv is "-r", the number of execs to
+ * go, and then the argument list. Pass it on until the count runs out.
+ */
+static
+void
+relay(int argc, char *argv[])
+{
+	unsigned left;
+
+	if (argc < 3) {
+		errx(1, "Bad relay args");
+	}
+	left = atoi(argv[2]);
+	if (left == 0) {
+		exit(0);
+	}
+	snprintf(countbuf, sizeof(countbuf), "%u", left - 1);
+	argv[2] = countbuf;
+	execv(_PATH_MYSELF, argv);
+	err(1, "%s", _PATH_MYSELF);
+}
+
+static
+void
+runsize(unsigned which)
+{
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	unsigned i, bytes;
+	pid_t pid;
+	int status;
+
+	memset(word, 'x', sizes[which].wordlen);
+	word[sizes[which].wordlen] = 0;
+
+	args[0] = (char *)_PATH_MYSELF;
+	args[1] = (char *)"-r";
+	snprintf(countbuf, sizeof(countbuf), "%u", nexecs);
+	args[2] = countbuf;
+	for (i=0; i<sizes[which].nwords; i++) {
+		args[3 + i] = word;
+	}
+	args[3 + i] = NULL;
+	bytes = sizes[which].nwords * (sizes[which].wordlen + 1);
+
+	__time(&secs1, &nsecs1);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(_PATH_MYSELF, args);
+		err(1, "%s", _PATH_MYSELF);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	__time(&secs2, &nsecs2);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s: exec chain failed", sizes[which].name);
+	}
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%-12s (%5u bytes): %u execs in %lu us, %lu us each\n",
+	       sizes[which].name, bytes, nexecs, usecs, usecs / nexecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+	int j;
+
+	if (argc > 1 && !strcmp(argv[1], "-r")) {
+		relay(argc, argv);
+	}
+
+	for (j=1; j<argc; j++) {
+		if (!strcmp(argv[j], "-n") && argv[j+1] != NULL) {
+			nexecs = atoi(argv[++j]);
+		}
+		else {
+			errx(1, "Usage: argbench [-n execs]");
+		}
+	}
+	if (nexecs == 0) {
+		errx(1, "Need at least one exec");
+	}
+
+	for (i=0; i<nsizes; i++) {
+		runsize(i);
+	}
+	return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * copybench - time copying a large file with read/write and with
+ * sendfile.
+ * usage: copybench [-k kbytes] [dir]
+ *
+ * Makes a KBYTES file in DIR (default the current directory), then
+ * copies it twice: once the way cp used to, with read and write
+ * through a 1K user buffer, and once with sendfile. Run it once on
+ * an emufs directory (e.g. emu0:) and once on an SFS volume to
+ * compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define BUFSIZE 1024
+
+static char buf[BUFSIZE];
+static char srcname[128], dstname[128];
+
+static
+int
+xopen(const char *name, int flags)
+{
+	int fd;
+
+	fd = open(name, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	return fd;
+}
+
+static
+void
+makesrc(unsigned kbytes)
+{
+	unsigned i, j;
+	int fd;
+
+	for (i=0; i<BUFSIZE; i++) {
+		buf[i] = 'a' + i % 26;
+	}
+	fd = xopen(srcname, O_WRONLY|O_CREAT|O_TRUNC);
+	for (i=0; i<kbytes; i++) {
+		for (j=0; j<BUFSIZE; j += BUFSIZE / 4) {
+			/* make each K a little different */
+			buf[j] = '0' + i % 10;
+		}
+		if (write(fd, buf, BUFSIZE) != BUFSIZE) {
+			err(1, "%s: write", srcname);
+		}
+	}
+	close(fd);
+}
+
+static
+void
+copy_rw(int infd, int outfd)
+{
+	int len, wr, wrtot;
+
+	while ((len = read(infd, buf, sizeof(buf))) > 0) {
+		wrtot = 0;
+		while (wrtot < len) {
+			wr = write(outfd, buf + wrtot, len - wrtot);
+			if (wr < 0) {
+				err(1, "%s: write", dstname);
+			}
+			wrtot += wr;
+		}
+	}
+	if (len < 0) {
+		err(1, "%s: read", srcname);
+	}
+}
+
+static
+void
+copy_sendfile(int infd, int outfd)
+{
+	int len;
+
+	while ((len = sendfile(outfd, infd, NULL, 1024*1024)) > 0) {
+		/* nothing */
+	}
+	if (len < 0) {
+		err(1, "sendfile");
+	}
+}
+
+static
+void
+timecopy(const char *what, void (*copyfn)(int, int), unsigned kbytes)
+{
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	int infd, outfd;
+
+	infd = xopen(srcname, O_RDONLY);
+	outfd = xopen(dstname, O_WRONLY|O_CREAT|O_TRUNC);
+
+	__time(&secs1, &nsecs1);
+	copyfn(infd, outfd);
+	if (fsync(outfd) < 0) {
+		err(1, "%s: fsync", dstname);
+	}
+	__time(&secs2, &nsecs2);
+
+	if (lseek(outfd, 0, SEEK_END) != (off_t)kbytes * BUFSIZE) {
+		errx(1, "%s: %s copied the wrong amount", dstname, what);
+	}
+	close(infd);
+	close(outfd);
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%-9s %u KB in %lu us (%lu KB/s)\n", what, kbytes, usecs,
+	       usecs == 0 ? 0 : (unsigned long)kbytes * 1000000 / usecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *dir = NULL;
+	unsigned kbytes = 1024;
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-k") && argv[i+1] != NULL) {
+			kbytes = atoi(argv[++i]);
+		}
+		else if (dir == NULL && argv[i][0] != '-') {
+			dir = argv[i];
+		}
+		else {
+			errx(1, "Usage: copybench [-k kbytes] [dir]");
+		}
+	}
+
+	if (dir == NULL) {
+		strcpy(srcname, "copybench.src");
+		strcpy(dstname, "copybench.dst");
+	}
+	else {
+		snprintf(srcname, sizeof(srcname), "%s/copybench.src", dir);
+		snprintf(dstname, sizeof(dstname), "%s/copybench.dst", dir);
+	}
+
+	makesrc(kbytes);
+	timecopy("read/write", copy_rw, kbytes);
+	timecopy("sendfile", copy_sendfile, kbytes);
+
+	remove(srcname);
+	remove(dstname);
+	return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * execcache - check that exec notices when a program file changes.
+ * usage: execcache [-n execs]
+ *
+ * The kernel remembers the headers of programs it has run, and must
+ * forget them when the file is written. This copies /bin/true to a
+ * scratch file and runs it (timing EXECS runs, which should mostly
+ * hit the cache), then breaks the ELF magic number in place and
+ * checks that exec now fails, then copies /bin/false over it in place
+ * and checks that it now exits 1.
+ *
+ * Needs a writable current directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define SCRATCH "execcache.prog"
+
+static unsigned nexecs = 100;
+
+/* vfork shares our memory, so the child can report errno here */
+static volatile int execerr;
+
+/*
+ * Copy FROM onto SCRATCH, truncating it but keeping the same file.
+ */
+static
+void
+copyfile(const char *from)
+{
+	char buf[4096];
+	int infd, outfd;
+	ssize_t len;
+
+	infd = open(from, O_RDONLY);
+	if (infd < 0) {
+		err(1, "%s", from);
+	}
+	outfd = open(SCRATCH, O_WRONLY|O_CREAT|O_TRUNC, 0755);
+	if (outfd < 0) {
+		err(1, "%s", SCRATCH);
+	}
+	while ((len = read(infd, buf, sizeof(buf))) > 0) {
+		if (write(outfd, buf, len) != len) {
+			err(1, "%s: write", SCRATCH);
+		}
+	}
+	if (len < 0) {
+		err(1, "%s: read", from);
+	}
+	close(infd);
+	close(outfd);
+}
+
+/*
+ * Run SCRATCH and return its exit code, or -1 with errno set if it
+ * couldn't be exec'd.
+ */
+static
+int
+run(void)
+{
+	char *args[2];
+	pid_t pid;
+	int status;
+
+	execerr = 0;
+
+	args[0] = (char *)SCRATCH;
+	args[1] = NULL;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		execv(SCRATCH, args);
+		execerr = errno;
+		_exit(255);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (execerr != 0) {
+		errno = execerr;
+		return -1;
+	}
+	if (!WIFEXITED(status)) {
+		errx(1, "%s: did not exit normally", SCRATCH);
+	}
+	return WEXITSTATUS(status);
+}
+
+static
+void
+timeruns(void)
+{
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	unsigned i;
+
+	__time(&secs1, &nsecs1);
+	for (i=0; i<nexecs; i++) {
+		if (run() != 0) {
+			errx(1, "%s: run %u failed", SCRATCH, i);
+		}
+	}
+	__time(&secs2, &nsecs2);
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%u runs of a copy of /bin/true in %lu us, %lu us each\n",
+	       nexecs, usecs, usecs / nexecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd, j, result;
+
+	for (j=1; j<argc; j++) {
+		if (!strcmp(argv[j], "-n") && argv[j+1] != NULL) {
+			nexecs = atoi(argv[++j]);
+		}
+		else {
+			errx(1, "Usage: execcache [-n execs]");
+		}
+	}
+	if (nexecs == 0) {
+		errx(1, "Need at least one exec");
+	}
+
+	copyfile("/bin/true");
+	timeruns();
+
+	/* Break the magic number; the cached headers must go. */
+	fd = open(SCRATCH, O_WRONLY);
+	if (fd < 0) {
+		err(1, "%s", SCRATCH);
+	}
+	if (write(fd, "X", 1) != 1) {
+		err(1, "%s: write", SCRATCH);
+	}
+	close(fd);
+	result = run();
+	if (result != -1 || errno != ENOEXEC) {
+		errx(1, "Broken %s ran anyway (result %d)", SCRATCH, result);
+	}
+	printf("Broken copy not run: passed\n");
+
+	/* Now a different program, in the same file. */
+	copyfile("/bin/false");
+	result = run();
+	if (result != 1) {
+		errx(1, "Expected /bin/false's status 1, got %d", result);
+	}
+	printf("Replaced copy run: passed\n");
+
+	remove(SCRATCH);
+	printf("execcache done.\n");
+	return 0;
+}
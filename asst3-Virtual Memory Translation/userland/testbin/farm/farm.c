@@ -38,6 +38,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
 static char *hargv[2] = { (char *)"hog", NULL };
@@ -50,19 +51,15 @@ static
 void
 spawnv(const char *prog, char **argv)
 {
-	int pid = fork();
-	switch (pid) {
-	    case -1:
-		err(1, "fork");
-	    case 0:
-		/* child */
-		execv(prog, argv);
+	pid_t pid;
+	int result;
+
+	result = posix_spawn(&pid, prog, NULL, NULL, argv, NULL);
+	if (result) {
+		errno = result;
 		err(1, "%s", prog);
-	    default:
-		/* parent */
-		pids[npids++] = pid;
-		break;
 	}
+	pids[npids++] = pid;
 }
 
 static
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * forkbench - measure the cost of fork.
+ * usage: forkbench [-f forks] [-d fds]
+ *
+ * Times FORKS fork/_exit/waitpid round trips, first with only the
+ * standard descriptors open and then with FDS more descriptors (all
+ * dups of one file) open, so the difference shows what fork pays per
+ * open file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+static unsigned nforks = 200;
+static unsigned nfds = 100;
+
+static
+void
+forkloop(unsigned fds)
+{
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	unsigned i;
+	pid_t pid;
+	int status;
+
+	__time(&secs1, &nsecs1);
+	for (i=0; i<nforks; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+	}
+	__time(&secs2, &nsecs2);
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%u extra fds: %u forks in %lu us, %lu us each\n",
+	       fds, nforks, usecs, usecs / nforks);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+	int fd, j;
+
+	for (j=1; j<argc; j++) {
+		if (!strcmp(argv[j], "-f") && argv[j+1] != NULL) {
+			nforks = atoi(argv[++j]);
+		}
+		else if (!strcmp(argv[j], "-d") && argv[j+1] != NULL) {
+			nfds = atoi(argv[++j]);
+		}
+		else {
+			errx(1, "Usage: forkbench [-f forks] [-d fds]");
+		}
+	}
+	if (nforks == 0) {
+		errx(1, "Need at least one fork");
+	}
+
+	forkloop(0);
+
+	fd = open("null:", O_RDWR);
+	if (fd < 0) {
+		err(1, "null:");
+	}
+	for (i=1; i<nfds; i++) {
+		if (dup2(fd, fd + i) < 0) {
+			err(1, "dup2 to %u", fd + i);
+		}
+	}
+
+	forkloop(nfds);
+
+	for (i=0; i<nfds; i++) {
+		close(fd + i);
+	}
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * infopage - check and time the user info page.
+ * usage: infopage [-n calls]
+ *
+ * Checks that getpid() and time(), which read the page, agree with
+ * the system calls __getpid() and __time(), in this process and in a
+ * forked child, and that the page can't be written. Then times CALLS
+ * calls of each, to show what skipping the trap saves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <kern/userinfo.h>
+
+static unsigned ncalls = 10000;
+
+static
+void
+check(const char *who)
+{
+	volatile const struct userinfo *ui;
+	time_t before, now, after;
+
+	if (getpid() != __getpid()) {
+		errx(1, "%s: getpid says %d, __getpid says %d", who,
+		     getpid(), __getpid());
+	}
+
+	/* the page is updated every tick, so allow a second of slop */
+	__time(&before, NULL);
+	now = time(NULL);
+	__time(&after, NULL);
+	if (now < before - 1 || now > after) {
+		errx(1, "%s: time says %ld, __time says %ld..%ld", who,
+		     (long)now, (long)before, (long)after);
+	}
+
+	ui = (volatile const struct userinfo *)USERINFO_GLOBAL;
+	if (ui->ui_ncpu == 0) {
+		errx(1, "%s: no cpus", who);
+	}
+	printf("%s: pid %d, time %ld, %u cpus\n", who, getpid(),
+	       (long)now, ui->ui_ncpu);
+}
+
+static
+void
+writer(void)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		/* should die here */
+		((struct userinfo_proc *)USERINFO_PROC)->up_pid = 1;
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFEXITED(status)) {
+		errx(1, "Writing the info page didn't fault");
+	}
+	if (getpid() != __getpid()) {
+		errx(1, "Our pid changed");
+	}
+}
+
+static
+void
+timeloop(const char *name, pid_t (*fn)(void))
+{
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	unsigned i;
+
+	__time(&secs1, &nsecs1);
+	for (i=0; i<ncalls; i++) {
+		(void)fn();
+	}
+	__time(&secs2, &nsecs2);
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%s: %u calls in %lu us\n", name, ncalls, usecs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	pid_t pid;
+	int j, status;
+
+	for (j=1; j<argc; j++) {
+		if (!strcmp(argv[j], "-n") && argv[j+1] != NULL) {
+			ncalls = atoi(argv[++j]);
+		}
+		else {
+			errx(1, "Usage: infopage [-n calls]");
+		}
+	}
+
+	check("parent");
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		check("child");
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "Child failed");
+	}
+
+	writer();
+
+	timeloop("__getpid", __getpid);
+	timeloop("getpid", getpid);
+	printf("Passed.\n");
+	return 0;
+}
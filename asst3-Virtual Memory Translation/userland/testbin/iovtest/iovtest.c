@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovtest - test readv, writev, pread, and pwrite.
+ * usage: iovtest [file]
+ *
+ * Writes a file in fragments with writev, reads it back scattered
+ * with readv, and checks that pread and pwrite work at the offsets
+ * they're given without moving the seek position.
+ */
+
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+static const char part1[] = "The quick ";
+static const char part2[] = "brown fox ";
+static const char part3[] = "jumps over the lazy dog.";
+
+static
+void
+checkpos(int fd, off_t expected)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "lseek");
+	}
+	if (pos != expected) {
+		errx(1, "Seek position is %ld, expected %ld",
+		     (long)pos, (long)expected);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *file = "testfile";
+	struct iovec iov[3];
+	char buf1[sizeof(part1) - 1], buf2[sizeof(part2) - 1];
+	char buf3[sizeof(part3) - 1];
+	char small[8];
+	size_t total;
+	ssize_t r;
+	int fd;
+
+	if (argc == 2) {
+		file = argv[1];
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: iovtest [file]");
+	}
+
+	total = strlen(part1) + strlen(part2) + strlen(part3);
+
+	fd = open(file, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", file);
+	}
+
+	/* writev: three fragments, one call */
+	iov[0].iov_base = (void *)part1;
+	iov[0].iov_len = strlen(part1);
+	iov[1].iov_base = (void *)part2;
+	iov[1].iov_len = strlen(part2);
+	iov[2].iov_base = (void *)part3;
+	iov[2].iov_len = strlen(part3);
+	r = writev(fd, iov, 3);
+	if (r < 0) {
+		err(1, "writev");
+	}
+	if ((size_t)r != total) {
+		errx(1, "writev: short count %ld", (long)r);
+	}
+	checkpos(fd, total);
+
+	/* pread in the middle doesn't move the seek position */
+	r = pread(fd, small, 5, strlen(part1));
+	if (r != 5) {
+		err(1, "pread");
+	}
+	if (memcmp(small, "brown", 5)) {
+		errx(1, "pread: wrong data");
+	}
+	checkpos(fd, total);
+
+	/* nor does pwrite */
+	r = pwrite(fd, "BROWN", 5, strlen(part1));
+	if (r != 5) {
+		err(1, "pwrite");
+	}
+	checkpos(fd, total);
+
+	/* readv it all back, scattered */
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	iov[0].iov_base = buf1;
+	iov[0].iov_len = sizeof(buf1);
+	iov[1].iov_base = buf2;
+	iov[1].iov_len = sizeof(buf2);
+	iov[2].iov_base = buf3;
+	iov[2].iov_len = sizeof(buf3);
+	r = readv(fd, iov, 3);
+	if (r < 0) {
+		err(1, "readv");
+	}
+	if ((size_t)r != total) {
+		errx(1, "readv: short count %ld", (long)r);
+	}
+	if (memcmp(buf1, part1, sizeof(buf1)) ||
+	    memcmp(buf2, "BROWN fox ", sizeof(buf2)) ||
+	    memcmp(buf3, part3, sizeof(buf3))) {
+		errx(1, "readv: wrong data");
+	}
+	checkpos(fd, total);
+
+	/* positioned I/O makes no sense on a console */
+	if (pread(STDIN_FILENO, small, 1, 0) >= 0) {
+		errx(1, "pread on console succeeded");
+	}
+
+	close(fd);
+	remove(file);
+	printf("Passed iovtest.\n");
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pidstorm - have lots of processes alive at once.
+ * usage: pidstorm [-n procs] [-r rounds]
+ *
+ * Each round forks PROCS children (more than the old limit of 128
+ * by default), which all wait on a futex until the last one exists,
+ * then exit with their index as status. The parent checks that the
+ * pids were all different and that waitpid returns each child's
+ * status, and reports how long the forks and the waits took.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define MAXPROCS 1000
+
+static unsigned nprocs = 200;
+static unsigned nrounds = 3;
+static pid_t pids[MAXPROCS];
+
+static
+unsigned long
+usecs_since(time_t secs1, unsigned long nsecs1)
+{
+	time_t secs2;
+	unsigned long nsecs2;
+
+	__time(&secs2, &nsecs2);
+	return (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+}
+
+static
+void
+storm(volatile int *go)
+{
+	time_t secs;
+	unsigned long nsecs, forkus, waitus;
+	unsigned i, j;
+	int status;
+
+	*go = 0;
+	__time(&secs, &nsecs);
+	for (i=0; i<nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork %u", i);
+		}
+		if (pids[i] == 0) {
+			while (*go == 0) {
+				futex_wait(go, 0);
+			}
+			_exit(i % 256);
+		}
+	}
+	forkus = usecs_since(secs, nsecs);
+
+	for (i=0; i<nprocs; i++) {
+		for (j=0; j<i; j++) {
+			if (pids[i] == pids[j]) {
+				errx(1, "Children %u and %u both got pid %d",
+				     j, i, pids[i]);
+			}
+		}
+	}
+
+	*go = 1;
+	futex_wake(go, nprocs);
+
+	__time(&secs, &nsecs);
+	/* backwards, so we don't just follow the exit order */
+	for (i=nprocs; i-- > 0; ) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid %d", pids[i]);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != (int)(i % 256)) {
+			errx(1, "Child %u (pid %d) had status %d", i, pids[i],
+			     status);
+		}
+	}
+	waitus = usecs_since(secs, nsecs);
+
+	printf("%u procs: forks %lu us, waits %lu us\n", nprocs, forkus, waitus);
+}
+
+int
+main(int argc, char *argv[])
+{
+	volatile int *go;
+	unsigned r;
+	int j;
+
+	for (j=1; j<argc; j++) {
+		if (!strcmp(argv[j], "-n") && argv[j+1] != NULL) {
+			nprocs = atoi(argv[++j]);
+		}
+		else if (!strcmp(argv[j], "-r") && argv[j+1] != NULL) {
+			nrounds = atoi(argv[++j]);
+		}
+		else {
+			errx(1, "Usage: pidstorm [-n procs] [-r rounds]");
+		}
+	}
+	if (nprocs == 0 || nprocs > MAXPROCS) {
+		errx(1, "Procs must be between 1 and %d", MAXPROCS);
+	}
+
+	go = mmap(sizeof(*go), PROT_READ|PROT_WRITE, -1, 0);
+	if (go == (void *)-1) {
+		err(1, "mmap");
+	}
+
+	for (r=0; r<nrounds; r++) {
+		storm(go);
+	}
+	printf("Passed.\n");
+	return 0;
+}
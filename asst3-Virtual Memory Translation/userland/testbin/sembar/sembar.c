@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * sembar - semfs batched operations: atomicity check and barrier
+ * benchmark.
+ * usage: sembar [-p nprocs] [-n phases]
+ *
+ * First checks that a SEMFS_IOC_BATCH that can't do all its P
+ * operations does none of them. Then runs NPROCS processes through
+ * PHASES barriers built out of semfs semaphores, once doing V on each
+ * peer with a separate write, and once doing all the Vs with one
+ * batch, and reports the time each took.
+ *
+ * Each process has its own semaphore. At a barrier it does V on every
+ * other process's semaphore and then P on its own for NPROCS-1.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define MAXPROCS	(SEMFS_BATCHMAX + 1)
+
+struct usem {
+	char name[32];
+	unsigned num;		/* semaphore number, for batches */
+	int fd;
+};
+
+static struct usem sems[MAXPROCS];
+static unsigned nprocs = 4;
+static unsigned nphases = 1000;
+
+////////////////////////////////////////////////////////////
+// semaphores
+
+/*
+ * As in multiexec, each process opens the semaphores itself so P on
+ * one handle can't hold up V on it in another process.
+ */
+
+static
+void
+semcreate(const char *tag, struct usem *sem)
+{
+	struct stat st;
+	int fd;
+
+	snprintf(sem->name, sizeof(sem->name), "sem:sembar.%s.%d",
+		 tag, (int)getpid());
+
+	fd = open(sem->name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", sem->name);
+	}
+	if (fstat(fd, &st) < 0) {
+		err(1, "%s: fstat", sem->name);
+	}
+	sem->num = st.st_ino;
+	close(fd);
+}
+
+static
+void
+semopen(struct usem *sem)
+{
+	sem->fd = open(sem->name, O_RDWR, 0664);
+	if (sem->fd < 0) {
+		err(1, "%s: open", sem->name);
+	}
+}
+
+static
+void
+semclose(struct usem *sem)
+{
+	close(sem->fd);
+}
+
+static
+void
+semdestroy(struct usem *sem)
+{
+	remove(sem->name);
+}
+
+static
+unsigned
+semcount(struct usem *sem)
+{
+	struct stat st;
+
+	if (fstat(sem->fd, &st) < 0) {
+		err(1, "%s: fstat", sem->name);
+	}
+	return st.st_size;
+}
+
+static
+void
+semP(struct usem *sem, size_t num)
+{
+	char c[num];
+
+	if (read(sem->fd, c, num) < 0) {
+		err(1, "%s: read", sem->name);
+	}
+	(void)c;
+}
+
+static
+void
+semV(struct usem *sem, size_t num)
+{
+	char c[num];
+
+	/* semfs does not use these values, but be conservative */
+	memset(c, 0, num);
+
+	if (write(sem->fd, c, num) < 0) {
+		err(1, "%s: write", sem->name);
+	}
+}
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: signal %d", (int)pid, WTERMSIG(status));
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: exit %d", (int)pid, WEXITSTATUS(status));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// atomicity
+
+/*
+ * The child waits for P on both A and B at once while only A is
+ * available. A must not be taken until B is too.
+ */
+static
+void
+atomtest(void)
+{
+	struct usem a, b;
+	struct semfs_batch batch;
+	struct timespec ts;
+	pid_t pid;
+
+	printf("Batch atomicity...\n");
+
+	semcreate("a", &a);
+	semcreate("b", &b);
+	semopen(&a);
+	semopen(&b);
+	semV(&a, 1);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		batch.sb_nops = 2;
+		batch.sb_ops[0].so_sem = a.num;
+		batch.sb_ops[0].so_delta = -1;
+		batch.sb_ops[1].so_sem = b.num;
+		batch.sb_ops[1].so_delta = -1;
+		if (ioctl(a.fd, SEMFS_IOC_BATCH, &batch) < 0) {
+			err(1, "SEMFS_IOC_BATCH");
+		}
+		_exit(0);
+	}
+
+	/* give the child time to block */
+	ts.tv_sec = 0;
+	ts.tv_nsec = 200000000;
+	nanosleep(&ts, NULL);
+	if (semcount(&a) != 1) {
+		errx(1, "Blocked batch took %s", a.name);
+	}
+
+	semV(&b, 1);
+	dowait(pid);
+	if (semcount(&a) != 0 || semcount(&b) != 0) {
+		errx(1, "Batch did not take both semaphores");
+	}
+
+	semclose(&a);
+	semclose(&b);
+	semdestroy(&a);
+	semdestroy(&b);
+	printf("Passed.\n");
+}
+
+////////////////////////////////////////////////////////////
+// barrier benchmark
+
+static
+void
+barrier(unsigned me, int batched)
+{
+	struct semfs_batch batch;
+	unsigned i;
+
+	if (batched) {
+		batch.sb_nops = 0;
+		for (i=0; i<nprocs; i++) {
+			if (i != me) {
+				batch.sb_ops[batch.sb_nops].so_sem = sems[i].num;
+				batch.sb_ops[batch.sb_nops].so_delta = 1;
+				batch.sb_nops++;
+			}
+		}
+		if (ioctl(sems[me].fd, SEMFS_IOC_BATCH, &batch) < 0) {
+			err(1, "SEMFS_IOC_BATCH");
+		}
+	}
+	else {
+		for (i=0; i<nprocs; i++) {
+			if (i != me) {
+				semV(&sems[i], 1);
+			}
+		}
+	}
+	semP(&sems[me], nprocs - 1);
+}
+
+static
+void
+worker(unsigned me, int batched)
+{
+	unsigned i;
+
+	for (i=0; i<nprocs; i++) {
+		semopen(&sems[i]);
+	}
+	for (i=0; i<nphases; i++) {
+		barrier(me, batched);
+	}
+	for (i=0; i<nprocs; i++) {
+		semclose(&sems[i]);
+	}
+}
+
+static
+void
+bench(int batched)
+{
+	pid_t pids[MAXPROCS];
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	unsigned i;
+
+	__time(&secs1, &nsecs1);
+	for (i=0; i<nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			worker(i, batched);
+			_exit(0);
+		}
+	}
+	for (i=0; i<nprocs; i++) {
+		dowait(pids[i]);
+	}
+	__time(&secs2, &nsecs2);
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%-8s %u procs, %u phases: %lu us, %lu us per phase, "
+	       "%u syscalls per process per phase\n",
+	       batched ? "batched" : "plain", nprocs, nphases,
+	       usecs, usecs / nphases, batched ? 2 : nprocs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char tag[8];
+	int i;
+
+	for (i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-p") && argv[i+1] != NULL) {
+			nprocs = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-n") && argv[i+1] != NULL) {
+			nphases = atoi(argv[++i]);
+		}
+		else {
+			errx(1, "Usage: sembar [-p nprocs] [-n phases]");
+		}
+	}
+	if (nprocs < 2 || nprocs > MAXPROCS) {
+		errx(1, "nprocs must be between 2 and %d", MAXPROCS);
+	}
+
+	atomtest();
+
+	for (i=0; i<(int)nprocs; i++) {
+		snprintf(tag, sizeof(tag), "%d", i);
+		semcreate(tag, &sems[i]);
+	}
+	bench(0);
+	bench(1);
+	for (i=0; i<(int)nprocs; i++) {
+		semdestroy(&sems[i]);
+	}
+	return 0;
+}
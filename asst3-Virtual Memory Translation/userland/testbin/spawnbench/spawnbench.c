@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * spawnbench - compare ways of starting a program.
+ * usage: spawnbench [-n runs] [-m kbytes] [prog]
+ *
+ * Times RUNS launches of PROG (default /bin/true), each waited for,
+ * done three ways: fork+execv, vfork+execv, and posix_spawn. With -m
+ * the parent first grows and touches a heap of KBYTES, which fork
+ * has to copy and the other two don't.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+static unsigned nruns = 100;
+static const char *prog = "/bin/true";
+static char *args[2];
+
+static
+void
+waitfor(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s failed", prog);
+	}
+}
+
+static
+void
+run_fork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(prog, args);
+		_exit(127);
+	}
+	waitfor(pid);
+}
+
+static
+void
+run_vfork(void)
+{
+	pid_t pid;
+
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		execv(prog, args);
+		_exit(127);
+	}
+	waitfor(pid);
+}
+
+static
+void
+run_spawn(void)
+{
+	pid_t pid;
+	int result;
+
+	result = posix_spawn(&pid, prog, NULL, NULL, args, NULL);
+	if (result) {
+		errno = result;
+		err(1, "posix_spawn: %s", prog);
+	}
+	waitfor(pid);
+}
+
+static
+void
+timeit(const char *name, void (*run)(void))
+{
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	unsigned i;
+
+	__time(&secs1, &nsecs1);
+	for (i=0; i<nruns; i++) {
+		run();
+	}
+	__time(&secs2, &nsecs2);
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%-12s %u runs in %lu us, %lu us each\n",
+	       name, nruns, usecs, usecs / nruns);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned kbytes = 0;
+	char *heap;
+	int j;
+
+	for (j=1; j<argc; j++) {
+		if (!strcmp(argv[j], "-n") && argv[j+1] != NULL) {
+			nruns = atoi(argv[++j]);
+		}
+		else if (!strcmp(argv[j], "-m") && argv[j+1] != NULL) {
+			kbytes = atoi(argv[++j]);
+		}
+		else if (argv[j][0] != '-' && argv[j+1] == NULL) {
+			prog = argv[j];
+		}
+		else {
+			errx(1, "Usage: spawnbench [-n runs] [-m kbytes] "
+			     "[prog]");
+		}
+	}
+	if (nruns == 0) {
+		errx(1, "Need at least one run");
+	}
+	args[0] = (char *)prog;
+	args[1] = NULL;
+
+	if (kbytes > 0) {
+		heap = sbrk(kbytes * 1024);
+		if (heap == (void *)-1) {
+			err(1, "sbrk");
+		}
+		memset(heap, 1, kbytes * 1024);
+		printf("Parent heap: %u KB\n", kbytes);
+	}
+
+	timeit("fork+execv", run_fork);
+	timeit("vfork+execv", run_vfork);
+	timeit("posix_spawn", run_spawn);
+	return 0;
+}
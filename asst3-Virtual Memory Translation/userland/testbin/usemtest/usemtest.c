@@ -27,22 +27,24 @@
  * SUCH DAMAGE.
  */
 
+
 /*
- * Simple test for the user-level semaphores provided by semfs, aka
- * "sem:".
+ * Test and benchmark for user-level semaphores built on futexes.
  *
- * This should mostly run once you've implemented open, read, write,
- * and fork, and run fully once you've also implemented waitpid.
+ * The semaphores live in memory from mmap that the children share
+ * with the parent after fork. P and V are done with atomic
+ * instructions and only call into the kernel (futex_wait and
+ * futex_wake) when a P has to wait or a V has someone to wake.
  *
- * The last part of the test will generally hang, sometimes in fork,
- * unless your filetable/open-file locking is just so.
+ * This needs fork, waitpid, anonymous shared mmap, and the futex
+ * calls.
  */
 
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <stdio.h>
 #include <unistd.h>
-#include <fcntl.h>
+#include <errno.h>
 #include <err.h>
 
 #define ONCELOOPS   3
@@ -51,6 +53,8 @@
 #define LOOPS (ONCELOOPS + 2*TWICELOOPS + 3*THRICELOOPS)
 #define NUMJOBS 4
 
+#define PINGPONGLOOPS 10000
+
 /*
  * Print to the console, one character at a time to encourage
  * interleaving if the semaphores aren't working.
@@ -66,22 +70,6 @@ say(const char *str)
 	}
 }
 
-#if 0 /* not used */
-static
-void
-sayf(const char *str, ...)
-{
-	char buf[256];
-	va_list ap;
-
-	va_start(ap, fmt);
-	vsnprintf(buf, sizeof(buf), fmt, ap);
-	va_end(ap);
-
-	say(str);
-}
-#endif
-
 /*
  * This should probably be in libtest.
  */
@@ -108,85 +96,148 @@ dowait(pid_t pid, unsigned num)
 }
 
 ////////////////////////////////////////////////////////////
-// semaphore access
+// atomic operations
 
 /*
- * Semaphore structure.
+ * Atomic add and compare-and-swap with LL/SC. The sync at the end
+ * keeps later loads (e.g. of a waiter count) from being done before
+ * the update.
  */
-struct usem {
-	char name[32];
-	int fd;
-};
-
 static
 void
-usem_init(struct usem *sem, const char *tag, unsigned num)
+atomic_add(volatile int *p, int delta)
 {
-	snprintf(sem->name, sizeof(sem->name), "sem:usemtest.%s%u", tag, num);
-	sem->fd = open(sem->name, O_RDWR|O_CREAT|O_TRUNC, 0664);
-	if (sem->fd < 0) {
-		err(1, "%s: create", sem->name);
-	}
-	close(sem->fd);
-	sem->fd = -1;
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"addu %1, %0, %3;"	/*   y = x + delta */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   if it failed, try again */
+		"nop;"			/*   (delay slot) */
+		"sync;"			/* memory barrier */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y) : "r" (p), "r" (delta) : "memory");
 }
 
 static
-void
-usem_open(struct usem *sem)
+int
+atomic_cas(volatile int *p, int oldval, int newval)
 {
-	sem->fd = open(sem->name, O_RDWR);
-	if (sem->fd < 0) {
-		err(1, "%s: open", sem->name);
-	}
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   if x != oldval, give up */
+		"move %1, %4;"		/*   y = newval (delay slot) */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   if it failed, try again */
+		"nop;"			/*   (delay slot) */
+		"2: sync;"		/* memory barrier */
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (oldval), "r" (newval)
+		: "memory");
+	return x == oldval;
 }
 
+////////////////////////////////////////////////////////////
+// semaphores
+
+/*
+ * Semaphore structure. COUNT is the semaphore's value; WAITERS is how
+ * many processes are in (or about to be in) futex_wait on it, so V
+ * knows whether it has to call futex_wake. SLEEPS counts the P
+ * operations that had to go into the kernel, for the statistics.
+ */
+struct usem {
+	volatile int count;
+	volatile int waiters;
+	volatile int sleeps;
+};
+
+static unsigned long numsleeps;
+static unsigned long numops;
+
+/*
+ * Get NUM semaphores, with value 0, in memory that will be shared
+ * with children forked afterwards.
+ */
 static
-void
-usem_close(struct usem *sem)
+struct usem *
+usem_create(unsigned num)
 {
-	if (close(sem->fd) == -1) {
-		warn("%s: close", sem->name);
+	struct usem *sems;
+
+	sems = mmap(num * sizeof(*sems), PROT_READ|PROT_WRITE, -1, 0);
+	if (sems == (void *)-1) {
+		err(1, "mmap");
 	}
+	/* mmap memory comes zeroed */
+	return sems;
 }
 
 static
 void
-usem_cleanup(struct usem *sem)
+P(struct usem *sem)
 {
-	(void)remove(sem->name);
+	int c;
+
+	while (1) {
+		c = sem->count;
+		if (c > 0) {
+			if (atomic_cas(&sem->count, c, c - 1)) {
+				return;
+			}
+			continue;
+		}
+
+		/*
+		 * Announce ourselves before checking the count again
+		 * in futex_wait, so a V either sees us or we see its
+		 * increment and don't sleep.
+		 */
+		atomic_add(&sem->waiters, 1);
+		atomic_add(&sem->sleeps, 1);
+		if (futex_wait(&sem->count, 0) < 0 && errno != EAGAIN) {
+			err(1, "futex_wait");
+		}
+		atomic_add(&sem->waiters, -1);
+	}
 }
 
 static
 void
-P(struct usem *sem)
+V(struct usem *sem)
 {
-	ssize_t r;
-	char c;
-
-	r = read(sem->fd, &c, 1);
-	if (r < 0) {
-		err(1, "%s: read", sem->name);
-	}
-	if (r == 0) {
-		errx(1, "%s: read: unexpected EOF", sem->name);
+	atomic_add(&sem->count, 1);
+	if (sem->waiters > 0) {
+		if (futex_wake(&sem->count, 1) < 0) {
+			err(1, "futex_wake");
+		}
 	}
 }
 
+/*
+ * Add up the statistics for a set of semaphores that have been
+ * through OPS P operations in total.
+ */
 static
 void
-V(struct usem *sem)
+usem_tally(struct usem *sems, unsigned num, unsigned long ops)
 {
-	ssize_t r;
-	char c;
+	unsigned i;
 
-	r = write(sem->fd, &c, 1);
-	if (r < 0) {
-		err(1, "%s: write", sem->name);
-	}
-	if (r == 0) {
-		errx(1, "%s: write: short count", sem->name);
+	for (i=0; i<num; i++) {
+		numsleeps += sems[i].sleeps;
 	}
+	numops += ops;
 }
 
 ////////////////////////////////////////////////////////////
@@ -214,28 +265,12 @@ child_plain(struct usem *gosem, struct usem *waitsem, unsigned num)
 	}
 }
 
-static
-void
-child_with_own_fd(struct usem *gosem, struct usem *waitsem, unsigned num)
-{
-	usem_open(gosem);
-	usem_open(waitsem);
-	child_plain(gosem, waitsem, num);
-	usem_close(gosem);
-	usem_close(waitsem);
-}
-
 static
 void
 baseparent(struct usem *gosems, struct usem *waitsems)
 {
 	unsigned i, j;
 
-	for (i=0; i<NUMJOBS; i++) {
-		usem_open(&gosems[i]);
-		usem_open(&waitsems[i]);
-	}
-
 	say("Once...\n");
 	for (j=0; j<ONCELOOPS; j++) {
 		for (i=0; i<NUMJOBS; i++) {
@@ -273,11 +308,6 @@ baseparent(struct usem *gosems, struct usem *waitsems)
 			putchar('\n');
 		}
 	}
-
-	for (i=0; i<NUMJOBS; i++) {
-		usem_close(&gosems[i]);
-		usem_close(&waitsems[i]);
-	}
 }
 
 static
@@ -285,13 +315,11 @@ void
 basetest(void)
 {
 	unsigned i;
-	struct usem gosems[NUMJOBS], waitsems[NUMJOBS];
+	struct usem *gosems, *waitsems;
 	pid_t pids[NUMJOBS];
 
-	for (i=0; i<NUMJOBS; i++) {
-		usem_init(&gosems[i], "g", i);
-		usem_init(&waitsems[i], "w", i);
-	}
+	gosems = usem_create(NUMJOBS);
+	waitsems = usem_create(NUMJOBS);
 
 	for (i=0; i<NUMJOBS; i++) {
 		pids[i] = fork();
@@ -299,7 +327,7 @@ basetest(void)
 			err(1, "fork");
 		}
 		if (pids[i] == 0) {
-			child_with_own_fd(&gosems[i], &waitsems[i], i);
+			child_plain(&gosems[i], &waitsems[i], i);
 			_exit(0);
 		}
 	}
@@ -309,10 +337,8 @@ basetest(void)
 		dowait(pids[i], i);
 	}
 
-	for (i=0; i<NUMJOBS; i++) {
-		usem_cleanup(&gosems[i]);
-		usem_cleanup(&waitsems[i]);
-	}
+	usem_tally(gosems, NUMJOBS, NUMJOBS * LOOPS);
+	usem_tally(waitsems, NUMJOBS, NUMJOBS * LOOPS);
 }
 
 static
@@ -321,10 +347,6 @@ concparent(struct usem *gosems, struct usem *waitsems)
 {
 	unsigned i, j;
 
-	/*
-	 * Print this *before* forking as we frequently hang *in* fork.
-	 *say("Shoot...\n");
-	 */
 	for (j=0; j<LOOPS; j++) {
 		for (i=0; i<NUMJOBS; i++) {
 			V(&gosems[i]);
@@ -340,17 +362,13 @@ void
 conctest(void)
 {
 	unsigned i;
-	struct usem gosems[NUMJOBS], waitsems[NUMJOBS];
+	struct usem *gosems, *waitsems;
 	pid_t pids[NUMJOBS];
 
 	say("Shoot...\n");
 
-	for (i=0; i<NUMJOBS; i++) {
-		usem_init(&gosems[i], "g", i);
-		usem_init(&waitsems[i], "w", i);
-		usem_open(&gosems[i]);
-		usem_open(&waitsems[i]);
-	}
+	gosems = usem_create(NUMJOBS);
+	waitsems = usem_create(NUMJOBS);
 
 	for (i=0; i<NUMJOBS; i++) {
 		pids[i] = fork();
@@ -368,22 +386,69 @@ conctest(void)
 		dowait(pids[i], i);
 	}
 
-	for (i=0; i<NUMJOBS; i++) {
-		usem_close(&gosems[i]);
-		usem_close(&waitsems[i]);
-		usem_cleanup(&gosems[i]);
-		usem_cleanup(&waitsems[i]);
-	}
+	usem_tally(gosems, NUMJOBS, NUMJOBS * LOOPS);
+	usem_tally(waitsems, NUMJOBS, NUMJOBS * LOOPS);
 }
 
 ////////////////////////////////////////////////////////////
-// concurrent use test
+// benchmark
+
+/*
+ * Parent and child take turns PINGPONGLOOPS times, each waking the
+ * other with V and waiting with P, and we time the round trips.
+ * Every P here has to wait, so this measures the slow path; the
+ * count of kernel entries afterwards shows how much the fast path
+ * saved in the tests above.
+ */
+static
+void
+pingpong(void)
+{
+	struct usem *sems;
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2, usecs;
+	unsigned i;
+	pid_t pid;
+
+	say("Ping-pong...\n");
+
+	sems = usem_create(2);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		for (i=0; i<PINGPONGLOOPS; i++) {
+			P(&sems[0]);
+			V(&sems[1]);
+		}
+		_exit(0);
+	}
+
+	__time(&secs1, &nsecs1);
+	for (i=0; i<PINGPONGLOOPS; i++) {
+		V(&sems[0]);
+		P(&sems[1]);
+	}
+	__time(&secs2, &nsecs2);
+	dowait(pid, 0);
+
+	usecs = (secs2 - secs1) * 1000000 + nsecs2 / 1000 - nsecs1 / 1000;
+	printf("%u round trips in %lu us, %lu us each\n",
+	       PINGPONGLOOPS, usecs, usecs / PINGPONGLOOPS);
+
+	usem_tally(sems, 2, 2 * PINGPONGLOOPS);
+}
 
 int
 main(void)
 {
 	basetest();
 	conctest();
+	pingpong();
+	printf("%lu of %lu P operations entered the kernel\n",
+	       numsleeps, numops);
 	say("Passed.\n");
 	return 0;
 }